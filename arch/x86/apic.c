@@ -0,0 +1,208 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#include <kernel/interrupts.h>
+#include <kernel/thread.h>
+#include <kernel/timer.h>
+#include <kernel/cpu.h>
+#include <kernel/spinlock.h>
+#include <arch/common_op.h>
+#include <arch/x86/apic.h>
+#include <arch/x86/vmm.h>
+#include <config.h>
+#include <stdio.h>
+#include <debug.h>
+
+/*
+** Local APIC driver.
+**
+** Each processor has it's own local APIC, all of them being mapped at the
+** same physical address. It is used to send inter-processor interrupts,
+** and as the periodic timer of the application processors (the boot
+** processor keeps using the platform timer).
+*/
+
+static volatile uint32 *lapic;
+static struct spinlock lapic_lock;
+
+/* Initial count of the timer to tick HZ times per second */
+static uint32 lapic_timer_count;
+
+static inline uint32
+lapic_read(uint reg)
+{
+	return (lapic[reg / sizeof(uint32)]);
+}
+
+static inline void
+lapic_write(uint reg, uint32 value)
+{
+	lapic[reg / sizeof(uint32)] = value;
+	(void)lapic_read(LAPIC_ID); /* Wait for the write to complete */
+}
+
+bool
+lapic_present(void)
+{
+	return (lapic != NULL);
+}
+
+/*
+** Returns the id of the local APIC of the current processor.
+*/
+uint
+lapic_id(void)
+{
+	return (lapic_read(LAPIC_ID) >> 24u);
+}
+
+/*
+** Signals the end of the current interrupt.
+*/
+void
+lapic_eoi(void)
+{
+	lapic_write(LAPIC_EOI, 0);
+}
+
+/*
+** Waits until the previous inter-processor interrupt was sent.
+*/
+static void
+lapic_wait_icr(void)
+{
+	while (lapic_read(LAPIC_ICR_LOW) & LAPIC_ICR_PENDING) {
+		pause();
+	}
+}
+
+/*
+** Sends the given interrupt vector to the processor with the given id.
+*/
+void
+lapic_send_ipi(uint apic_id, uint vector)
+{
+	LOCK(&lapic_lock, state);
+	lapic_wait_icr();
+	lapic_write(LAPIC_ICR_HIGH, apic_id << 24u);
+	lapic_write(LAPIC_ICR_LOW, vector | LAPIC_ICR_ASSERT);
+	RELEASE(&lapic_lock, state);
+}
+
+/*
+** Starts the given application processor with the INIT-SIPI-SIPI
+** sequence. It begins executing in real mode, at the given page.
+*/
+void
+lapic_start_ap(uint apic_id, phys_addr_t entry)
+{
+	uint i;
+
+	assert(IS_PAGE_ALIGNED(entry));
+	assert_lo(entry, 0x100000);
+
+	lapic_wait_icr();
+	lapic_write(LAPIC_ICR_HIGH, apic_id << 24u);
+	lapic_write(LAPIC_ICR_LOW, LAPIC_ICR_INIT | LAPIC_ICR_ASSERT);
+	platform_udelay(10000);
+
+	for (i = 0; i < 2; ++i)
+	{
+		lapic_wait_icr();
+		lapic_write(LAPIC_ICR_HIGH, apic_id << 24u);
+		lapic_write(LAPIC_ICR_LOW, LAPIC_ICR_STARTUP | LAPIC_ICR_ASSERT | (entry >> 12u));
+		platform_udelay(200);
+	}
+	lapic_wait_icr();
+}
+
+/*
+** Enables the local APIC of the current processor.
+*/
+void
+lapic_setup(void)
+{
+	lapic_write(LAPIC_TPR, 0);
+	lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | LAPIC_VECTOR_SPURIOUS);
+}
+
+/*
+** Starts the periodic timer of the current processor.
+*/
+void
+lapic_timer_start(void)
+{
+	lapic_write(LAPIC_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_BY_16);
+	lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_PERIODIC | LAPIC_VECTOR_TIMER);
+	lapic_write(LAPIC_TIMER_INIT, lapic_timer_count);
+}
+
+/*
+** Measures the frequency of the timer against the platform timer, so it
+** ticks HZ times per second.
+*/
+static void
+lapic_timer_calibrate(void)
+{
+	uint32 elapsed;
+
+	lapic_write(LAPIC_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_BY_16);
+	lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_MASKED | LAPIC_VECTOR_TIMER);
+	lapic_write(LAPIC_TIMER_INIT, 0xFFFFFFFF);
+	platform_udelay(10000);
+	elapsed = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CURRENT);
+	lapic_write(LAPIC_TIMER_INIT, 0);
+
+	lapic_timer_count = elapsed * 100u / HZ;
+	if (lapic_timer_count == 0) {
+		lapic_timer_count = 1;
+	}
+}
+
+static enum handler_return
+lapic_timer_handler(void)
+{
+	return (sched_tick());
+}
+
+static enum handler_return
+lapic_reschedule_handler(void)
+{
+	return (IRQ_RESCHEDULE);
+}
+
+/*
+** Sends a reschedule interrupt to the given processor, so it picks up
+** the threads that became runnable.
+*/
+void
+arch_cpu_kick(struct cpu *cpu)
+{
+	if (lapic_present() && cpu->online) {
+		lapic_send_ipi(cpu->arch.apic_id, LAPIC_VECTOR_RESCHEDULE);
+	}
+}
+
+/*
+** Maps the local APIC registers and enables the one of the boot processor.
+*/
+status_t __init
+lapic_init(phys_addr_t base)
+{
+	init_lock(&lapic_lock);
+	lapic = (volatile uint32 *)arch_map_mmio(base, PAGE_SIZE);
+	if (lapic == NULL) {
+		return (ERR_NO_MEMORY);
+	}
+	lapic_setup();
+	lapic_timer_calibrate();
+	register_int_handler(LAPIC_IRQ_TIMER, &lapic_timer_handler);
+	register_int_handler(LAPIC_IRQ_RESCHEDULE, &lapic_reschedule_handler);
+	return (OK);
+}
@@ -9,11 +9,11 @@
 
 global start:function
 global ret_kernel_main
+global boot_page_directory
 
 extern gdtptr_phys
-extern gdtptr
 extern idt_setup
-extern tss_setup
+extern x86_boot_cpu_setup
 extern kernel_main
 extern mb_tag
 
@@ -94,12 +94,7 @@ start:
 .higher_half:
 	mov esp, kernel_stack_top	; Reset kernel stack
 
-	call tss_setup			; Setup the Task State Segment
-
-	lgdt [gdtptr]			; Reload the gdt
-
-	mov ax, TSS_SELECTOR | 0b11
-	ltr ax
+	call x86_boot_cpu_setup		; Setup the per-CPU GDT, TSS and data segment
 
 	; Unmap the low memory
 	mov dword [boot_page_directory.first_entry], 0
@@ -136,8 +131,8 @@ boot_page_directory:
 high_kernel_page_table:
 	times 1024 dd 0
 
-section .bss
-align 4096
+; The boot stack is freed once the kernel is initialized (see kernel.ld)
+section .init.bss nobits alloc noexec write align=4096
 
 kernel_stack_bottom:
 	resb 4096 * 16			; Byte reserved for kernel stack (at boot-time)
@@ -0,0 +1,80 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#include <kernel/cpu.h>
+#include <arch/x86/tss.h>
+#include <arch/x86/x86.h>
+#include <arch/x86/fpu.h>
+#include <string.h>
+
+/*
+** Per-CPU data.
+**
+** Each processor loads it's own copy of the GDT, where the per-CPU data
+** segment starts at it's struct cpu. That segment is kept in %gs, so
+** %gs:0 is always the struct cpu of the current processor.
+*/
+
+/* The boot GDT, defined in gdt.asm */
+extern uint64 gdt[GDT_NB_ENTRIES];
+
+struct gdt_ptr
+{
+	uint16 limit;
+	uint32 base;
+} __packed;
+
+static void
+gdt_set_base(uint64 *entry, uintptr base)
+{
+	*entry &= ~0xFF0000FFFFFF0000ull;
+	*entry |= ((uint64)(base & 0xFFFFFF) << 16u) | ((uint64)(base >> 24u) << 56u);
+}
+
+/*
+** Loads the GDT, the TSS and the per-CPU data segment of the given
+** structure on the current processor, and enables it's FPU.
+*/
+void
+x86_cpu_setup(struct cpu *cpu)
+{
+	struct gdt_ptr ptr;
+
+	cpu->self = cpu;
+	memcpy(cpu->arch.gdt, gdt, sizeof(cpu->arch.gdt));
+	tss_setup(&cpu->arch.tss, (struct gdt_tss_entry *)(cpu->arch.gdt + TSS_SELECTOR / 8));
+	gdt_set_base(cpu->arch.gdt + PERCPU_SELECTOR / 8, (uintptr)cpu);
+
+	ptr.limit = sizeof(cpu->arch.gdt) - 1;
+	ptr.base = (uintptr)cpu->arch.gdt;
+	asm volatile("lgdt %0" :: "m"(ptr));
+	asm volatile("ltr %w0" :: "r"(TSS_SELECTOR | 0b11));
+	asm volatile("movw %w0, %%gs" :: "r"(PERCPU_SELECTOR));
+
+	x86_fpu_setup(cpu);
+}
+
+/*
+** Sets up the per-CPU data of the boot processor.
+** Called by boot.asm, before anything else.
+*/
+void __init
+x86_boot_cpu_setup(void)
+{
+	x86_cpu_setup(cpus + BOOT_CPU_ID);
+}
+
+struct cpu *
+current_cpu(void)
+{
+	struct cpu *cpu;
+
+	asm volatile("movl %%gs:0, %0" : "=r"(cpu));
+	return (cpu);
+}
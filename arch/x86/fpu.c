@@ -0,0 +1,210 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#include <kernel/thread.h>
+#include <kernel/kalloc.h>
+#include <kernel/cpu.h>
+#include <arch/x86/fpu.h>
+#include <arch/x86/asm.h>
+#include <arch/x86/x86.h>
+#include <string.h>
+
+/*
+** Lazy FPU/SSE context switching.
+**
+** The kernel never uses the FPU, so it's registers are only switched for
+** the threads that actually use them. Each processor remembers the thread
+** whose state is in it's registers. When an other thread is switched in,
+** CR0.TS is set, so the first FPU instruction it executes raises a #NM
+** trap, where it's state is loaded (or initialized, the first time).
+**
+** The state of the owner is saved when it's switched out, so it's always
+** up to date in memory and the thread can be loaded on any processor. A
+** thread that gets back on the processor that still has it's registers
+** doesn't trap at all.
+**
+** Everything runs with interrupts disabled, and the owner of a processor
+** is only changed by that processor.
+*/
+
+static inline void
+fxsave(struct fpu_state *fpu)
+{
+	asm volatile("fxsave %0" : "=m"(fpu->fxsave));
+}
+
+static inline void
+fxrstor(struct fpu_state *fpu)
+{
+	asm volatile("fxrstor %0" :: "m"(fpu->fxsave));
+}
+
+/*
+** Makes the next FPU instruction trap, or not.
+** CR0 is only written if it needs to be.
+*/
+static inline void
+fpu_set_trap(struct cpu *cpu, bool trap)
+{
+	if (cpu->arch.fpu_trap != trap) {
+		if (trap) {
+			set_cr0(get_cr0() | CR0_TS);
+		} else {
+			clts();
+		}
+		cpu->arch.fpu_trap = trap;
+	}
+}
+
+static struct fpu_state *
+fpu_alloc(void)
+{
+	struct fpu_state *fpu;
+	void *alloc;
+
+	/* kalloc() doesn't align on 16 bytes as FXSAVE requires */
+	alloc = kalloc(sizeof(*fpu) + 15);
+	if (alloc == NULL) {
+		return (NULL);
+	}
+	fpu = (struct fpu_state *)ALIGN((uintptr)alloc, 16);
+	fpu->alloc = alloc;
+	return (fpu);
+}
+
+/*
+** Enables the FPU (and SSE, if ENABLE_SSE is defined) on the current
+** processor. Nobody owns it yet, so the first use traps.
+*/
+void
+x86_fpu_setup(struct cpu *cpu)
+{
+	uintptr cr0;
+
+	cr0 = get_cr0();
+	cr0 &= ~CR0_EM;
+	cr0 |= CR0_MP | CR0_NE | CR0_TS;
+	set_cr0(cr0);
+#ifdef ENABLE_SSE
+	set_cr4(get_cr4() | CR4_OSFXSR | CR4_OSXMMEXCPT);
+#endif /* ENABLE_SSE */
+	cpu->arch.fpu_owner = NULL;
+	cpu->arch.fpu_trap = true;
+}
+
+/*
+** Saves the FPU state of the thread being switched out, if it's in the
+** registers, and makes the next FPU instruction trap unless the registers
+** already belong to the new thread.
+** Threads that never used the FPU only cost a comparison.
+*/
+void
+x86_fpu_switch(struct thread *old, struct thread *new)
+{
+	struct cpu *cpu;
+
+	cpu = current_cpu();
+	if (cpu->arch.fpu_owner == old && !cpu->arch.fpu_trap) {
+		fxsave(old->arch.fpu);
+	}
+	fpu_set_trap(cpu, cpu->arch.fpu_owner != new);
+}
+
+/*
+** Handler of the #NM trap: loads the FPU state of the current thread,
+** or initializes it the first time it uses the FPU.
+*/
+status_t
+x86_fpu_trap(void)
+{
+	struct thread *t;
+	struct cpu *self;
+	struct cpu *cpu;
+
+	t = get_current_thread();
+	self = current_cpu();
+
+	/* The state of an other processor may not be the latest anymore */
+	for (cpu = cpus; cpu < cpus + nb_cpus; ++cpu) {
+		if (cpu != self && cpu->arch.fpu_owner == t) {
+			cpu->arch.fpu_owner = NULL;
+		}
+	}
+
+	fpu_set_trap(self, false);
+	if (t->arch.fpu == NULL) {
+		t->arch.fpu = fpu_alloc();
+		if (t->arch.fpu == NULL) {
+			self->arch.fpu_owner = NULL;
+			fpu_set_trap(self, true);
+			return (ERR_NO_MEMORY);
+		}
+		asm volatile("fninit");
+#ifdef ENABLE_SSE
+		asm volatile("ldmxcsr %0" :: "m"((uint32){MXCSR_DEFAULT}));
+#endif /* ENABLE_SSE */
+	} else {
+		fxrstor(t->arch.fpu);
+	}
+	self->arch.fpu_owner = t;
+	return (OK);
+}
+
+/*
+** Gives the new thread a copy of the FPU state of the current one, which
+** is forking.
+*/
+status_t
+x86_fpu_fork(struct thread *new)
+{
+	struct thread *t;
+	struct cpu *cpu;
+
+	t = get_current_thread();
+	new->arch.fpu = NULL;
+	if (t->arch.fpu == NULL) {
+		return (OK);
+	}
+
+	new->arch.fpu = fpu_alloc();
+	if (new->arch.fpu == NULL) {
+		return (ERR_NO_MEMORY);
+	}
+
+	/* The registers may be more recent than the saved state */
+	cpu = current_cpu();
+	if (cpu->arch.fpu_owner == t && !cpu->arch.fpu_trap) {
+		fxsave(t->arch.fpu);
+	}
+	memcpy(new->arch.fpu->fxsave, t->arch.fpu->fxsave, sizeof(t->arch.fpu->fxsave));
+	return (OK);
+}
+
+/*
+** Frees the FPU state of the given thread, which either exited or is
+** starting a new program.
+*/
+void
+x86_fpu_release(struct thread *t)
+{
+	struct cpu *cpu;
+
+	for (cpu = cpus; cpu < cpus + nb_cpus; ++cpu) {
+		if (cpu->arch.fpu_owner == t) {
+			cpu->arch.fpu_owner = NULL;
+		}
+	}
+	if (t == get_current_thread()) {
+		fpu_set_trap(current_cpu(), true);
+	}
+	if (t->arch.fpu != NULL) {
+		kfree(t->arch.fpu->alloc);
+		t->arch.fpu = NULL;
+	}
+}
@@ -7,9 +7,8 @@
 ;;
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 
-global gdt_tss_entry
+global gdt
 global gdtptr_phys
-global gdtptr
 
 %include "include/arch/x86/asm.mac"
 
@@ -20,12 +19,6 @@ gdtptr_phys:
 	dw gdt_end - gdt_start - 1
 	dd PHYS(gdt)
 
-section .rodata
-align 16
-gdtptr:
-	dw gdt_end - gdt_start - 1
-	dd gdt
-
 section .data
 align 16
 gdt:
@@ -66,8 +59,7 @@ gdt_start:
 	db 0b11001111	; G(1) S(1) (0) (0) limit 19:16
 	db 0x00		; base 31:24
 
-gdt_tss_entry:
-	; Tss selector
+	; Tss selector (base and limit are set for each processor)
 	dw 0x0000	; limit 15:0
 	dw 0x0000	; base 15:0
 	db 0x00		; base 23:16
@@ -75,7 +67,11 @@ gdt_tss_entry:
 	db 0b10000000	; G(1) 0 0 AVL(0) limit 19:16
 	db 0x00		; base 31:24
 
-	; Null entry
-	dd 0
-	dd 0
+	; Per-CPU data selector (base is set for each processor)
+	dw 0xFFFF	; limit 15:0
+	dw 0x0000	; base 15:0
+	db 0x00		; base 23:16
+	db 0b10010010	; P(1) DPL(00) (1) C(0) E(0) W(1) A(0)
+	db 0b01000000	; G(0) S(1) (0) (0) limit 19:16
+	db 0x00		; base 31:24
 gdt_end:
@@ -12,6 +12,7 @@
 bits 32
 global idt
 global idt_setup
+global idt_load
 extern x86_exception_handler
 extern x86_irq_handler
 extern x86_syscalls_handler
@@ -52,6 +53,7 @@ extern idt_set_vector
 		mov ds, ax
 		mov es, ax
 		mov fs, ax
+		mov ax, PERCPU_SELECTOR	; Per-CPU data of the current processor
 		mov gs, ax
 
 		push esp	; Push the stack frame on the stack
@@ -129,6 +131,13 @@ NEW_EXCEPTION_HANDLER		0xD,		irq_D,				IRQ
 NEW_EXCEPTION_HANDLER		0xE,		irq_E,				IRQ
 NEW_EXCEPTION_HANDLER		0xF,		irq_F,				IRQ
 
+; Generates the local APIC interrupt handlers
+;
+; macro				id		name				irq
+NEW_EXCEPTION_HANDLER		0x10,		lapic_timer,			IRQ
+NEW_EXCEPTION_HANDLER		0x11,		lapic_resched,			IRQ
+NEW_EXCEPTION_HANDLER		0x12,		lapic_spurious,			IRQ
+
 ; Generates the syscall handler
 ;
 ; macro				id		name				syscall
@@ -203,6 +212,11 @@ idt_setup:
 	ADD_IDT_ENTRY		0x2E,		irq_E
 	ADD_IDT_ENTRY		0x2F,		irq_F
 
+	; Add the local APIC interrupts in the IDT
+	ADD_IDT_ENTRY		0x30,		lapic_timer
+	ADD_IDT_ENTRY		0x31,		lapic_resched
+	ADD_IDT_ENTRY		0x3F,		lapic_spurious
+
 	mov dword [esp + 0x8], 0xF		; Set the interrupt gate to Trap Interrupt 32 bits
 	mov dword [esp + 0x4], 0x3		; DPL (Ring 3)
 
@@ -213,3 +227,8 @@ idt_setup:
 
 	lidt [idtptr]
 	ret
+
+; Loads the Interrupt Descriptor Table on an other processor
+idt_load:
+	lidt [idtptr]
+	ret
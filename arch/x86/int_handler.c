@@ -10,7 +10,11 @@
 #include <kernel/syscall.h>
 #include <kernel/thread.h>
 #include <kernel/interrupts.h>
+#include <kernel/swap.h>
 #include <arch/x86/interrupts.h>
+#include <arch/x86/apic.h>
+#include <arch/x86/fpu.h>
+#include <arch/x86/vmm.h>
 #include <stdio.h>
 
 __noreturn static void
@@ -27,6 +31,22 @@ x86_division_by_zero_handler(struct iframe *iframe __unused)
 	return (OK);
 }
 
+static status_t
+x86_fpu_exception_handler(struct iframe *iframe __unused)
+{
+	thread_exit(136); /* Boom, headshot! */
+	return (OK);
+}
+
+static status_t
+x86_device_na_handler(struct iframe *iframe __unused)
+{
+	if (x86_fpu_trap() != OK) {
+		thread_exit(137); /* Out of memory for it's FPU state */
+	}
+	return (OK);
+}
+
 static status_t
 x86_breakpoint_handler(struct iframe *iframe)
 {
@@ -42,9 +62,21 @@ x86_pagefault_handler(struct iframe *iframe)
 {
 	uintptr addr;
 
+	addr = get_cr2();
+
+	/* The kernel page table may have been allocated by an other address space */
+	if (!(iframe->err_code & 0x1) && arch_sync_kernel_pde((virt_addr_t)addr)) {
+		return (OK);
+	}
+
+	/* The page may have been swapped out */
+	if (!(iframe->err_code & 0x1)
+		&& swap_in((virt_addr_t)ROUND_DOWN(addr, PAGE_SIZE)) == OK) {
+		return (OK);
+	}
+
 	if (unlikely(get_current_thread()->pid <= 1)) /* Usefull for early boot crash */
 	{
-		addr = get_cr2();
 		printf("Page Fault at address %#p.\n"
 			"\tAddress: %#p\n"
 			"\tPresent: %y\n"
@@ -84,6 +116,13 @@ x86_exception_handler(struct iframe *iframe)
 	case X86_INT_BREAKPOINT:
 		x86_breakpoint_handler(iframe);
 		break;
+	case X86_INT_DEVICE_NA:
+		x86_device_na_handler(iframe);
+		break;
+	case X86_INT_FPU_EXCEPTION:
+	case X86_INT_SIMD_FP_EXCEPTION:
+		x86_fpu_exception_handler(iframe);
+		break;
 	case X86_INT_PAGE_FAULT:
 		x86_pagefault_handler(iframe);
 		break;
@@ -106,10 +145,17 @@ x86_irq_handler(struct iframe * iframe)
 
 	ret = handle_interrupt(iframe->int_num);
 
-	/* Reset the PICs */
-	if (iframe->err_code > 7)
-		RESET_SLAVE_PIC();
-	RESET_MASTER_PIC();
+	if (iframe->int_num >= LAPIC_IRQ_TIMER) {
+		/* Spurious interrupts must not be acknowledged */
+		if (iframe->int_num != LAPIC_IRQ_SPURIOUS) {
+			lapic_eoi();
+		}
+	} else {
+		/* Reset the PICs */
+		if (iframe->err_code > 7)
+			RESET_SLAVE_PIC();
+		RESET_MASTER_PIC();
+	}
 
 	if (ret == IRQ_RESCHEDULE) {
 		thread_yield();
@@ -166,6 +212,18 @@ x86_syscalls_handler(struct iframe *iframe)
 		case READDIR:
 			iframe->eax = sys_readdir(iframe->edi, (struct dirent *)iframe->esi);
 			break;
+		case SLEEP:
+			iframe->eax = sys_sleep(iframe->edi);
+			break;
+		case NANOSLEEP:
+			iframe->eax = sys_nanosleep((struct timespec const *)iframe->edi);
+			break;
+		case SPAWN:
+			iframe->eax = sys_spawn((char const *)iframe->edi, (int (*)())iframe->esi, (char const **)iframe->edx);
+			break;
+		case FUTEX:
+			iframe->eax = sys_futex((uint32 *)iframe->edi, (int)iframe->esi, (uint32)iframe->edx);
+			break;
 		default:
 			panic("Unknown syscall %p\n", iframe->eax);
 	}
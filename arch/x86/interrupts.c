@@ -113,6 +113,16 @@ arch_disable_interrupts(void)
 	cli();
 }
 
+/*
+** Waits for the next interrupt, and returns with interrupts disabled.
+*/
+void
+arch_wait_for_interrupt(void)
+{
+	sti_hlt();
+	cli();
+}
+
 void
 arch_push_interrupts(int_state_t *save)
 {
@@ -151,7 +161,7 @@ setup_default_idt(void)
 	}
 }
 
-static void
+static void __init
 interrupt_init(enum init_level il __unused)
 {
 	/* Remapping IRQ */
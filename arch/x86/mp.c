@@ -0,0 +1,136 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#include <kernel/init.h>
+#include <kernel/cpu.h>
+#include <kernel/linker.h>
+#include <arch/x86/apic.h>
+#include <arch/x86/mp.h>
+#include <arch/x86/vmm.h>
+#include <string.h>
+#include <stdio.h>
+
+/*
+** Processors discovery, using the tables of the MultiProcessor
+** Specification.
+**
+** ACPI isn't supported yet, but the BIOS of QEMU (and of most machines)
+** still provides the MP tables.
+*/
+
+static bool __init
+checksum_ok(void const *addr, size_t len)
+{
+	uchar const *p;
+	uchar sum;
+
+	p = addr;
+	sum = 0;
+	while (len--) {
+		sum += *p++;
+	}
+	return (sum == 0);
+}
+
+/*
+** Looks for the MP floating pointer structure in the given physical area.
+*/
+static struct mp_floating * __init
+mp_search(phys_addr_t start, size_t len)
+{
+	struct mp_floating *mp;
+	struct mp_floating *end;
+
+	mp = low_mem(start);
+	end = low_mem(start + len);
+	while (mp < end)
+	{
+		if (!memcmp(mp->signature, MP_FLOATING_SIGNATURE, 4)
+			&& checksum_ok(mp, mp->length * 16u)) {
+			return (mp);
+		}
+		++mp;
+	}
+	return (NULL);
+}
+
+/*
+** Looks for the MP floating pointer structure in the first KiB of the
+** EBDA, in the last KiB of the base memory or in the BIOS ROM.
+*/
+static struct mp_floating * __init
+mp_find(void)
+{
+	struct mp_floating *mp;
+	phys_addr_t ebda;
+
+	ebda = (phys_addr_t)(*(uint16 *)low_mem(0x40E)) << 4u;
+	if (ebda && (mp = mp_search(ebda, 1024)) != NULL) {
+		return (mp);
+	}
+	if ((mp = mp_search(0x9FC00, 1024)) != NULL) {
+		return (mp);
+	}
+	return (mp_search(0xF0000, 0x10000));
+}
+
+/*
+** Registers the application processors listed in the MP configuration
+** table, and enables the local APIC of the boot processor.
+*/
+static void __init
+mp_init(enum init_level il __unused)
+{
+	struct mp_floating *mp;
+	struct mp_config *conf;
+	struct mp_processor *proc;
+	struct cpu *cpu;
+	uchar *entry;
+	uint i;
+
+	mp = mp_find();
+	if (mp == NULL || mp->default_config || mp->config == 0 || mp->config >= 0x100000) {
+		printf("[OK]\tSMP: no MP table, uniprocessor mode\n");
+		return ;
+	}
+	conf = low_mem(mp->config);
+	if (memcmp(conf->signature, MP_CONFIG_SIGNATURE, 4) || !checksum_ok(conf, conf->length)) {
+		printf("[OK]\tSMP: invalid MP table, uniprocessor mode\n");
+		return ;
+	}
+
+	if (lapic_init(conf->lapic_addr) != OK) {
+		printf("[OK]\tSMP: can't map the local APIC, uniprocessor mode\n");
+		return ;
+	}
+	cpus[BOOT_CPU_ID].arch.apic_id = lapic_id();
+
+	entry = (uchar *)(conf + 1);
+	for (i = 0; i < conf->nb_entries; ++i)
+	{
+		if (*entry != MP_ENTRY_PROCESSOR) {
+			entry += MP_ENTRY_SIZE;
+			continue;
+		}
+		proc = (struct mp_processor *)entry;
+		entry += sizeof(*proc);
+		if (!(proc->flags & MP_PROCESSOR_ENABLED) || proc->lapic_id == cpus[BOOT_CPU_ID].arch.apic_id) {
+			continue;
+		}
+		cpu = cpu_register();
+		if (cpu == NULL) {
+			printf("SMP: too many processors, ignoring APIC %u\n", proc->lapic_id);
+			continue;
+		}
+		cpu->arch.apic_id = proc->lapic_id;
+	}
+	printf("[OK]\tSMP: %u processor(s) found\n", nb_cpus);
+}
+
+NEW_INIT_HOOK(mp, &mp_init, CHAOS_INIT_LEVEL_ARCH);
@@ -0,0 +1,163 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#include <kernel/init.h>
+#include <kernel/cpu.h>
+#include <kernel/thread.h>
+#include <kernel/timer.h>
+#include <kernel/interrupts.h>
+#include <kernel/vaspace.h>
+#include <kernel/linker.h>
+#include <arch/common_op.h>
+#include <arch/x86/apic.h>
+#include <arch/x86/vmm.h>
+#include <arch/x86/asm.h>
+#include <string.h>
+#include <stdio.h>
+
+/*
+** Application processors startup.
+**
+** The trampoline (see trampoline.asm) is copied in low memory, where the
+** processors start in real mode. It enables paging with a copy of the
+** kernel page directory where the low memory is identity-mapped, and
+** jumps to ap_main() on the kernel stack of the idle thread of the
+** processor.
+**
+** The processors are started one at a time, and wait for the boot to be
+** over before they start scheduling threads.
+*/
+
+/* Defined in trampoline.asm */
+extern char ap_trampoline_start[];
+extern char ap_trampoline_end[];
+extern uint32 ap_boot_cr3;
+extern uint32 ap_boot_stack;
+
+/* Defined in idt.asm */
+extern void idt_load(void);
+
+/* Kernel page directory, with the first 4MiB identity-mapped */
+static struct page_dir ap_page_directory __aligned(PAGE_SIZE) __initdata;
+
+/* Processor being started, and it's acknowledgement */
+static struct cpu *volatile ap_booting_cpu __initdata;
+static volatile bool ap_started __initdata;
+
+/*
+** Returns the address of the given symbol of the trampoline, once it's
+** copied in low memory.
+*/
+static inline void *
+trampoline_slot(void *sym)
+{
+	return (low_mem(AP_TRAMPOLINE_ADDR + ((char *)sym - ap_trampoline_start)));
+}
+
+/*
+** Waits for the end of the boot, and starts running threads.
+** Not part of the init code, as it runs once the init memory is freed.
+*/
+__noreturn static void
+ap_start_scheduling(struct cpu *cpu)
+{
+	smp_wait_boot_done();
+
+	lapic_timer_start();
+	cpu->online = true;
+	arch_enable_interrupts();
+	cpu->idle_thread->entry();
+	panic("The idle thread of cpu%u returned", cpu->id);
+}
+
+/*
+** First C function executed by the application processors, on the
+** kernel stack of their idle thread.
+*/
+__noreturn void __init
+ap_main(void)
+{
+	struct cpu *cpu;
+	struct thread *idle;
+
+	cpu = ap_booting_cpu;
+	idle = cpu->idle_thread;
+
+	x86_cpu_setup(cpu);
+	idt_load();
+	lapic_setup();
+	arch_sync_kernel_pd(idle->vaspace);
+	set_cr3(idle->vaspace->arch.pagedir);
+
+	set_kernel_stack(idle->arch.kernel_stack_top);
+	idle->state = RUNNING;
+	set_current_thread(idle);
+
+	ap_started = true;
+	ap_start_scheduling(cpu);
+}
+
+/*
+** Starts the given processor and waits for it to reach ap_main().
+** Returns false if it didn't answer.
+*/
+static bool __init
+smp_start_ap(struct cpu *cpu)
+{
+	struct thread *idle;
+	uint i;
+
+	idle = cpu->idle_thread;
+	*(uint32 *)trampoline_slot(&ap_boot_stack) = idle->arch.kernel_stack_top;
+	ap_booting_cpu = cpu;
+	ap_started = false;
+
+	lapic_start_ap(cpu->arch.apic_id, AP_TRAMPOLINE_ADDR);
+
+	/* Give it 100ms to start */
+	for (i = 0; i < 100 && !ap_started; ++i) {
+		platform_udelay(1000);
+	}
+	return (ap_started);
+}
+
+/*
+** Copies the trampoline and starts all the application processors.
+*/
+static void __init
+smp_init(enum init_level il __unused)
+{
+	struct cpu *cpu;
+	uint nb_started;
+
+	if (nb_cpus == 1) {
+		return ;
+	}
+
+	memcpy(ap_page_directory.entries, boot_page_directory.entries, sizeof(ap_page_directory));
+	ap_page_directory.entries[0].value = 0x83; /* Present, writable, 4MiB */
+	ap_page_directory.entries[1023].value = get_paddr(&ap_page_directory) | 0x3;
+
+	memcpy(trampoline_slot(ap_trampoline_start), ap_trampoline_start,
+		ap_trampoline_end - ap_trampoline_start);
+	*(uint32 *)trampoline_slot(&ap_boot_cr3) = get_paddr(&ap_page_directory);
+
+	nb_started = 1;
+	for (cpu = cpus + 1; cpu < cpus + nb_cpus; ++cpu)
+	{
+		if (smp_start_ap(cpu)) {
+			++nb_started;
+		} else {
+			printf("SMP: cpu%u (APIC %u) didn't start\n", cpu->id, cpu->arch.apic_id);
+		}
+	}
+	printf("[OK]\tSMP: %u processor(s) started\n", nb_started);
+}
+
+NEW_INIT_HOOK(smp, &smp_init, CHAOS_INIT_LEVEL_KTHREADS + 1);
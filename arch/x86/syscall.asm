@@ -54,3 +54,7 @@ SYSCALL			0x0C,			getdents
 SYSCALL			0x0D,			open
 SYSCALL			0x0E,			close
 SYSCALL			0x0F,			readdir
+SYSCALL			0x10,			sleep
+SYSCALL			0x11,			nanosleep
+SYSCALL			0x12,			spawn
+SYSCALL			0x13,			futex
@@ -9,26 +9,31 @@
 
 #include <kernel/thread.h>
 #include <kernel/kalloc.h>
+#include <kernel/kstack.h>
+#include <kernel/cpu.h>
 #include <arch/x86/tss.h>
+#include <arch/x86/vmm.h>
+#include <arch/x86/fpu.h>
+#include <arch/x86/asm.h>
 #include <string.h>
 
-static struct thread *current_thread = NULL;
-extern struct spinlock thread_table_lock;
-
 /*
 ** Very first entry point of each thread. Calls the main entry point of the thread.
 */
 static void
 thread_main(void)
 {
-	/* Release the lock acquired by the thread_yield() that brought us here. */
-	release_lock(&thread_table_lock);
+	/* The flags aren't switched, see x86_context_switch() */
+	set_eflags(FL_DEFAULT | FL_IOPL_3);
+
+	/* Release the run queue lock held by the switch that brought us here. */
+	sched_first_run();
 	arch_enable_interrupts();
 
 	/* User mode, never returns. still a WIP */
-	//x86_jump_userspace(current_thread->entry, current_thread->stack);
+	//x86_jump_userspace(get_current_thread()->entry, get_current_thread()->stack);
 
-	thread_exit(current_thread->entry());
+	thread_exit(get_current_thread()->entry());
 }
 
 /*
@@ -37,11 +42,30 @@ thread_main(void)
 static void
 thread_return_fork(void)
 {
-	/* Release the lock acquired by the thread_yield() that brought us here. */
-	release_lock(&thread_table_lock);
+	set_eflags(FL_DEFAULT | FL_IOPL_3);
+
+	/* Release the run queue lock held by the switch that brought us here. */
+	sched_first_run();
+	arch_enable_interrupts();
+
+	x86_return_userspace(get_current_thread()->arch.iframe);
+}
+
+/*
+** Very first entry point of a thread created by thread_spawn(). Loads it's
+** program and jumps to it.
+*/
+static void
+thread_return_spawn(void)
+{
+	set_eflags(FL_DEFAULT | FL_IOPL_3);
+
+	/* Release the run queue lock held by the switch that brought us here. */
+	sched_first_run();
 	arch_enable_interrupts();
 
-	x86_return_userspace(current_thread->arch.iframe);
+	thread_spawn_exec();
+	x86_return_userspace(get_current_thread()->arch.iframe);
 }
 
 /*
@@ -56,12 +80,15 @@ arch_thread_execve(int argc, char *argv[])
 	char **argv2;
 	size_t len;
 
+	/* The new program starts with a clean FPU state */
+	x86_fpu_release(get_current_thread());
+
 	argv2 = kalloc(sizeof(char *) * argc);
 	assert_neq(argv2, NULL);
 
 	/* Paste argv on thread's stack */
 	i = 0;
-	stack = current_thread->stack;
+	stack = get_current_thread()->stack;
 	while (i < argc)
 	{
 		len = strlen(argv[i]);
@@ -74,7 +101,10 @@ arch_thread_execve(int argc, char *argv[])
 	memcpy(stack, argv2, (argc + 1) * sizeof(char *));
 	kfree(argv2);
 	argv2 = stack;
-	stack = (void *)ROUND_DOWN((uintptr)stack, sizeof(void *));
+
+	/* argc is at an aligned address once both arguments are pushed */
+	stack = (void *)ROUND_DOWN((uintptr)stack, USER_STACK_ALIGN);
+	stack -= USER_STACK_ALIGN - sizeof(int) - sizeof(char **);
 
 	stack -= sizeof(char **); /* Push argv*/
 	*(char ***)stack = argv2;
@@ -89,7 +119,7 @@ arch_thread_execve(int argc, char *argv[])
 	iframe->ebx = 0;
 	iframe->esi = 0;
 	iframe->edi = 0;
-	iframe->eip = (uintptr)current_thread->entry;
+	iframe->eip = (uintptr)get_current_thread()->entry;
 	iframe->esp = (uintptr)stack;
 	iframe->ebp = iframe->esp;
 }
@@ -104,19 +134,19 @@ arch_init_thread(struct thread *t)
 	struct context_switch_frame *frame;
 
 	/* Allocate thread's kernel stack */
-	t->arch.kernel_stack = kalloc(DEFAULT_KERNEL_STACK_SIZE);
+	t->arch.kernel_stack = kstack_alloc(DEFAULT_KERNEL_STACK_SIZE);
 	t->arch.kernel_stack_size = DEFAULT_KERNEL_STACK_SIZE;
 	assert_neq(t->arch.kernel_stack, 0);
 
 	stack_top = t->arch.kernel_stack + t->arch.kernel_stack_size;
 	stack_top = (virt_addr_t)ROUND_DOWN((uintptr)stack_top, 8); // Stack must be 8 byte aligned
+	t->arch.kernel_stack_top = (uintptr)stack_top;
 
 	frame = (struct context_switch_frame *)stack_top;
 	frame--;
 
 	memset(frame, 0, sizeof(*frame));
 	frame->eip = (uintptr)&thread_main;
-	frame->eflags = FL_DEFAULT | FL_IOPL_3;
 	t->arch.sp = frame;
 }
 
@@ -129,17 +159,20 @@ arch_init_fork_thread(struct thread *t)
 	struct context_switch_frame *frame;
 
 	/* Allocate thread's kernel stack */
-	t->arch.kernel_stack = kalloc(current_thread->arch.kernel_stack_size);
-	t->arch.kernel_stack_size = current_thread->arch.kernel_stack_size;
+	t->arch.kernel_stack = kstack_alloc(get_current_thread()->arch.kernel_stack_size);
+	t->arch.kernel_stack_size = get_current_thread()->arch.kernel_stack_size;
 	assert_neq(t->arch.kernel_stack, 0);
+	t->arch.kernel_stack_top = (uintptr)t->arch.kernel_stack
+		+ (get_current_thread()->arch.kernel_stack_top - (uintptr)get_current_thread()->arch.kernel_stack);
 
 	/* Copy kernel stack */
-	memcpy(t->arch.kernel_stack, current_thread->arch.kernel_stack, t->arch.kernel_stack_size);
+	memcpy(t->arch.kernel_stack, get_current_thread()->arch.kernel_stack, t->arch.kernel_stack_size);
 
 	/* Set the value of arch.iframe */
-	t->arch.iframe = t->arch.kernel_stack + ((uintptr)current_thread->arch.iframe - (uintptr)current_thread->arch.kernel_stack);
+	t->arch.iframe = t->arch.kernel_stack + ((uintptr)get_current_thread()->arch.iframe - (uintptr)get_current_thread()->arch.kernel_stack);
 
-	assert_eq(t->arch.iframe->eip, current_thread->arch.iframe->eip);
+	assert_eq(t->arch.iframe->eip, get_current_thread()->arch.iframe->eip);
+	assert_eq(x86_fpu_fork(t), OK);
 	t->arch.iframe->eax = 0; /* Set the return value of fork() for the new process */
 
 	frame = (struct context_switch_frame *)t->arch.iframe;
@@ -147,7 +180,30 @@ arch_init_fork_thread(struct thread *t)
 
 	memset(frame, 0, sizeof(*frame));
 	frame->eip = (uintptr)&thread_return_fork;
-	frame->eflags = FL_DEFAULT | FL_IOPL_3;
+	t->arch.sp = frame;
+}
+
+/*
+** Initializes the new thread, set up by arch_init_thread(), after a spawn.
+**
+** Only the interrupt frame of the spawn system call is copied, at the top
+** of the kernel stack: it's registers are replaced when the program is
+** loaded, and it is used to jump to it.
+*/
+void
+arch_init_spawn_thread(struct thread *t)
+{
+	struct context_switch_frame *frame;
+
+	t->arch.iframe = (struct iframe *)t->arch.kernel_stack_top - 1;
+	memcpy(t->arch.iframe, get_current_thread()->arch.iframe, sizeof(*t->arch.iframe));
+	t->arch.iframe->eax = 0;
+
+	frame = (struct context_switch_frame *)t->arch.iframe;
+	frame--;
+
+	memset(frame, 0, sizeof(*frame));
+	frame->eip = (uintptr)&thread_return_spawn;
 	t->arch.sp = frame;
 }
 
@@ -158,14 +214,18 @@ arch_init_fork_thread(struct thread *t)
 void
 arch_context_switch(struct thread *old, struct thread *new)
 {
-	uintptr kernel_stack;
+	struct tss *tss;
 
 	if (old->vaspace != new->vaspace) {
+		/* Done first, as the current kernel stack may be in a new page table */
+		arch_sync_kernel_pd(new->vaspace);
 		set_cr3(new->vaspace->arch.pagedir);
 	}
-	kernel_stack = (uintptr)new->arch.kernel_stack + new->arch.kernel_stack_size;
-	kernel_stack = ROUND_DOWN(kernel_stack, sizeof(void *));
-	set_kernel_stack(kernel_stack);
+	tss = &current_cpu()->arch.tss;
+	if (tss->esp0 != new->arch.kernel_stack_top) {
+		tss->esp0 = new->arch.kernel_stack_top;
+	}
+	x86_fpu_switch(old, new);
 	x86_context_switch(&old->arch.sp, new->arch.sp);
 }
 
@@ -175,7 +235,7 @@ arch_context_switch(struct thread *old, struct thread *new)
 void
 set_current_thread(struct thread *thread)
 {
-	current_thread = thread;
+	current_cpu()->current_thread = thread;
 }
 
 /*
@@ -184,5 +244,11 @@ set_current_thread(struct thread *thread)
 struct thread *
 get_current_thread(void)
 {
-	return (current_thread);
+	struct thread *t;
+
+	/* A single instruction, so it can't be interrupted by a migration */
+	asm volatile("movl %%gs:%c1, %0"
+		: "=r"(t)
+		: "i"(offsetof(struct cpu, current_thread)));
+	return (t);
 }
@@ -0,0 +1,89 @@
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;
+;;  This file is part of the Chaos Kernel, and is made available under
+;;  the terms of the GNU General Public License version 2.
+;;
+;;  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+global ap_trampoline_start
+global ap_trampoline_end
+global ap_boot_cr3
+global ap_boot_stack
+
+extern ap_main
+
+%include "include/arch/x86/asm.mac"
+
+; Must match with AP_TRAMPOLINE_ADDR in include/arch/x86/apic.h
+%define TRAMPOLINE_ADDR		(0x8000)
+
+; Address of the given symbol once the trampoline is copied
+%define REL(x)			((x) - ap_trampoline_start + TRAMPOLINE_ADDR)
+
+; The application processors start here, in real mode, once this code is
+; copied at TRAMPOLINE_ADDR (see smp.c).
+; They switch to protected mode, enable paging using ap_boot_cr3 and
+; jump into the kernel with the stack at ap_boot_stack.
+section .init.text
+bits 16
+ap_trampoline_start:
+	cli
+	cld
+	xor ax, ax
+	mov ds, ax
+
+	lgdt [REL(ap_gdtptr)]
+
+	mov eax, cr0
+	or eax, 0x1			; Enable protected mode
+	mov cr0, eax
+
+	jmp dword KERNEL_CODE_SELECTOR:REL(.protected)
+
+bits 32
+.protected:
+	mov ax, KERNEL_DATA_SELECTOR
+	mov ds, ax
+	mov es, ax
+	mov fs, ax
+	mov gs, ax
+	mov ss, ax
+
+	mov eax, cr4
+	or eax, 0x00000010		; Enable 4MiB pages, the low memory uses one
+	mov cr4, eax
+
+	mov eax, [REL(ap_boot_cr3)]
+	mov cr3, eax
+
+	mov eax, cr0
+	or eax, 0x80000000		; Enable paging
+	mov cr0, eax
+
+	mov esp, [REL(ap_boot_stack)]
+	mov eax, ap_main		; Jump into virtual space
+	call eax
+
+	hlt				; And catch fire
+	jmp $
+
+; A flat GDT, with the same selectors than the kernel one
+align 8
+ap_gdt:
+	dq 0
+	dq 0x00CF9A000000FFFF		; Kernel code selector
+	dq 0x00CF92000000FFFF		; Kernel data selector
+
+ap_gdtptr:
+	dw ap_gdtptr - ap_gdt - 1
+	dd REL(ap_gdt)
+
+; Filled by smp.c before each processor is started
+ap_boot_cr3:
+	dd 0
+ap_boot_stack:
+	dd 0
+
+ap_trampoline_end:
@@ -7,38 +7,42 @@
 **
 \* ------------------------------------------------------------------------ */
 
+#include <kernel/cpu.h>
 #include <arch/x86/tss.h>
 #include <arch/x86/x86.h>
 #include <string.h>
 
-struct tss tss;
-
-extern struct gdt_tss_entry gdt_tss_entry;
-
+/*
+** Initializes the given Task State Segment and it's GDT entry.
+*/
 void
-tss_setup(void)
+tss_setup(struct tss *tss, struct gdt_tss_entry *entry)
 {
 	uintptr limit;
 	uintptr base;
 
-	base = (uintptr)&tss;
-	limit = (uintptr)sizeof(tss);
-
-	gdt_tss_entry.limit_low = limit & 0xFFFF;
-	gdt_tss_entry.base_low = base & 0xFFFFFF;
-	gdt_tss_entry.limit_high = (limit & 0x0F0000) >> 16u;
-	gdt_tss_entry.base_high = (base & 0xFF000000) >> 24u;
-
-	memset(&tss, 0, sizeof(tss));
-	tss.esp0 = 0;
-	tss.ss0 = KERNEL_DATA_SELECTOR;
-	tss.ss1 = 0;
-	tss.ss2 = 0;
-	tss.eflags = FL_DEFAULT | FL_IOPL_3;
+	base = (uintptr)tss;
+	limit = (uintptr)sizeof(*tss);
+
+	entry->limit_low = limit & 0xFFFF;
+	entry->base_low = base & 0xFFFFFF;
+	entry->limit_high = (limit & 0x0F0000) >> 16u;
+	entry->base_high = (base & 0xFF000000) >> 24u;
+	entry->busy = false;
+
+	memset(tss, 0, sizeof(*tss));
+	tss->esp0 = 0;
+	tss->ss0 = KERNEL_DATA_SELECTOR;
+	tss->ss1 = 0;
+	tss->ss2 = 0;
+	tss->eflags = FL_DEFAULT | FL_IOPL_3;
 }
 
+/*
+** Sets the stack used when the current processor enters kernel mode.
+*/
 void
 set_kernel_stack(uintptr stack)
 {
-	tss.esp0 = stack;
+	current_cpu()->arch.tss.esp0 = stack;
 }
@@ -13,18 +13,28 @@ global x86_jump_userspace:function
 global x86_return_userspace:function
 global x86_context_switch:function
 
-; void arch_context_switch(void **from_esp, void *esp)
+;
+; void x86_context_switch(void **from_esp, void *esp)
+;
+; Only the callee-saved registers are kept, the caller saved the others.
+; The flags aren't either: interrupts are always disabled here, and the
+; other flags are the same for all threads.
+;
 x86_context_switch:
 	mov eax, [esp + 4]
 	mov edx, [esp + 8]
-	pushf
-	pusha
+	push ebp
+	push ebx
+	push esi
+	push edi
 
 	mov [eax], esp
 	mov esp, edx
 
-	popa
-	popf
+	pop edi
+	pop esi
+	pop ebx
+	pop ebp
 	ret
 ;
 ; Jumps in userspace and calls the given function.
@@ -10,7 +10,10 @@
 #include <kernel/vaspace.h>
 #include <kernel/thread.h>
 #include <kernel/kalloc.h>
+#include <kernel/kstack.h>
+#include <kernel/swap.h>
 #include <arch/x86/vmm.h>
+#include <arch/x86/fpu.h>
 #include <string.h>
 
 /*
@@ -22,6 +25,43 @@ arch_init_vaspace(void)
 	get_current_thread()->vaspace->arch.pagedir = get_cr3();
 }
 
+/*
+** Sets up the page directory of the given virtual address space, with
+** only the kernel mapped.
+*/
+status_t
+arch_init_kernel_vaspace(struct vaspace *vas)
+{
+	struct page_dir *pd;
+	void *kalloc_pd;
+	size_t i;
+
+	kalloc_pd = kalloc(2 * sizeof(*pd)); /* Dirty way to have page-aligned allocations */
+	if (kalloc_pd == NULL) {
+		return (ERR_NO_MEMORY);
+	}
+	pd = (struct page_dir *)ALIGN((uintptr)kalloc_pd, PAGE_SIZE);
+	memset(pd, 0, sizeof(*pd));
+
+	i = GET_PD_IDX(KERNEL_VIRTUAL_BASE);
+	while (i < 1023)
+	{
+		pd->entries[i].value = boot_page_directory.entries[i].value;
+		++i;
+	}
+
+	/* Set up recursiv mapping */
+	pd->entries[1023].present = true;
+	pd->entries[1023].rw = true;
+	pd->entries[1023].frame = get_paddr(pd) >> 12u;
+
+	vas->arch.pagedir = get_paddr(pd);
+	vas->arch.pd = pd;
+	vas->arch.pd_alloc = kalloc_pd;
+	vas->arch.pd_generation = kernel_pd_generation;
+	return (OK);
+}
+
 /*
 ** Clone the page table 'src' of index 'pidx' within 'dest'.
 */
@@ -51,6 +91,10 @@ clone_page_table(struct page_table *dest, struct page_table *src, size_t pidx)
 			assert_neq(pa, NULL_FRAME);
 			set_paddr(page, pa);
 		}
+		else if (src->entries[i].swapped) {
+			/* Both address spaces now share the swapped page */
+			swap_dup_slot(src->entries[i].frame);
+		}
 		++i;
 	}
 	kfree(kalloc_page);
@@ -83,24 +127,26 @@ arch_clone_vaspace(struct vaspace *src)
 
 	/* Copy most of the virtual address space structure */
 	memcpy(vas, src, sizeof(*vas));
+	mutex_init(&vas->lock);
+	seqlock_init(&vas->layout);
 
 	/* Set usable page directory and page table. */
 	pd = (struct page_dir *)ALIGN((uintptr)kalloc_pd, PAGE_SIZE);
 	pt = (struct page_table *)ALIGN((uintptr)kalloc_pt, PAGE_SIZE);
 
+	/* The page directory stays mapped in kernel space, to be synced later */
 	vas->arch.pagedir = get_paddr(pd);
+	vas->arch.pd = pd;
+	vas->arch.pd_alloc = kalloc_pd;
 	vas->ref_count = 1;
 
 	pa = get_paddr(pt);
 
 	i = 0;
-	while (i < 1023)
+	while (i < GET_PD_IDX(KERNEL_VIRTUAL_BASE))
 	{
 		pd->entries[i].value = GET_PAGE_DIRECTORY->entries[i].value;
-
-		/* Kernel page tables are linked together so we only care about user page tables */
-		if (i < GET_PD_IDX(KERNEL_VIRTUAL_BASE)
-			&& GET_PAGE_DIRECTORY->entries[i].present)
+		if (GET_PAGE_DIRECTORY->entries[i].present)
 		{
 			/* Set the new page table frame */
 			pd->entries[i].frame = pa >> 12u;
@@ -114,17 +160,20 @@ arch_clone_vaspace(struct vaspace *src)
 		++i;
 	}
 
+	/* Kernel page tables are shared, and taken from the master page directory */
+	while (i < 1023)
+	{
+		pd->entries[i].value = boot_page_directory.entries[i].value;
+		++i;
+	}
+	vas->arch.pd_generation = kernel_pd_generation;
+
 	/* Set up recursiv mapping */
 	pd->entries[1023].value = 0;
 	pd->entries[1023].present = true;
 	pd->entries[1023].rw = true;
 	pd->entries[1023].frame = get_paddr(pd) >> 12u;
 
-	/* Set a new frame address for the page directory */
-	pa = alloc_frame();
-	assert_neq(pa, NULL_FRAME);
-	set_paddr(pd, pa);
-	kfree(kalloc_pd);
 	kfree(kalloc_pt);
 	return (vas);
 }
@@ -161,9 +210,23 @@ arch_free_vaspace(void)
 void
 arch_free_zombie_thread(struct thread *t)
 {
-	kfree(t->arch.kernel_stack);
+	kstack_free(t->arch.kernel_stack, t->arch.kernel_stack_size);
 	t->arch.kernel_stack = NULL;
+	x86_fpu_release(t);
+
+	if (t->vaspace->ref_count == 0) {
+		arch_destroy_vaspace(t->vaspace);
+	}
+}
 
-	free_frame(t->vaspace->arch.pagedir);
+/*
+** Frees the page directory of the given virtual address space, which
+** isn't used any more.
+*/
+void
+arch_destroy_vaspace(struct vaspace *vas)
+{
+	kfree(vas->arch.pd_alloc);
+	vas->arch.pd_alloc = NULL;
 }
 
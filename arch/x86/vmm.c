@@ -10,11 +10,149 @@
 #include <kernel/unit_tests.h>
 #include <kernel/kalloc.h>
 #include <kernel/multiboot.h>
+#include <kernel/swap.h>
+#include <kernel/thread.h>
 #include <arch/x86/vmm.h>
+#include <arch/common_op.h>
 #include <arch/x86/asm.h>
 #include <stdio.h>
 #include <string.h>
 
+/*
+** Kernel page tables are allocated lazily, and shared by all address spaces.
+**
+** The boot page directory is the master copy of the kernel half: each time
+** a kernel page table is allocated, it's added to the master and
+** kernel_pd_generation is incremented. Other page directories are synced
+** with the master when they are switched to, or when a kernel page fault
+** hits a page table they don't know about yet.
+**
+** New kernel page tables are published in the master, and the generation
+** bumped, under the kernel page table lock. A page table is zeroed before
+** it's published, so no processor can see it's old content: as it isn't
+** mapped yet, it's zeroed through the window page, which is only used with
+** that lock held.
+*/
+uint kernel_pd_generation;
+
+static struct spinlock kernel_pt_lock;
+static uchar kernel_pt_window[PAGE_SIZE] __aligned(PAGE_SIZE);
+
+/*
+** Copies the kernel half of the master page directory within the page
+** directory of the given address space, if it is outdated.
+*/
+void
+arch_sync_kernel_pd(struct vaspace *vaspace)
+{
+	size_t i;
+
+	if (vaspace->arch.pd_generation == kernel_pd_generation) {
+		return ;
+	}
+	if (vaspace->arch.pd != &boot_page_directory)
+	{
+		i = GET_PD_IDX(KERNEL_VIRTUAL_BASE);
+		while (i < 1023)
+		{
+			vaspace->arch.pd->entries[i].value = boot_page_directory.entries[i].value;
+			++i;
+		}
+	}
+	vaspace->arch.pd_generation = kernel_pd_generation;
+}
+
+/*
+** Copies the master entry of the page table containing the given kernel
+** address within the current page directory.
+** Returns false if the master doesn't have it either.
+*/
+bool
+arch_sync_kernel_pde(virt_addr_t va)
+{
+	struct pagedir_entry *pde;
+	struct pagedir_entry *master;
+
+	if (va < KERNEL_VIRTUAL_BASE || GET_PD_IDX(va) == 1023) {
+		return (false);
+	}
+	pde = GET_PAGE_DIRECTORY->entries + GET_PD_IDX(va);
+	master = boot_page_directory.entries + GET_PD_IDX(va);
+	if (pde->present || !master->present) {
+		return (false);
+	}
+	pde->value = master->value;
+	invlpg(GET_PAGE_TABLE(GET_PD_IDX(va)));
+	return (true);
+}
+
+/*
+** Fills the given frame with zeros, through the window page.
+** The kernel page table lock must be held.
+*/
+static void
+zero_frame(phys_addr_t pa)
+{
+	phys_addr_t old;
+
+	assert(holding_lock(&kernel_pt_lock));
+	old = set_paddr(kernel_pt_window, pa);
+	memset(kernel_pt_window, 0, PAGE_SIZE);
+	set_paddr(kernel_pt_window, old);
+}
+
+/*
+** Allocates the kernel page table containing the given address, or gets it
+** from the master page directory.
+*/
+static status_t
+alloc_kernel_page_table(virt_addr_t va)
+{
+	struct pagedir_entry *master;
+	struct pagedir_entry entry;
+	phys_addr_t pa;
+	bool published;
+
+	if (arch_sync_kernel_pde(va)) {
+		return (OK);
+	}
+
+	/* Allocating may sleep, so it's done before taking the lock */
+	pa = alloc_frame();
+	if (pa == NULL_FRAME) {
+		return (ERR_NO_MEMORY);
+	}
+
+	LOCK(&kernel_pt_lock, state);
+	master = boot_page_directory.entries + GET_PD_IDX(va);
+
+	/* An other processor may have allocated it in the meantime */
+	published = !master->present;
+	if (published)
+	{
+		zero_frame(pa);
+		entry.value = pa;
+		entry.present = true;
+		entry.rw = true;
+		barrier();
+		master->value = entry.value;
+
+		/* The current page directory is already up to date */
+		if (get_current_thread()->vaspace->arch.pd_generation == kernel_pd_generation) {
+			get_current_thread()->vaspace->arch.pd_generation++;
+		}
+		kernel_pd_generation++;
+	}
+	RELEASE(&kernel_pt_lock, state);
+
+	if (!published) {
+		free_frame(pa);
+	}
+	GET_PAGE_DIRECTORY->entries[GET_PD_IDX(va)].value = master->value;
+	invlpg(GET_PAGE_TABLE(GET_PD_IDX(va)));
+	return (OK);
+}
+
 status_t
 arch_map_virt_to_phys(virt_addr_t va, phys_addr_t pa, mmap_flags_t flags)
 {
@@ -28,7 +166,14 @@ arch_map_virt_to_phys(virt_addr_t va, phys_addr_t pa, mmap_flags_t flags)
 	assert(IS_PAGE_ALIGNED(pa));
 	pde = GET_PAGE_DIRECTORY->entries + GET_PD_IDX(va);
 	pt = GET_PAGE_TABLE(GET_PD_IDX(va));
-	if (pde->present == false)
+	if (pde->present == false && va >= KERNEL_VIRTUAL_BASE)
+	{
+		/* Kernel page tables are never freed */
+		if (alloc_kernel_page_table(va) != OK) {
+			return (ERR_NO_MEMORY);
+		}
+	}
+	else if (pde->present == false)
 	{
 		pde->value = alloc_frame();
 		if (pde->value == NULL_FRAME) {
@@ -43,8 +188,8 @@ arch_map_virt_to_phys(virt_addr_t va, phys_addr_t pa, mmap_flags_t flags)
 		allocated_pde = true;
 	}
 	pte = pt->entries + GET_PT_IDX(va);
-	/* Return NULL if the page is already mapped */
-	if (pte->present)
+	/* Return NULL if the page is already mapped (or swapped out) */
+	if (pte->present || pte->swapped)
 	{
 		if (allocated_pde) {
 			munmap(pt, PAGE_SIZE);
@@ -96,6 +241,11 @@ arch_munmap_va(virt_addr_t va)
 		pte->value = 0;
 		invlpg(va);
 	}
+	else if (pde->present && pte->swapped)
+	{
+		swap_free_slot(pte->frame);
+		pte->value = 0;
+	}
 }
 
 /*
@@ -140,10 +290,270 @@ set_paddr(virt_addr_t va, phys_addr_t pa)
 	return (NULL_FRAME);
 }
 
+/* Next free address of the memory-mapped devices area */
+static virt_addr_t next_mmio = MMIO_VIRTUAL_BASE;
+static struct spinlock mmio_lock;
+
 /*
-** Marks the initrd as allocated & accessible.
+** Maps the registers of a memory-mapped device in the kernel space, with
+** caching disabled.
+** Returns NULL if the area is full.
+*/
+virt_addr_t
+arch_map_mmio(phys_addr_t pa, size_t size)
+{
+	struct pagetable_entry *pte;
+	virt_addr_t va;
+	virt_addr_t start;
+	size_t offset;
+
+	offset = pa & (PAGE_SIZE - 1);
+	pa -= offset;
+	size = ALIGN(size + offset, PAGE_SIZE);
+
+	LOCK(&mmio_lock, state);
+	if (size > (size_t)(MMIO_VIRTUAL_END - next_mmio)) {
+		RELEASE(&mmio_lock, state);
+		return (NULL);
+	}
+	start = next_mmio;
+	next_mmio += size;
+	RELEASE(&mmio_lock, state);
+
+	for (va = start; va < start + size; va += PAGE_SIZE, pa += PAGE_SIZE)
+	{
+		assert_eq(arch_map_virt_to_phys(va, pa, MMAP_WRITE), OK);
+		pte = GET_PAGE_TABLE(GET_PD_IDX(va))->entries + GET_PT_IDX(va);
+		pte->cache = true;
+		pte->wtrough = true;
+		invlpg(va);
+	}
+	return (start + offset);
+}
+
+/*
+** Clock hand of the page replacement algorithm, as the index of a page
+** within the user space.
+*/
+static size_t swap_clock_hand;
+
+/*
+** Runs the clock algorithm over the user space of the current virtual
+** address space.
+**
+** Each present user page that was accessed since the last sweep gets it's
+** accessed bit cleared and is skipped. The first one that wasn't is the victim.
+** At most two complete sweeps are done, so the search can only fail if
+** there is no user page at all.
+*/
+status_t
+arch_swap_select_victim(virt_addr_t *va)
+{
+	struct pagedir_entry *pde;
+	struct pagetable_entry *pte;
+	size_t nb_pages;
+	size_t scanned;
+	size_t i;
+	size_t j;
+
+	nb_pages = GET_PD_IDX(KERNEL_VIRTUAL_BASE) * 1024u;
+	scanned = 0;
+	while (scanned < 2 * nb_pages)
+	{
+		i = swap_clock_hand / 1024u;
+		j = swap_clock_hand % 1024u;
+		pde = GET_PAGE_DIRECTORY->entries + i;
+
+		/* Skip the whole page table if it isn't present */
+		if (!pde->present) {
+			scanned += 1024u - j;
+			swap_clock_hand = ((i + 1) * 1024u) % nb_pages;
+			continue;
+		}
+
+		pte = GET_PAGE_TABLE(i)->entries + j;
+		swap_clock_hand = (swap_clock_hand + 1) % nb_pages;
+		++scanned;
+		if (pte->present && pte->user && !pte->pinned)
+		{
+			if (!pte->accessed) {
+				*va = GET_VADDR(i, j);
+				return (OK);
+			}
+			pte->accessed = false;
+			invlpg(GET_VADDR(i, j));
+		}
+	}
+	return (ERR_NOT_FOUND);
+}
+
+/*
+** Returns true if the given virtual address is a present user page that
+** isn't pinned.
+*/
+bool
+arch_swap_is_swappable(virt_addr_t va)
+{
+	struct pagedir_entry *pde;
+	struct pagetable_entry *pte;
+
+	if (va >= KERNEL_VIRTUAL_BASE) {
+		return (false);
+	}
+	pde = GET_PAGE_DIRECTORY->entries + GET_PD_IDX(va);
+	pte = GET_PAGE_TABLE(GET_PD_IDX(va))->entries + GET_PT_IDX(va);
+	return (pde->present && pte->present && pte->user && !pte->pinned);
+}
+
+/*
+** Prevents the given present user page from being swapped out, for as long
+** as it stays mapped.
+** Returns it's frame, or NULL_FRAME if it isn't a present user page.
+*/
+phys_addr_t
+arch_swap_pin(virt_addr_t va)
+{
+	struct pagedir_entry *pde;
+	struct pagetable_entry *pte;
+
+	if (va >= KERNEL_VIRTUAL_BASE) {
+		return (NULL_FRAME);
+	}
+	pde = GET_PAGE_DIRECTORY->entries + GET_PD_IDX(va);
+	pte = GET_PAGE_TABLE(GET_PD_IDX(va))->entries + GET_PT_IDX(va);
+	if (!pde->present || !pte->present || !pte->user) {
+		return (NULL_FRAME);
+	}
+	pte->pinned = true;
+	return (pte->frame << 12u);
+}
+
+/*
+** Lets the given page be swapped out again, if it's still a present user page.
+*/
+void
+arch_swap_unpin(virt_addr_t va)
+{
+	struct pagedir_entry *pde;
+	struct pagetable_entry *pte;
+
+	if (va >= KERNEL_VIRTUAL_BASE) {
+		return ;
+	}
+	pde = GET_PAGE_DIRECTORY->entries + GET_PD_IDX(va);
+	pte = GET_PAGE_TABLE(GET_PD_IDX(va))->entries + GET_PT_IDX(va);
+	if (pde->present && pte->present && pte->user) {
+		pte->pinned = false;
+	}
+}
+
+/*
+** Clears the dirty bit of the given swappable page, so writes done while it
+** is written to the swap device are noticed. Returns it's frame.
+*/
+phys_addr_t
+arch_swap_clean(virt_addr_t va)
+{
+	struct pagetable_entry *pte;
+
+	assert(arch_swap_is_swappable(va));
+	pte = GET_PAGE_TABLE(GET_PD_IDX(va))->entries + GET_PT_IDX(va);
+	pte->dirty = false;
+	invlpg(va);
+	return (pte->frame << 12u);
+}
+
+/*
+** Returns true if the given page is still swappable, mapped to the given
+** frame, and wasn't written since arch_swap_clean().
+*/
+bool
+arch_swap_unchanged(virt_addr_t va, phys_addr_t pa)
+{
+	struct pagetable_entry *pte;
+
+	if (!arch_swap_is_swappable(va)) {
+		return (false);
+	}
+	pte = GET_PAGE_TABLE(GET_PD_IDX(va))->entries + GET_PT_IDX(va);
+	return ((phys_addr_t)(pte->frame << 12u) == pa && !pte->dirty);
+}
+
+/*
+** Replaces the mapping of the given page by a reference to the given slot.
+** The rw and user flags are kept so they can be restored later.
+** Returns the frame that was mapped, which is NOT freed.
+*/
+phys_addr_t
+arch_swap_set_slot(virt_addr_t va, swap_slot_t slot)
+{
+	struct pagetable_entry *pte;
+	phys_addr_t old;
+
+	assert(arch_swap_is_swappable(va));
+	pte = GET_PAGE_TABLE(GET_PD_IDX(va))->entries + GET_PT_IDX(va);
+	old = pte->frame << 12u;
+	pte->present = false;
+	pte->accessed = false;
+	pte->dirty = false;
+	pte->swapped = true;
+	pte->frame = slot;
+	invlpg(va);
+	return (old);
+}
+
+/*
+** Returns the slot the given page has been swapped to, or NULL_SLOT if it
+** isn't swapped out.
+*/
+swap_slot_t
+arch_swap_get_slot(virt_addr_t va)
+{
+	struct pagedir_entry *pde;
+	struct pagetable_entry *pte;
+
+	pde = GET_PAGE_DIRECTORY->entries + GET_PD_IDX(va);
+	pte = GET_PAGE_TABLE(GET_PD_IDX(va))->entries + GET_PT_IDX(va);
+	if (pde->present && !pte->present && pte->swapped) {
+		return (pte->frame);
+	}
+	return (NULL_SLOT);
+}
+
+/*
+** Maps back a swapped page to the given frame.
 */
 void
+arch_swap_restore(virt_addr_t va, phys_addr_t pa)
+{
+	struct pagetable_entry *pte;
+
+	assert_neq(arch_swap_get_slot(va), NULL_SLOT);
+	pte = GET_PAGE_TABLE(GET_PD_IDX(va))->entries + GET_PT_IDX(va);
+	pte->swapped = false;
+	pte->frame = pa >> 12u;
+	pte->present = true;
+	invlpg(va);
+}
+
+/*
+** Gives the given frame to the given kernel page, and returns the one it
+** had.
+*/
+phys_addr_t
+arch_swap_exchange_frame(virt_addr_t va, phys_addr_t pa)
+{
+	phys_addr_t old;
+
+	old = set_paddr(va, pa);
+	assert_neq(old, NULL_FRAME);
+	return (old);
+}
+
+/*
+** Marks the initrd as allocated & accessible.
+*/
+void __init
 arch_vmm_mark_initrd(void)
 {
 	void *initrd;
@@ -170,13 +580,14 @@ arch_vmm_mark_initrd(void)
 	}
 }
 
-void
+void __init
 arch_vmm_init(void)
 {
 	size_t i;
 	size_t j;
 	phys_addr_t pa;
-	status_t s;
+
+	init_lock(&kernel_pt_lock);
 
 	/* Remove the top part of identity mapping */
 	i = GET_PD_IDX(KERNEL_VIRTUAL_END);
@@ -190,14 +601,12 @@ arch_vmm_init(void)
 		++j;
 	}
 
-	/* Allocates all kernel page tables, so that each future processes share kernel memory. */
-	i = GET_PD_IDX(KERNEL_VIRTUAL_BASE);
-	while (i < 1023)
-	{
-		s = arch_map_page(GET_PAGE_TABLE(i), MMAP_WRITE);
-		assert(s == OK || s == ERR_ALREADY_MAPPED);
-		++i;
-	}
+	/*
+	** The boot page directory is the master copy of the kernel page tables,
+	** which are allocated on demand.
+	*/
+	get_current_thread()->vaspace->arch.pd = &boot_page_directory;
+	get_current_thread()->vaspace->arch.pd_generation = kernel_pd_generation;
 }
 
 /*
@@ -271,7 +680,7 @@ arch_is_allocated(virt_addr_t va)
 	return (pde->present && pte->present);
 }
 
-static void
+static void __init
 vmm_test(void)
 {
 	virt_addr_t brk;
@@ -0,0 +1,68 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#ifndef _ARCH_X86_APIC_H_
+# define _ARCH_X86_APIC_H_
+
+# include <kernel/pmm.h>
+# include <chaosdef.h>
+# include <chaoserr.h>
+
+/* Default physical address of the local APIC registers */
+# define LAPIC_DEFAULT_BASE		(0xFEE00000)
+
+/* Local APIC registers, as offsets from it's base address */
+# define LAPIC_ID			(0x020)
+# define LAPIC_TPR			(0x080)
+# define LAPIC_EOI			(0x0B0)
+# define LAPIC_SVR			(0x0F0)
+# define LAPIC_ICR_LOW			(0x300)
+# define LAPIC_ICR_HIGH			(0x310)
+# define LAPIC_LVT_TIMER		(0x320)
+# define LAPIC_TIMER_INIT		(0x380)
+# define LAPIC_TIMER_CURRENT		(0x390)
+# define LAPIC_TIMER_DIVIDE		(0x3E0)
+
+# define LAPIC_SVR_ENABLE		(1u << 8u)
+
+# define LAPIC_ICR_INIT			(0x500)
+# define LAPIC_ICR_STARTUP		(0x600)
+# define LAPIC_ICR_ASSERT		(1u << 14u)
+# define LAPIC_ICR_PENDING		(1u << 12u)
+
+# define LAPIC_TIMER_PERIODIC		(1u << 17u)
+# define LAPIC_TIMER_MASKED		(1u << 16u)
+# define LAPIC_TIMER_DIVIDE_BY_16	(0x3)
+
+/*
+** Interrupts raised by the local APIC, as IRQ numbers (see idt.asm).
+** They come right after the ones of the PIC.
+*/
+# define LAPIC_IRQ_TIMER		(0x10)
+# define LAPIC_IRQ_RESCHEDULE		(0x11)
+# define LAPIC_IRQ_SPURIOUS		(0x12)
+
+/* Corresponding interrupt vectors */
+# define LAPIC_VECTOR_TIMER		(0x30)
+# define LAPIC_VECTOR_RESCHEDULE	(0x31)
+# define LAPIC_VECTOR_SPURIOUS		(0x3F)
+
+/* Physical address of the page the application processors start in */
+# define AP_TRAMPOLINE_ADDR		(0x8000)
+
+status_t		lapic_init(phys_addr_t base);
+void			lapic_setup(void);
+uint			lapic_id(void);
+void			lapic_eoi(void);
+void			lapic_send_ipi(uint apic_id, uint vector);
+void			lapic_start_ap(uint apic_id, phys_addr_t entry);
+void			lapic_timer_start(void);
+bool			lapic_present(void);
+
+#endif /* !_ARCH_X86_APIC_H_ */
@@ -30,4 +30,82 @@ atomic_add(volatile int *addr, int val)
 	return (val);
 }
 
+/*
+** Stores 'newval' at the given address if it holds 'oldval'.
+** Returns the value that was at the given address.
+*/
+static inline int
+atomic_cmpxchg(volatile int *addr, int oldval, int newval)
+{
+	asm volatile("lock cmpxchgl %[newval], %[addr];"
+			: "=a" (oldval), [addr]"+m" (*addr)
+			: "a" (oldval), [newval]"r" (newval)
+			: "memory");
+	return (oldval);
+}
+
+/*
+** Prevents the compiler from moving memory accesses across it.
+** The processor keeps stores in order, so it's enough to release a lock.
+*/
+static inline void
+barrier(void)
+{
+	asm volatile("" ::: "memory");
+}
+
+/*
+** Prevents both the compiler and the processor from moving memory
+** accesses across it. Needed when a store must be visible before a
+** following load.
+** A locked instruction is a full barrier, and unlike mfence it doesn't
+** require SSE2.
+*/
+static inline void
+memory_fence(void)
+{
+	asm volatile("lock addl $0, (%%esp)" ::: "memory", "cc");
+}
+
+/*
+** Hints the processor that we are in a spin-wait loop.
+*/
+static inline void
+pause(void)
+{
+	asm volatile("pause" ::: "memory");
+}
+
+/*
+** Returns the number of cycles since the processor was reset.
+*/
+static inline uint64
+read_cycle_counter(void)
+{
+	uint32 lo;
+	uint32 hi;
+
+	asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+	return (((uint64)hi << 32u) | lo);
+}
+
+/*
+** Divides a 64 bits number by a 32 bits one.
+** Done in two steps, so the quotient of each divl fits in 32 bits.
+*/
+static inline uint64
+udiv64_32(uint64 n, uint32 d)
+{
+	uint32 q_hi;
+	uint32 q_lo;
+	uint32 r;
+
+	q_hi = (uint32)(n >> 32u) / d;
+	r = (uint32)(n >> 32u) % d;
+	asm("divl %[d]"
+		: "=a" (q_lo), "=d" (r)
+		: "a" ((uint32)n), "d" (r), [d]"rm" (d));
+	return (((uint64)q_hi << 32u) | q_lo);
+}
+
 #endif /* !_ARCH_X86_ARCH_COMMON_OP_H_ */
@@ -0,0 +1,41 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#ifndef _ARCH_X86_ARCH_CPU_H_
+# define _ARCH_X86_ARCH_CPU_H_
+
+# include <arch/x86/tss.h>
+# include <arch/x86/x86.h>
+
+/* Size of a line of the data caches, in bytes */
+# define CACHE_LINE_SIZE	(64u)
+
+/*
+** Each processor has it's own GDT, so it can have it's own TSS and
+** it's own per-CPU data segment (loaded in %gs).
+*/
+struct		arch_cpu
+{
+	uint apic_id;
+	struct tss tss;
+	uint64 gdt[GDT_NB_ENTRIES] __aligned(8);
+
+	/* Thread whose FPU state is in the registers, if any */
+	struct thread *fpu_owner;
+
+	/* Whether CR0.TS is set, so the next FPU instruction traps */
+	bool fpu_trap;
+};
+
+struct cpu;
+struct thread;
+
+void		x86_cpu_setup(struct cpu *cpu);
+
+#endif /* !_ARCH_X86_ARCH_CPU_H_ */
@@ -12,6 +12,12 @@
 
 # include <arch/x86/interrupts.h>
 
+/*
+** Alignment of the user stack expected by the System V ABI when a function
+** is called, so the compiler can spill SSE registers on it.
+*/
+# define USER_STACK_ALIGN	(16u)
+
 struct		arch_thread
 {
 	/* Stack pointer of the thread, belongs to kernel stack */
@@ -23,21 +29,26 @@ struct		arch_thread
 	/* Size of the kernel stack */
 	size_t kernel_stack_size;
 
+	/* Top of the kernel stack, loaded in the TSS when switching to it */
+	uintptr kernel_stack_top;
+
 	/* Interrupt frame, set when a syscall is trigger */
 	struct iframe *iframe;
+
+	/* Saved FPU/SSE state, allocated the first time the thread uses it */
+	struct fpu_state *fpu;
 };
 
+/*
+** Registers saved by x86_context_switch(). Only the callee-saved ones are
+** needed, as it's called like any C function.
+*/
 struct		context_switch_frame
 {
 	uintptr edi;
 	uintptr esi;
-	uintptr ebp;
-	uintptr esp;
 	uintptr ebx;
-	uintptr edx;
-	uintptr ecx;
-	uintptr eax;
-	uintptr eflags;
+	uintptr ebp;
 	uintptr eip;
 };
 
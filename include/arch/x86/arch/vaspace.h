@@ -12,9 +12,18 @@
 
 # include <kernel/pmm.h>
 
+struct page_dir;
+
 struct arch_vaspace
 {
 	phys_addr_t pagedir;
+
+	/* Page directory, mapped in kernel space */
+	struct page_dir *pd;
+	void *pd_alloc;
+
+	/* Value of kernel_pd_generation when the kernel PDEs were last synced */
+	uint pd_generation;
 };
 
 #endif /* !_ARCH_X86_ARCH_VASPACE_H_ */
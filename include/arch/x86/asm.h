@@ -24,6 +24,16 @@ sti(void)
   asm volatile("sti");
 }
 
+/*
+** Enables interrupts and halts until the next one.
+** The interrupt can't be missed, as sti only takes effect after hlt.
+*/
+static inline void
+sti_hlt(void)
+{
+  asm volatile("sti; hlt");
+}
+
 static inline void
 outb(ushort port, uchar data)
 {
@@ -54,6 +64,27 @@ set_eflags(uintptr eflags)
 	asm volatile("pushl %0; popfl" :: "g" (eflags) : "memory", "cc");
 }
 
+static inline uintptr
+get_cr0(void)
+{
+	uintptr cr0;
+
+	asm volatile("mov %%cr0, %0" : "=r"(cr0));
+	return (cr0);
+}
+
+static inline void
+set_cr0(uintptr cr0)
+{
+	asm volatile("mov %0, %%cr0" :: "r"(cr0));
+}
+
+static inline void
+clts(void)
+{
+	asm volatile("clts");
+}
+
 static inline uintptr
 get_cr2(void)
 {
@@ -78,6 +109,21 @@ set_cr3(uintptr cr3)
 	asm volatile("mov %0, %%cr3" :: "r"(cr3));
 }
 
+static inline uintptr
+get_cr4(void)
+{
+	uintptr cr4;
+
+	asm volatile("mov %%cr4, %0" : "=r"(cr4));
+	return (cr4);
+}
+
+static inline void
+set_cr4(uintptr cr4)
+{
+	asm volatile("mov %0, %%cr4" :: "r"(cr4));
+}
+
 static inline void
 interrupt(uchar i)
 {
@@ -0,0 +1,39 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#ifndef _ARCH_X86_FPU_H_
+# define _ARCH_X86_FPU_H_
+
+# include <chaosdef.h>
+# include <chaoserr.h>
+
+/* Default value of MXCSR: all SSE exceptions masked */
+# define MXCSR_DEFAULT		(0x1F80)
+
+/*
+** FPU, MMX and SSE registers, as saved by FXSAVE.
+*/
+struct fpu_state
+{
+	uint8 fxsave[512] __aligned(16);
+
+	/* Memory block the structure was allocated in */
+	void *alloc;
+};
+
+struct cpu;
+struct thread;
+
+void		x86_fpu_setup(struct cpu *cpu);
+void		x86_fpu_switch(struct thread *old, struct thread *new);
+status_t	x86_fpu_trap(void);
+status_t	x86_fpu_fork(struct thread *new);
+void		x86_fpu_release(struct thread *t);
+
+#endif /* !_ARCH_X86_FPU_H_ */
@@ -0,0 +1,90 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#ifndef _ARCH_X86_MP_H_
+# define _ARCH_X86_MP_H_
+
+# include <chaosdef.h>
+# include <debug.h>
+
+/*
+** Structures of the Intel MultiProcessor Specification, left in memory
+** by the BIOS to describe the processors of the machine.
+*/
+
+# define MP_FLOATING_SIGNATURE		"_MP_"
+# define MP_CONFIG_SIGNATURE		"PCMP"
+
+/*
+** The MP floating pointer structure, the entry point of the tables.
+*/
+struct mp_floating
+{
+	char signature[4];
+	uint32 config;		/* Physical address of the configuration table */
+	uint8 length;		/* In 16 bytes units */
+	uint8 spec_rev;
+	uint8 checksum;
+	uint8 default_config;	/* If not 0, there is no configuration table */
+	uint8 features[4];
+} __packed;
+
+/*
+** Header of the MP configuration table, followed by it's entries.
+*/
+struct mp_config
+{
+	char signature[4];
+	uint16 length;
+	uint8 spec_rev;
+	uint8 checksum;
+	char oem_id[8];
+	char product_id[12];
+	uint32 oem_table;
+	uint16 oem_table_size;
+	uint16 nb_entries;
+	uint32 lapic_addr;	/* Physical address of the local APICs */
+	uint16 ext_length;
+	uint8 ext_checksum;
+	uint8 reserved;
+} __packed;
+
+enum mp_entry_type
+{
+	MP_ENTRY_PROCESSOR	= 0,
+	MP_ENTRY_BUS		= 1,
+	MP_ENTRY_IOAPIC		= 2,
+	MP_ENTRY_IO_INTERRUPT	= 3,
+	MP_ENTRY_LOCAL_INTERRUPT	= 4,
+};
+
+/*
+** Processor entry. All the other entries are 8 bytes long.
+*/
+struct mp_processor
+{
+	uint8 type;
+	uint8 lapic_id;
+	uint8 lapic_version;
+	uint8 flags;
+	uint32 signature;
+	uint32 features;
+	uint32 reserved[2];
+} __packed;
+
+# define MP_PROCESSOR_ENABLED		(1u << 0u)
+# define MP_PROCESSOR_BSP		(1u << 1u)
+
+# define MP_ENTRY_SIZE			(8u)
+
+static_assert(sizeof(struct mp_floating) == 16);
+static_assert(sizeof(struct mp_config) == 44);
+static_assert(sizeof(struct mp_processor) == 20);
+
+#endif /* !_ARCH_X86_MP_H_ */
@@ -70,6 +70,7 @@ struct gdt_tss_entry
 
 static_assert(sizeof(struct gdt_tss_entry) == 2 * sizeof(uintptr));
 
+void			tss_setup(struct tss *tss, struct gdt_tss_entry *entry);
 void			set_kernel_stack(uintptr stack);
 
 #endif /* !_ARCH_X86_TSS_H_ */
@@ -20,6 +20,10 @@
 # define GET_PT_IDX(x)		(((uintptr)(x) >> 12u) & 0x3FF)
 # define GET_VADDR(i, j)	((void *)((i) << 22u | (j) << 12u))
 
+/* Virtual area where the memory-mapped devices are mapped, right below the page tables */
+# define MMIO_VIRTUAL_BASE	((virt_addr_t)0xFF800000ul)
+# define MMIO_VIRTUAL_END	((virt_addr_t)0xFFC00000ul)
+
 /*
 ** An entry in the page directory
 */
@@ -62,7 +66,9 @@ struct			pagetable_entry
 			uint32 dirty : 1;	/* Set by cpu when writting */
 			uint32 _zero : 1;	/* Must be zero */
 			uint32 global : 1;	/* Prevent tlb update */
-			uint32 __unusued : 3;	/* unused & reserved bits */
+			uint32 swapped : 1;	/* Not present, frame is a swap slot (available to software) */
+			uint32 pinned : 1;	/* Never swapped out (available to software) */
+			uint32 __unusued : 1;	/* unused & reserved bits */
 			uint32 frame : 20;	/* Frame address */
 		};
 		uintptr value;
@@ -90,7 +96,27 @@ static_assert(sizeof(struct pagetable_entry) == sizeof(uintptr));
 static_assert(sizeof(struct page_table) == PAGE_SIZE);
 static_assert(sizeof(struct page_dir) == PAGE_SIZE);
 
-phys_addr_t		get_paddr(virt_addr_t);
+struct vaspace;
+
 phys_addr_t		set_paddr(virt_addr_t va, phys_addr_t pa);
+void			arch_sync_kernel_pd(struct vaspace *vaspace);
+bool			arch_sync_kernel_pde(virt_addr_t va);
+virt_addr_t		arch_map_mmio(phys_addr_t pa, size_t size);
+
+/*
+** Returns the virtual address of the given low memory physical address.
+** The first MiB is always mapped in the kernel space.
+** The sum is done on integers: the compiler would otherwise see an offset
+** into the linker symbol behind KERNEL_VIRTUAL_BASE.
+*/
+static inline void *
+low_mem(phys_addr_t pa)
+{
+	return ((void *)((uintptr)KERNEL_VIRTUAL_BASE + pa));
+}
+
+/* Master copy of the kernel page directory entries, defined in boot.asm */
+extern struct page_dir	boot_page_directory;
+extern uint		kernel_pd_generation;
 
 #endif /* !_ARCH_X86_VMM_H_ */
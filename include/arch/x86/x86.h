@@ -19,6 +19,10 @@
 # define		USER_CODE_SELECTOR	(0x18)
 # define		USER_DATA_SELECTOR	(0x20)
 # define 		TSS_SELECTOR		(0x28)
+# define		PERCPU_SELECTOR		(0x30)
+
+/* Number of entries in the GDT */
+# define		GDT_NB_ENTRIES		(7)
 
 /*
 ** An enumeration of all rings level
@@ -57,4 +61,14 @@ enum			dpl
 # define FL_VIP		(0x00100000) // Virtual Interrupt Pending
 # define FL_ID		(0x00200000) // ID flag
 
+/*
+** Control registers bits.
+*/
+# define CR0_MP		(0x00000002) // Monitor co-processor
+# define CR0_EM		(0x00000004) // x87 emulation
+# define CR0_TS		(0x00000008) // Task switched
+# define CR0_NE		(0x00000020) // Native x87 errors
+# define CR4_OSFXSR	(0x00000200) // FXSAVE/FXRSTOR and SSE support
+# define CR4_OSXMMEXCPT	(0x00000400) // Unmasked SSE exceptions support
+
 #endif /* !_ARCH_X86_X86_H_ */
@@ -37,6 +37,10 @@
 # define unlikely(x)		__builtin_expect((x), 0)
 # define __optimize(x)		__attribute__((optimize(x)))
 
+/* Code and data only used during boot, freed once the kernel is initialized */
+# define __init			__section(".init.text")
+# define __initdata		__section(".init.data")
+
 # include <debug.h>
 
 /* Defines some shortcuts types. */
@@ -17,8 +17,11 @@
 ** let you customize ChaOS.
 */
 
-/* Maximum number of processes running at the same time */
-# define MAX_PID			(32)
+/* Maximum number of processes running at the same time (a multiple of 1024) */
+# define MAX_PID			(32768)
+
+/* Maximum number of processors */
+# define MAX_CPUS			(8)
 
 /* Default size of a thread's stack */
 # define DEFAULT_STACK_SIZE		(PAGE_SIZE * 16u)
@@ -26,15 +29,57 @@
 /* Default size of a thread's kernel stack */
 # define DEFAULT_KERNEL_STACK_SIZE	(PAGE_SIZE * 4u)
 
-/* [X86] Comment to disable SSE instructions (floating points) */
-/* TODO Not implemented yet */
+/* Number of kernel stacks kept aside by each processor, for new threads */
+# define KSTACK_CACHE_SIZE		(8u)
+
+/* Number of user stack regions kept aside by each address space */
+# define USER_STACK_CACHE_SIZE		(8u)
+
+/* Frequency of the timer interrupt, in Hz */
+# define HZ				(100)
+
+/* Number of priority levels of the scheduler */
+# define SCHED_NB_LEVELS		(4)
+
+/* Number of timer ticks between two boosts of all threads to their base level */
+# define SCHED_BOOST_PERIOD		(64)
+
+/* Highest niceness of a thread (lowest priority) */
+# define SCHED_NICE_MAX			(19)
+
+/* Number of timer ticks between two load balancings of a processor */
+# define SCHED_BALANCE_PERIOD		(16)
+
+/*
+** [X86] Comment to disable SSE instructions (floating points) in userspace.
+** The x87 FPU stays available either way.
+*/
 # define ENABLE_SSE
 
+/* Uncomment to count acquisitions, contention and hold time of each lock */
+/* # define ENABLE_LOCK_STATS */
+
 /*
 ** Ensure configuration is valid
 */
-# if MAX_PID < 1
-#  error "MAX_PID is less than one"
-# endif /* MAX_PID < 1 */
+# if MAX_PID < 1024 || MAX_PID > 32768 || MAX_PID % 1024
+#  error "MAX_PID must be a multiple of 1024, between 1024 and 32768"
+# endif /* MAX_PID < 1024 || MAX_PID > 32768 || MAX_PID % 1024 */
+
+# if MAX_CPUS < 1 || MAX_CPUS > 32
+#  error "MAX_CPUS must be between 1 and 32"
+# endif /* MAX_CPUS < 1 || MAX_CPUS > 32 */
+
+# if HZ < 1 || HZ > 1000
+#  error "HZ must be between 1 and 1000"
+# endif /* HZ < 1 || HZ > 1000 */
+
+# if SCHED_NB_LEVELS < 1 || SCHED_NB_LEVELS > SCHED_NICE_MAX + 1
+#  error "SCHED_NB_LEVELS must be between 1 and SCHED_NICE_MAX + 1"
+# endif /* SCHED_NB_LEVELS < 1 || SCHED_NB_LEVELS > SCHED_NICE_MAX + 1 */
+
+# if SCHED_BALANCE_PERIOD < 1
+#  error "SCHED_BALANCE_PERIOD is less than one"
+# endif /* SCHED_BALANCE_PERIOD < 1 */
 
 #endif /* !_CONFIG_ */
@@ -0,0 +1,50 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#ifndef _KERNEL_BENCHMARK_H_
+# define _KERNEL_BENCHMARK_H_
+
+# include <kernel/init.h>
+# include <chaosdef.h>
+
+typedef void(*benchmark_hook_funcptr)(void);
+
+struct benchmark_hook
+{
+	benchmark_hook_funcptr hook;
+	char const *name;
+};
+
+/*
+** A running measure, started with bench_start() and reported with
+** bench_stop().
+*/
+struct bench
+{
+	uint64 start_cycles;
+	uint64 start_ticks;
+};
+
+/*
+** Benchmarks are only run when the kernel is booted with '--bench', by
+** the init thread, before the init memory is freed. They can therefore
+** be marked __init.
+*/
+# define NEW_BENCHMARK(n, h)						\
+	__aligned(sizeof(void*)) __used __section("chaos_benchmarks")	\
+	static const struct benchmark_hook _bench_hook_struct_##n = {	\
+		.hook = h,						\
+		.name = #n,						\
+	}
+
+void			bench_start(struct bench *b);
+void			bench_stop(struct bench *b, char const *what, uint32 nb_ops);
+void			run_benchmarks(void);
+
+#endif /* !_KERNEL_BENCHMARK_H_ */
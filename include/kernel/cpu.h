@@ -0,0 +1,76 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#ifndef _KERNEL_CPU_H_
+# define _KERNEL_CPU_H_
+
+# include <arch/cpu.h>
+# include <chaosdef.h>
+# include <config.h>
+
+struct thread;
+
+/*
+** A set of processors, one bit per processor id.
+*/
+typedef uint32		cpumask_t;
+
+# define CPUMASK_CPU(id)	((cpumask_t)1u << (id))
+# define CPUMASK_ALL		((cpumask_t)-1)
+
+/*
+** Per-CPU data.
+**
+** Each processor reaches it's own structure through current_cpu().
+** The first two fields are accessed directly by the architecture, so
+** they must stay where they are.
+*/
+struct cpu
+{
+	struct cpu *self;
+	struct thread *current_thread;
+
+	/* Index within the cpus array. The boot processor is 0. */
+	uint id;
+
+	/* Set once the processor is running the scheduler */
+	bool online;
+
+	/* Thread running when nothing else is runnable on this processor */
+	struct thread *idle_thread;
+
+	/* Quiescent states, see kernel/rcu.c */
+	volatile int rcu_qs;
+	volatile uint rcu_idle;
+
+	/* Time spent in interrupt handlers, in cycles */
+	uint64 irq_cycles;
+	uint32 irq_max_cycles;
+	uint32 nb_irqs;
+
+	struct arch_cpu arch;
+};
+
+extern struct cpu	cpus[MAX_CPUS];
+extern uint		nb_cpus;
+
+# define BOOT_CPU_ID	(0u)
+
+struct cpu		*cpu_register(void);
+void			cpu_dump(void);
+void			smp_boot_done(void);
+void			smp_wait_boot_done(void);
+
+/*
+** Must be implemented in each architecture.
+*/
+struct cpu		*current_cpu(void);
+void			arch_cpu_kick(struct cpu *cpu);
+
+#endif /* !_KERNEL_CPU_H_ */
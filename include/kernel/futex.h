@@ -0,0 +1,31 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#ifndef _KERNEL_FUTEX_H_
+# define _KERNEL_FUTEX_H_
+
+# include <chaosdef.h>
+# include <chaoserr.h>
+
+/* Number of buckets of the futex hash table (a power of two) */
+# define FUTEX_HASH_SIZE	(256u)
+
+/*
+** Operations of the futex system call.
+*/
+enum futex_op
+{
+	FUTEX_WAIT	= 0x00,
+	FUTEX_WAKE	= 0x01,
+};
+
+status_t		futex_wait(uint32 *uaddr, uint32 val);
+int			futex_wake(uint32 *uaddr, uint nb);
+
+#endif /* !_KERNEL_FUTEX_H_ */
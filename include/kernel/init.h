@@ -31,6 +31,9 @@ enum	init_level
 	CHAOS_INIT_LEVEL_ARCH		= 0x80000,
 	CHAOS_INIT_LEVEL_PLATFORM	= 0x90000,
 
+	/* Kernel threads, created once the init thread is */
+	CHAOS_INIT_LEVEL_KTHREADS	= 0xA0000,
+
 	CHAOS_INIT_LEVEL_LATEST		= INT_MAX
 };
 
@@ -44,6 +47,7 @@ struct	init_hook
 };
 
 void	kernel_init_level(enum init_level, enum init_level);
+void	free_init_memory(void);
 
 # define NEW_INIT_HOOK(n, h, l)						\
 	__aligned(sizeof(void*)) __used __section("chaos_init")		\
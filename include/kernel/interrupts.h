@@ -13,7 +13,7 @@
 # include <chaosdef.h>
 # include <chaoserr.h>
 
-# define MAX_IRQ			16
+# define MAX_IRQ			32
 
 typedef uintptr		int_state_t;
 
@@ -39,6 +39,7 @@ status_t		arch_mask_interrupt(uint v);
 status_t		arch_unmask_interrupt(uint v);
 void			arch_enable_interrupts(void);
 void			arch_disable_interrupts(void);
+void			arch_wait_for_interrupt(void);
 void			arch_push_interrupts(int_state_t *);
 void			arch_pop_interrupts(int_state_t *);
 bool			arch_are_int_enabled(void);
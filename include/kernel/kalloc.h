@@ -32,6 +32,8 @@ virt_addr_t	kalloc(size_t);
 virt_addr_t	krealloc(virt_addr_t, size_t);
 virt_addr_t	kcalloc(size_t, size_t);
 void		kfree(virt_addr_t);
+bool		kalloc_busy(void);
+void		kalloc_dump_lock_stats(void);
 
 static_assert(sizeof(struct block) % sizeof(void *) == 0);
 
@@ -0,0 +1,18 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#ifndef _KERNEL_KSTACK_H_
+# define _KERNEL_KSTACK_H_
+
+# include <chaosdef.h>
+
+void			*kstack_alloc(size_t size);
+void			kstack_free(void *stack, size_t size);
+
+#endif /* !_KERNEL_KSTACK_H_ */
@@ -21,11 +21,15 @@ extern void *__KERNEL_VIRTUAL_LINK __weak;
 extern void *__KERNEL_VIRTUAL_BASE __weak;
 extern void *__KERNEL_VIRTUAL_END __weak;
 extern void *__KERNEL_PHYSICAL_END __weak;
+extern void *__KERNEL_INIT_START __weak;
+extern void *__KERNEL_INIT_END __weak;
 
 /* All guaranteed to be page-aligned */
 # define KERNEL_VIRTUAL_LINK	((void *)&__KERNEL_VIRTUAL_LINK)
 # define KERNEL_VIRTUAL_BASE	((void *)&__KERNEL_VIRTUAL_BASE)
 # define KERNEL_VIRTUAL_END	((void *)&__KERNEL_VIRTUAL_END)
 # define KERNEL_PHYSICAL_END	((uintptr)&__KERNEL_PHYSICAL_END)
+# define KERNEL_INIT_START	((void *)&__KERNEL_INIT_START)
+# define KERNEL_INIT_END	((void *)&__KERNEL_INIT_END)
 
 #endif /* !_KERNEL_LINKER_H_ */
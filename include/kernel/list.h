@@ -86,6 +86,36 @@ list_delete(struct list_node *node)
 	node->prev = NULL;
 }
 
+/*
+** Inserts a new node after the specified head, in a list read without
+** lock under RCU (see kernel/rcu.h).
+**
+** The node is fully initialized before being made reachable.
+** Writers must still be serialized.
+*/
+static inline void
+list_add_rcu(struct list_node *new, struct list_node *head)
+{
+	new->prev = head;
+	new->next = head->next;
+	asm volatile("" ::: "memory");
+	head->next->prev = new;
+	head->next = new;
+}
+
+/*
+** Deletes a node from a list read under RCU.
+**
+** It's next pointer is left untouched, as readers may still be on it. The
+** node can only be freed or reused once a grace period elapsed.
+*/
+static inline void
+list_delete_rcu(struct list_node *node)
+{
+	list_remove(node->prev, node->next);
+	node->prev = NULL;
+}
+
 /*
 ** Deletes from one list and add as another's head.
 */
@@ -174,6 +204,18 @@ list_zip(struct list_node *list, struct list_node *head)
 		&pos->member != (head);					\
 		pos = get_content(pos->member.next, typeof(*pos), member))
 
+/*
+** Iterates over the content of a list read under RCU.
+**
+** Each pointer is read exactly once, as writers may change it meanwhile.
+*/
+# define list_foreach_content_rcu(pos, head, member)				\
+	for (pos = get_content(*(struct list_node *volatile *)&(head)->next,	\
+			typeof(*pos), member);					\
+		&pos->member != (head);						\
+		pos = get_content(*(struct list_node *volatile *)&pos->member.next, \
+			typeof(*pos), member))
+
 /*
 ** Iterates over a list content.
 **
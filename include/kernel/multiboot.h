@@ -16,6 +16,8 @@
 struct cmd_options
 {
 	bool unit_test;
+	bool bench;
+	bool zram;
 };
 
 struct initrd_infos
@@ -0,0 +1,56 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#ifndef _KERNEL_MUTEX_H_
+# define _KERNEL_MUTEX_H_
+
+# include <kernel/waitqueue.h>
+# include <kernel/spinlock.h>
+# include <chaosdef.h>
+# include <config.h>
+
+struct thread;
+
+/*
+** A recursive sleeping lock, for long critical sections.
+**
+** Threads waiting for it sleep in a wait queue instead of spinning with
+** interrupts disabled. It must therefore never be taken from an interrupt
+** handler or with a spinlock held, spinlocks being kept for short
+** sections.
+** The thread holding it can take it again, as long as it releases it as
+** many times.
+*/
+struct mutex
+{
+	struct spinlock lock;
+	struct thread *owner;
+	uint depth;
+	uint nb_waiters;	/* Sleepers that weren't woken up yet */
+	struct wait_queue waiters;
+# ifdef ENABLE_LOCK_STATS
+	uint64 hold_start;
+	struct spinlock_stats stats;
+# endif /* ENABLE_LOCK_STATS */
+};
+
+# define MUTEX_INIT_VALUE(m)	{ .waiters = WAIT_QUEUE_INIT_VALUE((m).waiters) }
+
+void			mutex_init(struct mutex *);
+void			mutex_lock(struct mutex *);
+void			mutex_unlock(struct mutex *);
+bool			holding_mutex(struct mutex *);
+
+# ifdef ENABLE_LOCK_STATS
+void			mutex_dump_stats(char const *name, struct mutex *);
+# else
+#  define mutex_dump_stats(name, m)
+# endif /* ENABLE_LOCK_STATS */
+
+#endif /* !_KERNEL_MUTEX_H_ */
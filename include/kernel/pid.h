@@ -0,0 +1,46 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#ifndef _KERNEL_PID_H_
+# define _KERNEL_PID_H_
+
+# include <kernel/list.h>
+# include <kernel/spinlock.h>
+# include <chaosdef.h>
+# include <config.h>
+
+typedef int			pid_t;
+
+struct thread;
+
+/* Number of buckets of the pid hash table */
+# define PID_HASH_SIZE		(256u)
+
+void			pid_init(void);
+pid_t			pid_alloc(void);
+void			pid_free(pid_t pid);
+void			pid_hash_add(struct thread *t);
+void			pid_hash_remove(struct thread *t);
+struct thread		*thread_lookup(pid_t pid);
+
+/*
+** Iterates over all threads, through the pid hash table.
+** The pid lock must be held.
+*/
+# define pid_foreach_thread(t, bucket)					\
+	for ((bucket) = 0; (bucket) < PID_HASH_SIZE; ++(bucket))	\
+		list_foreach_content(t, pid_hash + (bucket), pid_node)
+
+extern struct list_node	pid_hash[PID_HASH_SIZE];
+extern struct spinlock	pid_lock;
+
+# define LOCK_PID(state)	LOCK(&pid_lock, state)
+# define RELEASE_PID(state)	RELEASE(&pid_lock, state)
+
+#endif /* !_KERNEL_PID_H_ */
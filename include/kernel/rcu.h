@@ -0,0 +1,45 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#ifndef _KERNEL_RCU_H_
+# define _KERNEL_RCU_H_
+
+# include <kernel/interrupts.h>
+# include <chaosdef.h>
+
+/*
+** Read-copy-update, for data that is read far more often than written.
+**
+** Readers don't take any lock: they only disable interrupts, so they can't
+** be preempted nor go to sleep. A processor that context-switches, takes
+** an interrupt or idles is therefore out of any read-side section, which
+** is called a quiescent state.
+**
+** Interrupt handlers must not be readers, as an idle processor is in a
+** quiescent state until it's interrupt handler returned.
+**
+** Writers are serialized with a lock of their own. They unlink an entry
+** so new readers can't find it, call synchronize_rcu() to wait until all
+** processors went through a quiescent state, and then free it.
+*/
+
+# define		RCU_READ_LOCK(state)		\
+	int_state_t state;				\
+	arch_push_interrupts(&state);			\
+	arch_disable_interrupts();
+
+# define		RCU_READ_UNLOCK(state)		\
+	arch_pop_interrupts(&state);
+
+void			rcu_note_qs(void);
+void			rcu_idle_enter(void);
+void			rcu_idle_exit(void);
+void			synchronize_rcu(void);
+
+#endif /* !_KERNEL_RCU_H_ */
@@ -0,0 +1,61 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#ifndef _KERNEL_RWLOCK_H_
+# define _KERNEL_RWLOCK_H_
+
+# include <kernel/spinlock.h>
+# include <chaosdef.h>
+
+/*
+** A reader-writer spinlock, for read-mostly data.
+**
+** Any number of readers can hold it at the same time, while a writer
+** holds it alone. Writers take the inner ticket lock, so they are served
+** in order, and new readers back off as soon as a writer is waiting so
+** they can't starve it.
+**
+** Unlike spinlocks, it is not recursive: a reader taking it again while a
+** writer waits would deadlock.
+*/
+struct rwlock
+{
+	volatile int readers;	/* Number of readers holding the lock */
+	volatile uint writer;	/* Set while a writer holds or waits for it */
+	struct spinlock lock;	/* Serializes writers */
+};
+
+void			rwlock_init(struct rwlock *);
+void			read_lock(struct rwlock *);
+void			read_unlock(struct rwlock *);
+void			write_lock(struct rwlock *);
+void			write_unlock(struct rwlock *);
+bool			holding_write_lock(struct rwlock *);
+
+# define		LOCK_READ(rw, state)		\
+	int_state_t state;				\
+	arch_push_interrupts(&state);			\
+	arch_disable_interrupts();			\
+	read_lock(rw);
+
+# define		RELEASE_READ(rw, state)		\
+	read_unlock(rw);				\
+	arch_pop_interrupts(&state);
+
+# define		LOCK_WRITE(rw, state)		\
+	int_state_t state;				\
+	arch_push_interrupts(&state);			\
+	arch_disable_interrupts();			\
+	write_lock(rw);
+
+# define		RELEASE_WRITE(rw, state)	\
+	write_unlock(rw);				\
+	arch_pop_interrupts(&state);
+
+#endif /* !_KERNEL_RWLOCK_H_ */
@@ -0,0 +1,82 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#ifndef _KERNEL_SEQLOCK_H_
+# define _KERNEL_SEQLOCK_H_
+
+# include <kernel/spinlock.h>
+# include <arch/common_op.h>
+# include <chaosdef.h>
+
+/*
+** A sequence lock, for small data that is read often and written rarely.
+**
+** Writers are serialized by the inner spinlock, and increment the
+** sequence number before and after their update, so it is odd while an
+** update is in progress.
+** Readers don't write anything: they copy the data and retry if the
+** sequence number changed in the meantime. They must therefore never
+** follow a pointer they read under the seqlock.
+**
+**	do {
+**		seq = read_seqbegin(&sl);
+**		copy = data;
+**	} while (read_seqretry(&sl, seq));
+**
+** The processor doesn't reorder loads with other loads nor stores with
+** other stores, so compiler barriers are enough.
+*/
+struct seqlock
+{
+	volatile uint sequence;
+	struct spinlock lock;
+};
+
+void			seqlock_init(struct seqlock *);
+void			write_seqlock(struct seqlock *);
+void			write_sequnlock(struct seqlock *);
+
+/*
+** Returns the sequence number to give to read_seqretry(), waiting for the
+** current update, if any, to be over.
+*/
+static inline uint
+read_seqbegin(struct seqlock const *sl)
+{
+	uint seq;
+
+	while ((seq = sl->sequence) & 1u) {
+		pause();
+	}
+	barrier();
+	return (seq);
+}
+
+/*
+** Returns true if the data read since read_seqbegin() may be inconsistent,
+** and must be read again.
+*/
+static inline bool
+read_seqretry(struct seqlock const *sl, uint seq)
+{
+	barrier();
+	return (sl->sequence != seq);
+}
+
+# define		LOCK_SEQ(sl, state)		\
+	int_state_t state;				\
+	arch_push_interrupts(&state);			\
+	arch_disable_interrupts();			\
+	write_seqlock(sl);
+
+# define		RELEASE_SEQ(sl, state)		\
+	write_sequnlock(sl);				\
+	arch_pop_interrupts(&state);
+
+#endif /* !_KERNEL_SEQLOCK_H_ */
@@ -0,0 +1,65 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#ifndef _KERNEL_SHRINKER_H_
+# define _KERNEL_SHRINKER_H_
+
+# include <chaosdef.h>
+
+/*
+** Number of free frames under which the reclaim thread is woken up,
+** and the number it tries to reach before going back to sleep.
+*/
+# define RECLAIM_LOW_WATERMARK		(256u)
+# define RECLAIM_HIGH_WATERMARK		(512u)
+
+/* Number of frames the frame allocator tries to reclaim when it runs dry */
+# define RECLAIM_BATCH			(8u)
+
+/*
+** Cheap shrinkers (dropping caches) are asked first, the expensive ones
+** (writing pages to a device) only if it wasn't enough.
+*/
+enum shrinker_cost
+{
+	SHRINKER_COST_LOW		= 0,
+	SHRINKER_COST_HIGH,
+
+	SHRINKER_COST_MAX,
+};
+
+/*
+** A cache that can give memory back when the system runs out of it.
+**
+** 'count' returns how many frames could be freed, and 'scan' tries to free
+** the given amount and returns how many it actually freed.
+** Both may be called with the frame allocator in an unknown state, and
+** must not rely on being able to allocate memory.
+*/
+struct shrinker
+{
+	char const *name;
+	enum shrinker_cost cost;
+	size_t (*count)(void);
+	size_t (*scan)(size_t nb_frames);
+};
+
+size_t			shrink_caches(size_t nb_frames);
+void			reclaim_wakeup(void);
+
+# define NEW_SHRINKER(n, co, cnt, sc)					\
+	__aligned(sizeof(void*)) __used __section("chaos_shrinker")	\
+	static const struct shrinker _shrinker_struct_##n = {		\
+		.name = #n,						\
+		.cost = co,						\
+		.count = cnt,						\
+		.scan = sc,						\
+	}
+
+#endif /* !_KERNEL_SHRINKER_H_ */
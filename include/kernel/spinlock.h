@@ -11,18 +11,52 @@
 # define _KERNEL_SPINLOCK_H_
 
 # include <chaosdef.h>
+# include <config.h>
 
+/*
+** Statistics of a lock, if ENABLE_LOCK_STATS is defined.
+** Hold times are in cycles.
+*/
+struct spinlock_stats
+{
+	uint32 nb_acquires;
+	uint32 nb_contended;	/* Acquisitions that had to wait */
+	uint32 max_hold;
+};
+
+/*
+** A recursive ticket spinlock.
+**
+** Processors get the lock in the order they asked for it: each one takes
+** a ticket, and waits until it is served.
+** The processor holding the lock can take it again, as long as it
+** releases it as many times.
+*/
 struct spinlock
 {
-	uint locked;
+	volatile int next;	/* Next ticket to give */
+	volatile int serving;	/* Ticket holding the lock */
+	uint owner;		/* Id + 1 of the processor holding the lock, or 0 */
 	uint depth;
+# ifdef ENABLE_LOCK_STATS
+	uint64 hold_start;
+	struct spinlock_stats stats;
+# endif /* ENABLE_LOCK_STATS */
 };
 
 void			init_lock(struct spinlock *);
 bool			holding_lock(struct spinlock *);
 void			acquire_lock(struct spinlock *);
+bool			try_acquire_lock(struct spinlock *);
 void			release_lock(struct spinlock *);
 
+# ifdef ENABLE_LOCK_STATS
+void			lock_get_stats(struct spinlock *, struct spinlock_stats *);
+void			lock_dump_stats(char const *name, struct spinlock *);
+# else
+#  define lock_dump_stats(name, lock)
+# endif /* ENABLE_LOCK_STATS */
+
 # define		LOCK(lock, state)		\
 	int_state_t state;				\
 	arch_push_interrupts(&state);			\
@@ -0,0 +1,118 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#ifndef _KERNEL_SWAP_H_
+# define _KERNEL_SWAP_H_
+
+# include <kernel/vmm.h>
+# include <kernel/bdev.h>
+# include <kernel/spinlock.h>
+# include <chaoserr.h>
+
+/* The index of a page-sized slot within the swap device */
+typedef uint			swap_slot_t;
+
+/* The NULL equivalent for swap slots */
+# define NULL_SLOT		(-1u)
+
+/*
+** The swap device currently in use, if any.
+*/
+struct swap_device
+{
+	struct bdev *bdev;
+
+	/* Reference counter of each slot (0 means the slot is free) */
+	uchar *slot_map;
+	size_t nb_slots;
+	size_t nb_free_slots;
+
+	/* Index of the slot most likely to be free */
+	size_t next_slot;
+
+	/* Statistics */
+	size_t nb_swapped_out;
+	size_t nb_swapped_in;
+};
+
+status_t		swap_on(char const *bdev_name);
+status_t		swap_off(void);
+status_t		swap_out(void);
+status_t		swap_out_page(virt_addr_t va);
+status_t		swap_in(virt_addr_t va);
+phys_addr_t		swap_pin_page(virt_addr_t va);
+void			swap_unpin_page(virt_addr_t va);
+void			swap_dup_slot(swap_slot_t slot);
+void			swap_free_slot(swap_slot_t slot);
+
+/*
+** Must be re-implemented on each supported architecture.
+*/
+
+/*
+** Runs the clock algorithm over the current virtual address space and stores
+** in 'va' the first user page that wasn't accessed since the last sweep.
+*/
+status_t		arch_swap_select_victim(virt_addr_t *va);
+
+/*
+** Returns true if the given virtual address is a page that can be swapped out.
+*/
+bool			arch_swap_is_swappable(virt_addr_t va);
+
+/*
+** Prevents the given present user page from being swapped out.
+** Returns it's frame, or NULL_FRAME if it isn't a present user page.
+*/
+phys_addr_t		arch_swap_pin(virt_addr_t va);
+
+/*
+** Lets the given page be swapped out again, if it's still a present user page.
+*/
+void			arch_swap_unpin(virt_addr_t va);
+
+/*
+** Clears the dirty bit of the given swappable page, so writes done while it
+** is written to the swap device are noticed. Returns it's frame.
+*/
+phys_addr_t		arch_swap_clean(virt_addr_t va);
+
+/*
+** Returns true if the given page is still swappable, mapped to the given
+** frame, and wasn't written since arch_swap_clean().
+*/
+bool			arch_swap_unchanged(virt_addr_t va, phys_addr_t pa);
+
+/*
+** Replaces the mapping of the given page by a reference to the given slot.
+** Returns the frame that was mapped, which is NOT freed.
+*/
+phys_addr_t		arch_swap_set_slot(virt_addr_t va, swap_slot_t slot);
+
+/*
+** Returns the slot the given page has been swapped to, or NULL_SLOT if it
+** hasn't been swapped out.
+*/
+swap_slot_t		arch_swap_get_slot(virt_addr_t va);
+
+/*
+** Maps back a swapped page to the given frame, restoring it's old flags.
+*/
+void			arch_swap_restore(virt_addr_t va, phys_addr_t pa);
+
+/*
+** Gives the given frame to the given kernel page, and returns the one it
+** had.
+*/
+phys_addr_t		arch_swap_exchange_frame(virt_addr_t va, phys_addr_t pa);
+
+# define LOCK_SWAP(state)	LOCK(&swap_lock, state)
+# define RELEASE_SWAP(state)	RELEASE(&swap_lock, state)
+
+#endif /* !_KERNEL_SWAP_H_ */
@@ -13,6 +13,7 @@
 # include <chaosdef.h>
 # include <kernel/thread.h>
 # include <kernel/fs.h>
+# include <kernel/timer.h>
 
 enum syscalls_values
 {
@@ -32,6 +33,10 @@ enum syscalls_values
 	OPEN		= 0x0D,
 	CLOSE		= 0x0E,
 	READDIR		= 0x0F,
+	SLEEP		= 0x10,
+	NANOSLEEP	= 0x11,
+	SPAWN		= 0x12,
+	FUTEX		= 0x13,
 };
 
 static char const *const syscalls_str[] =
@@ -52,6 +57,10 @@ static char const *const syscalls_str[] =
 	[OPEN]		= "OPEN",
 	[CLOSE]		= "CLOSE",
 	[READDIR]	= "READDIR",
+	[SLEEP]		= "SLEEP",
+	[NANOSLEEP]	= "NANOSLEEP",
+	[SPAWN]		= "SPAWN",
+	[FUTEX]		= "FUTEX",
 };
 
 int			sys_open(char const *path);
@@ -61,5 +70,10 @@ int			sys_read(int fd, char *, size_t);
 pid_t			sys_fork(void);
 int			sys_readdir(int fd, struct dirent *dirent);
 int			sys_execve(char const *name, int (*main)(), char const *args[]);
+uint			sys_sleep(uint seconds);
+int			sys_nanosleep(struct timespec const *req);
+pid_t			sys_spawn(char const *name, int (*main)(), char const *args[]);
+int			sys_futex(uint32 *uaddr, int op, uint32 val);
+void			free_args(char **argv);
 
 #endif /* !_KERNEL_SYSCALL_H_ */
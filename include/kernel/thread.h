@@ -12,13 +12,15 @@
 
 # include <kernel/vmm.h>
 # include <kernel/vaspace.h>
+# include <kernel/list.h>
+# include <kernel/waitqueue.h>
+# include <kernel/cpu.h>
+# include <kernel/pid.h>
 # include <arch/thread.h>
 # include <chaosdef.h>
 # include <config.h>
+# include <stddef.h>
 
-# define IRQ_TIMER_VECTOR	(0x0)
-
-typedef int			pid_t;
 typedef int			(*thread_entry_cb)(void);
 
 enum			thread_state
@@ -48,14 +50,70 @@ struct filedesc
 	struct filehandler *handler;
 };
 
+/*
+** Scheduling statistics of a priority level.
+** Waiting times are the number of cycles a thread spent in the run queue
+** before being picked.
+*/
+struct sched_stats
+{
+	uint32 nb_picks;
+	uint32 avg_wait;
+	uint32 max_wait;
+};
+
+/*
+** Scheduling statistics of a processor.
+*/
+struct sched_cpu_stats
+{
+	uint32 nb_queued;	/* Threads in the run queues */
+	uint32 nb_migrations;	/* Threads pulled from an other processor */
+};
+
+/*
+** A thread.
+**
+** The fields read at each scheduling decision and context switch are
+** packed at the beginning of the structure, which is aligned on a cache
+** line, so picking a thread touches a single line. The other fields are
+** kept out of the way, in the cold part.
+**
+** Locking:
+**   - The thread lock protects the wait queues, going to sleep and exiting,
+**     and keeps zombies alive until they are waited. Wait queues have no
+**     lock of their own, so every sleep and wake-up (mutexes, futexes,
+**     timers, workqueues, waitpid) still goes through this global lock.
+**   - The lock of each run queue (see kernel/scheduler.c) protects the
+**     scheduling fields of the threads assigned to it.
+**   - The pid lock protects the pid allocator and the pid hash table.
+**   - The lock of each thread protects its file descriptors and working
+**     directory.
+** The thread lock may be held when taking a run queue lock, never the
+** other way around.
+*/
 struct			thread
 {
-	/* Thread basic infos*/
-	char name[255];
+	/* Hot part, must fit in a cache line */
+	enum thread_state state;
 	pid_t pid;
+	struct arch_thread arch;
+	struct vaspace *vaspace;
+	struct list_node rq_node;	/* Node in the run queue or a wait queue */
+	uint quantum;			/* Ticks left before demotion */
+	uint64 enqueue_time;		/* Cycle counter when made runnable */
+	cpumask_t affinity;		/* Processors the thread may run on */
+	uint16 cpu;			/* Processor it runs or last ran on */
+	uint8 sched_level;		/* Current priority level */
+	int8 nice;			/* Static priority, from 0 to SCHED_NICE_MAX */
+
+	/* Cold part: thread basic infos */
+	char name[255];
 	uchar exit_status;
-	enum thread_state state;
+	struct list_node pid_node;	/* Node in the pid hash table */
 	struct thread *parent;
+	struct wait_queue exit_wq;	/* Threads waiting for this one to exit */
+	struct spinlock lock;		/* Protects cwd and the file descriptors */
 	char *cwd;
 
 	/* File descriptors */
@@ -66,15 +124,20 @@ struct			thread
 	virt_addr_t stack;
 	size_t stack_size;
 
-	/* arch stuff */
-	struct arch_thread arch;
-
 	/* entry point */
 	thread_entry_cb entry;
 
-	/* virtual address space */
-	struct vaspace *vaspace;
-};
+	/* Data of kernel threads (see kthread_data()), or arguments of spawned threads */
+	void *data;
+
+	/* Set while it shrinks the caches, see shrink_caches() */
+	bool reclaiming;
+
+	/* Memory block the structure was allocated in (NULL if static) */
+	void *alloc;
+} __aligned(CACHE_LINE_SIZE);
+
+static_assert(offsetof(struct thread, name) <= CACHE_LINE_SIZE);
 
 void			thread_init(void);
 void			thread_early_init(void);
@@ -82,19 +145,32 @@ int			init_routine(void);
 
 struct thread		*thread_fork(void);
 struct thread		*thread_create(char const *name, thread_entry_cb entry, size_t stack_size);
+struct thread		*kthread_create(char const *name, thread_entry_cb entry, void *data);
+struct thread		*thread_spawn(char const *name, int (*main)(), char *argv[]);
+void			thread_spawn_exec(void);
+void			*kthread_data(void);
 int			thread_reserve_fd(void);
 void			thread_set_fd_handler(int fd, struct filehandler *hd);
 void			thread_free_fd(int fd);
 struct filehandler	*thread_get_fd_handler(int fd);
 void			thread_dump(void);
 void			thread_yield(void);
-void			thread_reschedule(void);
 void			thread_resume(struct thread *);
+void			sched_enqueue_new(struct thread *);
+void			sched_sleep(void);
+void			sched_first_run(void);
+void			sched_wait_switched_out(struct thread *);
+void			sched_init(void);
+void			sched_get_stats(struct sched_stats s[SCHED_NB_LEVELS]);
+void			sched_dump_stats(void);
+void			sched_get_cpu_stats(uint cpu, struct sched_cpu_stats *s);
+status_t		thread_set_nice(struct thread *, int nice);
+status_t		thread_set_affinity(struct thread *, cpumask_t mask);
 void			thread_exit(int);
 int			thread_waitpid(pid_t);
 char			*thread_getcwd(char *buffer, size_t len);
 status_t		thread_execve(char const *, int (*)(), int, char *argv[]);
-enum handler_return	irq_timer_handler(void);
+enum handler_return	sched_tick(void);
 
 /* Must be implemented in each architecture */
 void			set_current_thread(struct thread *);
@@ -102,6 +178,7 @@ struct thread		*get_current_thread(void);
 void			arch_context_switch(struct thread *old, struct thread *new);
 void			arch_init_thread(struct thread *);
 void			arch_init_fork_thread(struct thread *new);
+void			arch_init_spawn_thread(struct thread *new);
 void			arch_thread_execve(int, char *[]);
 
 # define LOCK_THREAD(state)	LOCK(&thread_table_lock, state)
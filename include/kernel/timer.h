@@ -0,0 +1,62 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#ifndef _KERNEL_TIMER_H_
+# define _KERNEL_TIMER_H_
+
+# include <kernel/list.h>
+# include <kernel/interrupts.h>
+# include <kernel/timespec.h>
+# include <chaosdef.h>
+# include <config.h>
+
+# define IRQ_TIMER_VECTOR		(0x0)
+
+/* Number of buckets of the timer wheel. Must be a power of two. */
+# define TIMER_WHEEL_SIZE		256u
+
+typedef void			(*timer_cb)(void *arg);
+
+/*
+** A one-shot kernel timer.
+**
+** The callback is called from the timer interrupt, once the tick count
+** reaches 'expires'.
+*/
+struct timer
+{
+	struct list_node node;
+	uint64 expires;
+	timer_cb callback;
+	void *arg;
+	bool pending;
+};
+
+/* Converts a duration to a number of ticks, rounding up */
+# define MSEC_TO_TICKS(ms)		(((ms) * HZ + 999u) / 1000u)
+# define SEC_TO_TICKS(s)		((s) * HZ)
+
+void			timer_setup(struct timer *timer, timer_cb cb, void *arg);
+void			timer_add(struct timer *timer, uint64 expires);
+bool			timer_cancel(struct timer *timer);
+uint64			get_ticks(void);
+void			timer_sleep(uint64 nb_ticks);
+void			timer_nohz_enter(void);
+void			timer_irq_enter(uint vector);
+enum handler_return	irq_timer_handler(void);
+
+/*
+** Must be implemented by each platform.
+*/
+void			platform_timer_periodic(void);
+uint			platform_timer_oneshot(uint nb_ticks);
+void			platform_timer_stop(void);
+void			platform_udelay(uint usec);
+
+#endif /* !_KERNEL_TIMER_H_ */
@@ -0,0 +1,25 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#ifndef _KERNEL_TIMESPEC_H_
+# define _KERNEL_TIMESPEC_H_
+
+# include <chaosdef.h>
+
+/*
+** Duration given to the nanosleep system call.
+** Shared with userspace, through unistd.h.
+*/
+struct timespec
+{
+	uint tv_sec;
+	uint tv_nsec;
+};
+
+#endif /* !_KERNEL_TIMESPEC_H_ */
@@ -17,6 +17,16 @@ enum unit_test_level
 	UNIT_TEST_LEVEL_LIBC		= 0,
 	UNIT_TEST_LEVEL_PMM,
 	UNIT_TEST_LEVEL_VMM,
+	UNIT_TEST_LEVEL_SHRINKER,
+	UNIT_TEST_LEVEL_SWAP,
+	UNIT_TEST_LEVEL_TIMER,
+	UNIT_TEST_LEVEL_PID,
+	UNIT_TEST_LEVEL_WAITQUEUE,
+	UNIT_TEST_LEVEL_MUTEX,
+	UNIT_TEST_LEVEL_RWLOCK,
+	UNIT_TEST_LEVEL_RCU,
+	UNIT_TEST_LEVEL_WORKQUEUE,
+	UNIT_TEST_LEVEL_FUTEX,
 };
 
 typedef void(*unit_test_hook_funcptr)(void);
@@ -11,10 +11,23 @@
 # define _KERNEL_VASPACE_H_
 
 # include <arch/vaspace.h>
-# include <kernel/spinlock.h>
+# include <kernel/vmm.h>
+# include <kernel/mutex.h>
+# include <kernel/seqlock.h>
+# include <chaoserr.h>
+# include <config.h>
 
 struct thread;
 
+/*
+** A user stack region left by an exited thread, see alloc_user_stack().
+*/
+struct user_stack
+{
+	virt_addr_t base;
+	size_t size;
+};
+
 /*
 ** Represents the virtual address space of a thread.
 */
@@ -42,21 +55,38 @@ struct vaspace
 	struct arch_vaspace arch;
 
 	/* Locker to lock the virtual address space */
-	struct spinlock lock;
+	struct mutex lock;
+
+	/*
+	** Taken by the holder of the mutex around updates of the segments
+	** above, so they can be read without sleeping.
+	*/
+	struct seqlock layout;
+
+	/* Stack regions of exited threads, protected by the mutex */
+	struct user_stack free_stacks[USER_STACK_CACHE_SIZE];
+	uint nb_free_stacks;
 
-	/* Number of threads sharing this virtual address space */
-	uint ref_count;
+	/* Number of threads sharing this virtual address space, atomic */
+	int ref_count;
 };
 
 struct vaspace			*setup_boot_vaspace(void);
+struct vaspace			*setup_kernel_vaspace(void);
+struct vaspace			*create_vaspace(void);
+void				destroy_vaspace(struct vaspace *vas);
 struct vaspace			*clone_vaspace(struct vaspace *src);
 void				init_vaspace(void);
 void				free_vaspace(void);
 void				free_zombie_thread(struct thread *t);
+virt_addr_t			alloc_user_stack(size_t size);
+void				free_user_stack(virt_addr_t base, size_t size);
 
 /* Must be re-implemented on each supported architecture */
 struct vaspace			*arch_clone_vaspace(struct vaspace *src);
 void				arch_init_vaspace(void);
+status_t			arch_init_kernel_vaspace(struct vaspace *vas);
+void				arch_destroy_vaspace(struct vaspace *vas);
 void				arch_free_vaspace(void);
 void				arch_free_zombie_thread(struct thread *t);
 
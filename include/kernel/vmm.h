@@ -14,6 +14,7 @@ typedef void 		*virt_addr_t;
 
 # include <kernel/pmm.h>
 # include <kernel/spinlock.h>
+# include <kernel/mutex.h>
 # include <arch/vaspace.h>
 # include <chaosdef.h>
 # include <chaoserr.h>
@@ -36,6 +37,12 @@ void			arch_dump_mem(void);
 */
 bool			arch_is_allocated(virt_addr_t);
 
+/*
+** Returns the frame the given virtual address is mapped to, or NULL_FRAME
+** if it isn't present.
+*/
+phys_addr_t		get_paddr(virt_addr_t va);
+
 /*
 ** Maps a physical address to a virtual one.
 */
@@ -68,7 +75,7 @@ virt_addr_t		ksbrk(intptr);
 status_t		ubrk(virt_addr_t new_brk);
 virt_addr_t		usbrk(intptr inc);
 
-# define LOCK_VASPACE(state)	LOCK(&get_current_thread()->vaspace->lock, state)
-# define RELEASE_VASPACE(state)	RELEASE(&get_current_thread()->vaspace->lock, state)
+# define LOCK_VASPACE()		mutex_lock(&get_current_thread()->vaspace->lock)
+# define RELEASE_VASPACE()	mutex_unlock(&get_current_thread()->vaspace->lock)
 
 #endif /* !_KERNEL_VMM_H_ */
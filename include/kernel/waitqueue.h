@@ -0,0 +1,36 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#ifndef _KERNEL_WAITQUEUE_H_
+# define _KERNEL_WAITQUEUE_H_
+
+# include <kernel/list.h>
+# include <chaosdef.h>
+
+/*
+** A list of threads sleeping until an event happens.
+**
+** Wait queues are protected by the thread lock, so a thread can check
+** the condition it is waiting for and go to sleep atomically. Scheduling
+** has its own locks, but sleeping and waking up on any wait queue still
+** serialize on the thread lock.
+*/
+struct wait_queue
+{
+	struct list_node waiters;
+};
+
+# define WAIT_QUEUE_INIT_VALUE(wq)	{ LIST_INIT_VALUE((wq).waiters) }
+
+void			wait_queue_init(struct wait_queue *wq);
+void			wait_queue_sleep(struct wait_queue *wq);
+bool			wait_queue_wake_one(struct wait_queue *wq);
+size_t			wait_queue_wake_all(struct wait_queue *wq);
+
+#endif /* !_KERNEL_WAITQUEUE_H_ */
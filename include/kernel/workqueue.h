@@ -0,0 +1,76 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#ifndef _KERNEL_WORKQUEUE_H_
+# define _KERNEL_WORKQUEUE_H_
+
+# include <kernel/list.h>
+# include <kernel/spinlock.h>
+# include <kernel/waitqueue.h>
+# include <kernel/timer.h>
+# include <chaosdef.h>
+
+struct workqueue;
+struct thread;
+
+typedef void			(*work_cb)(void *arg);
+
+/*
+** A function to call later, in thread context.
+**
+** It can be queued from an interrupt handler, and is called by the
+** worker thread of the queue. A work is queued at most once at a time.
+*/
+struct work
+{
+	struct list_node node;
+	work_cb func;
+	void *arg;
+	struct workqueue *wq;	/* Queue it's pending on, or NULL */
+};
+
+/*
+** A work queued once a timer expired.
+** It is armed from the moment it's timer is added to the moment the work is
+** queued, so it can't be armed twice in between.
+*/
+struct delayed_work
+{
+	struct work work;
+	struct timer timer;
+	struct workqueue *target;	/* Queue to put it on, NULL if cancelled */
+	bool armed;
+};
+
+/*
+** A list of pending works, run in order by a kernel thread.
+*/
+struct workqueue
+{
+	struct spinlock lock;
+	struct list_node works;
+	struct work *running;		/* Work being run by the worker */
+	struct thread *worker;
+	struct wait_queue waiters;	/* The worker, waiting for some work */
+	struct wait_queue flushers;	/* Threads waiting for the queue to be idle */
+};
+
+extern struct workqueue		*system_wq;
+
+void			workqueue_init(void);
+struct workqueue	*create_workqueue(char const *name);
+void			work_init(struct work *work, work_cb func, void *arg);
+void			delayed_work_init(struct delayed_work *dw, work_cb func, void *arg);
+bool			queue_work(struct workqueue *wq, struct work *work);
+bool			queue_delayed_work(struct workqueue *wq, struct delayed_work *dw, uint64 delay);
+bool			cancel_work(struct work *work);
+bool			cancel_delayed_work(struct delayed_work *dw);
+void			flush_workqueue(struct workqueue *wq);
+
+#endif /* !_KERNEL_WORKQUEUE_H_ */
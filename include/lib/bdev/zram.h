@@ -0,0 +1,76 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#ifndef _LIB_BDEV_ZRAM_H_
+# define _LIB_BDEV_ZRAM_H_
+
+# include <kernel/bdev.h>
+# include <kernel/spinlock.h>
+# include <lib/compress/lz4.h>
+
+# define ZRAM_BLOCKSIZE		PAGE_SIZE
+
+/* Size of the device created with the --zram boot option */
+# define ZRAM_DEFAULT_SIZE	(16 * 1024 * 1024)
+
+/* Pages that don't compress below this size are stored as is */
+# define ZRAM_MAX_COMPRESSED	(PAGE_SIZE * 3 / 4)
+
+enum zram_slot_type
+{
+	ZRAM_SLOT_EMPTY		= 0,
+	ZRAM_SLOT_SAME_FILLED,
+	ZRAM_SLOT_COMPRESSED,
+	ZRAM_SLOT_RAW,
+};
+
+struct zram_slot
+{
+	enum zram_slot_type type;
+	union {
+		uint32 fill;	/* Word repeated on the whole page */
+		void *data;	/* Compressed (or raw) content */
+	};
+	size_t size;		/* Size of data */
+};
+
+struct zram_stats
+{
+	size_t nb_stored;		/* Pages currently stored */
+	size_t nb_same_filled;		/* Pages stored without any memory */
+	size_t nb_raw;			/* Pages that didn't compress well */
+	size_t orig_size;		/* Total size of the stored pages */
+	size_t compr_size;		/* Memory actually used to store them */
+	size_t nb_reads;
+	size_t nb_writes;
+	size_t nb_failed_writes;
+
+	/* Latencies, in cycles (moving average of the last operations and max) */
+	uint32 read_latency;
+	uint32 write_latency;
+	uint32 max_read_latency;
+	uint32 max_write_latency;
+};
+
+struct zram_bdev
+{
+	struct bdev bdev;		/* Base device */
+	struct zram_slot *slots;
+	size_t nb_slots;
+	struct lz4_ctx *ctx;		/* Compressor working memory */
+	uchar *buffer;			/* Compression buffer */
+	struct spinlock lock;
+	struct zram_stats stats;
+};
+
+status_t		register_zram(char const *name, size_t size);
+status_t		zram_get_stats(struct bdev *bdev, struct zram_stats *stats);
+void			zram_print_stats(struct bdev *bdev);
+
+#endif /* !_LIB_BDEV_ZRAM_H_ */
@@ -0,0 +1,35 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#ifndef _LIB_COMPRESS_LZ4_H_
+# define _LIB_COMPRESS_LZ4_H_
+
+# include <chaosdef.h>
+
+# define LZ4_HASH_LOG		12
+# define LZ4_HASH_SIZE		(1 << LZ4_HASH_LOG)
+
+/* Offsets are stored on 16 bits, so the input can't be bigger */
+# define LZ4_MAX_INPUT_SIZE	(0x10000)
+
+/*
+** Working memory of the compressor.
+** It's too big to be put on the stack, so the caller must provide it.
+*/
+struct lz4_ctx
+{
+	uint16 table[LZ4_HASH_SIZE];
+};
+
+size_t		lz4_compress(void const *src, size_t src_len, void *dst,
+			     size_t dst_len, struct lz4_ctx *ctx);
+ssize_t		lz4_decompress(void const *src, size_t src_len, void *dst,
+			       size_t dst_len);
+
+#endif /* !_LIB_COMPRESS_LZ4_H_ */
@@ -0,0 +1,41 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#ifndef _PLATFORM_PC_PIT_H_
+# define _PLATFORM_PC_PIT_H_
+
+# include <chaosdef.h>
+# include <config.h>
+
+# define PIT_FREQUENCY			1193182u
+
+# define PIT_CHANNEL0_IO_PORT		0x40
+# define PIT_COMMAND_IO_PORT		0x43
+
+/* Channel 0, lobyte/hibyte access, rate generator */
+# define PIT_CMD_CHANNEL0_RATE		0x34
+
+/* Channel 0, lobyte/hibyte access, interrupt on terminal count */
+# define PIT_CMD_CHANNEL0_ONESHOT	0x30
+
+/* Channel 2 (not wired to an interrupt), lobyte/hibyte access, interrupt on terminal count */
+# define PIT_CMD_CHANNEL2_ONESHOT	0xB0
+
+# define PIT_CHANNEL2_IO_PORT		0x42
+
+/* Controls the gate of channel 2, and reads it's output */
+# define PIT_CHANNEL2_GATE_IO_PORT	0x61
+# define PIT_CHANNEL2_GATE		(1u << 0u)
+# define PIT_CHANNEL2_SPEAKER		(1u << 1u)
+# define PIT_CHANNEL2_OUTPUT		(1u << 5u)
+
+/* Number of PIT cycles between two ticks */
+# define PIT_TICK_DIVISOR		(PIT_FREQUENCY / HZ)
+
+#endif /* !_PLATFORM_PC_PIT_H_ */
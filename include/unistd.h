@@ -12,6 +12,8 @@
 
 # include <chaosdef.h>
 # include <chaoserr.h>
+# include <kernel/futex.h>	/* Operations of the futex syscall */
+# include <kernel/timespec.h>
 
 typedef int	pid_t;
 
@@ -38,5 +40,9 @@ char		*getcwd(char *, size_t);
 int		open(char const *);
 int		close(int);
 int		readdir(int, struct dirent *);
+uint		sleep(uint seconds);
+int		nanosleep(struct timespec const *);
+pid_t		spawn(char const *, int (*)(), char const *[]);
+int		futex(uint32 *, int, uint32);
 
 #endif /* !_UNISTD_H_ */
@@ -9,10 +9,19 @@
 
 #include <kernel/bdev.h>
 #include <kernel/kalloc.h>
+#include <kernel/rcu.h>
+#include <kernel/spinlock.h>
 #include <arch/common_op.h>
 #include <string.h>
+#include <debug.h>
 
+/*
+** The device list is read under RCU, so opening a device doesn't take any
+** lock. Registrations are serialized by the spinlock, and an unregistered
+** device keeps the reference of the list until a grace period elapsed.
+*/
 static struct list_node bdev_list = LIST_INIT_VALUE(bdev_list);
+static struct spinlock bdev_lock;
 
 static inline void
 bdev_inc_ref(struct bdev *bdev)
@@ -23,11 +32,15 @@ bdev_inc_ref(struct bdev *bdev)
 static inline void
 bdev_dec_ref(struct bdev *bdev)
 {
+	char *name;
+
 	if (atomic_add(&bdev->ref_count, -1) == 1) {
+		/* The device may be freed by it's close() callback */
+		name = bdev->name;
 		if (bdev->close) {
 			bdev->close(bdev);
 		}
-		kfree(bdev->name);
+		kfree(name);
 	}
 }
 
@@ -54,15 +67,30 @@ bdev_open(char const *name)
 {
 	struct bdev *bdev;
 
-	list_foreach_content(bdev, &bdev_list, node) {
+	RCU_READ_LOCK(state);
+	list_foreach_content_rcu(bdev, &bdev_list, node) {
 		if (!strcmp(name, bdev->name)) {
 			bdev_inc_ref(bdev);
+			RCU_READ_UNLOCK(state);
 			return (bdev);
 		}
 	}
+	RCU_READ_UNLOCK(state);
 	return (NULL);
 }
 
+/*
+** Takes an other reference on the given opened device, so it can be used
+** after the one it was found through is dropped. Released with bdev_close().
+*/
+struct bdev *
+bdev_dup(struct bdev *bdev)
+{
+	assert_neq(bdev->ref_count, 0);
+	bdev_inc_ref(bdev);
+	return (bdev);
+}
+
 ssize_t
 bdev_read(struct bdev *dev, void *buff, size_t offset, size_t len)
 {
@@ -87,12 +115,22 @@ void
 bdev_register(struct bdev *bdev)
 {
 	bdev_inc_ref(bdev);
-	list_add_tail(&bdev->node, &bdev_list);
+	LOCK(&bdev_lock, state);
+	list_add_rcu(&bdev->node, bdev_list.prev);
+	RELEASE(&bdev_lock, state);
 }
 
+/*
+** Removes the given device from the device list.
+** May sleep until the readers that could have found it are gone.
+*/
 void
 bdev_unregister(struct bdev *bdev)
 {
-	list_delete(&bdev->node);
+	LOCK(&bdev_lock, state);
+	list_delete_rcu(&bdev->node);
+	RELEASE(&bdev_lock, state);
+
+	synchronize_rcu();
 	bdev_dec_ref(bdev);
 }
@@ -0,0 +1,70 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#include <kernel/benchmark.h>
+#include <kernel/multiboot.h>
+#include <kernel/timer.h>
+#include <arch/common_op.h>
+#include <stdio.h>
+
+extern struct benchmark_hook const __start_chaos_benchmarks[] __weak;
+extern struct benchmark_hook const __stop_chaos_benchmarks[] __weak;
+
+void
+bench_start(struct bench *b)
+{
+	b->start_ticks = get_ticks();
+	b->start_cycles = read_cycle_counter();
+}
+
+/*
+** Prints the average cost of an operation since bench_start().
+** The rate is only printed if the timer ticked meanwhile.
+*/
+void
+bench_stop(struct bench *b, char const *what, uint32 nb_ops)
+{
+	uint64 cycles;
+	uint64 ticks;
+
+	cycles = read_cycle_counter() - b->start_cycles;
+	ticks = get_ticks() - b->start_ticks;
+	if (nb_ops == 0) {
+		nb_ops = 1;
+	}
+
+	printf("\t%s: %u ops, %u cycles/op",
+		what,
+		nb_ops,
+		(uint32)udiv64_32(cycles, nb_ops)
+	);
+	if (ticks != 0 && ticks < (uint32)-1) {
+		printf(", %u ops/s", (uint32)udiv64_32((uint64)nb_ops * HZ, (uint32)ticks));
+	}
+	printf("\n");
+}
+
+/*
+** Runs all the benchmarks, if asked to on the command line.
+*/
+void __init
+run_benchmarks(void)
+{
+	struct benchmark_hook const *hook;
+
+	if (!cmd_options.bench) {
+		return ;
+	}
+	for (hook = __start_chaos_benchmarks; hook < __stop_chaos_benchmarks; ++hook)
+	{
+		printf("[..]\tBenchmark (%s)\n", hook->name);
+		hook->hook();
+		printf("[OK]\tBenchmark (%s)\n", hook->name);
+	}
+}
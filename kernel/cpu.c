@@ -0,0 +1,83 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#include <kernel/cpu.h>
+#include <kernel/thread.h>
+#include <arch/common_op.h>
+#include <stdio.h>
+
+/*
+** The boot processor is always cpus[0]. The others are registered when
+** the architecture discovers them.
+*/
+struct cpu cpus[MAX_CPUS];
+uint nb_cpus = 1;
+
+/* Set once the init memory is freed, so the other processors can schedule */
+static volatile bool boot_done;
+
+/*
+** Reserves the structure of a new processor.
+** Returns NULL if there are already MAX_CPUS processors.
+*/
+struct cpu *
+cpu_register(void)
+{
+	struct cpu *cpu;
+
+	if (nb_cpus >= MAX_CPUS) {
+		return (NULL);
+	}
+	cpu = cpus + nb_cpus;
+	cpu->self = cpu;
+	cpu->id = nb_cpus;
+	nb_cpus++;
+	return (cpu);
+}
+
+/*
+** Prints the state of each processor.
+*/
+void
+cpu_dump(void)
+{
+	struct cpu *cpu;
+
+	for (cpu = cpus; cpu < cpus + nb_cpus; ++cpu) {
+		printf("cpu%u: %s, running %s, %u irqs (avg %u cycles, max %u)\n",
+			cpu->id,
+			cpu->online ? "online" : "offline",
+			cpu->current_thread ? cpu->current_thread->name : "nothing",
+			cpu->nb_irqs,
+			cpu->nb_irqs ? (uint32)udiv64_32(cpu->irq_cycles, cpu->nb_irqs) : 0,
+			cpu->irq_max_cycles
+		);
+	}
+}
+
+/*
+** Lets the other processors start running threads.
+** Called by the init thread, once the init memory is freed.
+*/
+void
+smp_boot_done(void)
+{
+	boot_done = true;
+}
+
+/*
+** Spins until smp_boot_done() is called.
+*/
+void
+smp_wait_boot_done(void)
+{
+	while (!boot_done) {
+		pause();
+	}
+}
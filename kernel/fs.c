@@ -12,6 +12,8 @@
 #include <kernel/list.h>
 #include <kernel/init.h>
 #include <kernel/kalloc.h>
+#include <kernel/mutex.h>
+#include <kernel/rcu.h>
 #include <kernel/multiboot.h>
 #include <kernel/thread.h>
 #include <arch/common_op.h>
@@ -24,6 +26,17 @@ extern struct fs_hook const __end_fs_hook[] __weak;
 
 struct list_node mounts = LIST_INIT_VALUE(mounts);
 
+/*
+** The mount list is read under RCU, so path lookups don't take any lock.
+** The list holds a reference on each mount, and reference counters are
+** updated atomically. A counter only drops to 0 when the mount is taken
+** out of the list, and a reader never takes a reference on such a mount.
+**
+** Mounting and unmounting are serialized by a mutex, as they call the
+** filesystem drivers and may read the device.
+*/
+static struct mutex mounts_lock = MUTEX_INIT_VALUE(mounts_lock);
+
 static char *
 resolve_input(char const *cwd, char const *input)
 {
@@ -194,6 +207,25 @@ find_fs(char const *name)
 	return (NULL);
 }
 
+/*
+** Takes a reference on the given mount, unless it is being unmounted.
+*/
+static bool
+get_mount_unless_zero(struct fs_mount *mount)
+{
+	int ref;
+
+	ref = mount->ref_count;
+	while (ref != 0)
+	{
+		if (atomic_cmpxchg(&mount->ref_count, ref, ref + 1) == ref) {
+			return (true);
+		}
+		ref = mount->ref_count;
+	}
+	return (false);
+}
+
 /*
 ** Finds the mount structure holding the given path, and stores
 ** the remaining path in 'trimmed_path'.
@@ -208,40 +240,56 @@ find_mount(char const *path, char const **trimmed_path)
 	size_t mount_pathlen;
 
 	pathlen = strlen(path);
-	list_foreach_content(mount, &mounts, node) {
+	RCU_READ_LOCK(state);
+	list_foreach_content_rcu(mount, &mounts, node) {
 		mount_pathlen = strlen(mount->path);
 
 		if (pathlen < mount_pathlen)
 			continue;
-		if (memcmp(path, mount->path, mount_pathlen) == 0) {
+		if (memcmp(path, mount->path, mount_pathlen) == 0
+			&& get_mount_unless_zero(mount)) {
 			if (trimmed_path)
 				*trimmed_path = path + mount_pathlen;
-			mount->ref_count++;
+			RCU_READ_UNLOCK(state);
 			return (mount);
 		}
 	}
+	RCU_READ_UNLOCK(state);
 	return (NULL);
 }
 
 /*
-** Decrements the reference counter of the given mount structure,
-** eventually causing a unmount operation if it reaches 0.
+** Unmounts the given mount structure, once it was removed from the mount
+** list and the readers that may have found it are gone.
+*/
+static void
+free_mount(struct fs_mount *mount)
+{
+	mount->api->unmount(mount->fscookie);
+	kfree(mount->path);
+	bdev_close(mount->device);
+	kfree(mount);
+}
+
+/*
+** Decrements the reference counter of the given mount structure.
+** The last reference is the one of the mount list, dropped by
+** fs_unmount().
 */
 static void
 put_mount(struct fs_mount *mount)
 {
-	--mount->ref_count;
-	if (mount->ref_count == 0) {
-		list_delete(&mount->node);
-		mount->api->unmount(mount->fscookie);
-		kfree(mount->path);
-		bdev_close(mount->device);
-		kfree(mount);
-	}
+	int old;
+
+	old = atomic_add(&mount->ref_count, -1);
+	assert_lo(1, old);
 }
 
 /*
 ** Mounts the given file system api at the given path for the given device.
+**
+** The mount lock is held all along, so two threads can't mount something
+** at the same path.
 */
 static status_t
 mount(char const *path, char const *device, struct fs_api *const api)
@@ -262,6 +310,7 @@ mount(char const *path, char const *device, struct fs_api *const api)
 	}
 	resolve_path(tmp);
 
+	mutex_lock(&mounts_lock);
 	mount = find_mount(tmp, &relative);
 	if (mount) {
 		err = ERR_ALREADY_MOUNTED;
@@ -290,13 +339,17 @@ mount(char const *path, char const *device, struct fs_api *const api)
 	mount->fscookie = cookie;
 	mount->ref_count = 1;
 	mount->api = api;
-	list_add(&mount->node, &mounts);
+
+	list_add_rcu(&mount->node, &mounts);
+
+	mutex_unlock(&mounts_lock);
 	return (OK);
 
 err:
 	if (mount) {
 		put_mount(mount);
 	}
+	mutex_unlock(&mounts_lock);
 	if (bdev) {
 		bdev_close(bdev);
 	}
@@ -335,17 +388,29 @@ fs_unmount(char const *path)
 		return (ERR_NO_MEMORY);
 	}
 	resolve_path(tmp);
+
+	mutex_lock(&mounts_lock);
 	mount = find_mount(tmp, NULL);
 	kfree(tmp);
 	if (!mount) {
+		mutex_unlock(&mounts_lock);
 		return (ERR_NOT_FOUND);
 	}
-	put_mount(mount);
-	if (mount->ref_count > 1) {
-		return (ERR_TARGET_BUSY);
-	} else {
+
+	/*
+	** Only ours and the one of the list are expected. Dropping both at
+	** once ensures no one grabs a reference in the meantime.
+	*/
+	if (atomic_cmpxchg(&mount->ref_count, 2, 0) != 2) {
 		put_mount(mount);
+		mutex_unlock(&mounts_lock);
+		return (ERR_TARGET_BUSY);
 	}
+	list_delete_rcu(&mount->node);
+	mutex_unlock(&mounts_lock);
+
+	synchronize_rcu();
+	free_mount(mount);
 	return (OK);
 }
 
@@ -431,6 +496,8 @@ fs_readdir(struct filehandler *handler, struct dirent *dirent)
 
 /*
 ** Duplicates the given file handler into a new one kheap-allocated.
+** The new handler holds it's own reference on the mount, dropped by
+** fs_close().
 */
 struct filehandler *
 fs_dup_handler(struct filehandler const *handler)
@@ -440,10 +507,11 @@ fs_dup_handler(struct filehandler const *handler)
 	nh = kalloc(sizeof(*nh));
 	if (nh != NULL) {
 		memcpy(nh, handler, sizeof(*nh));
+		atomic_add(&nh->mount->ref_count, 1);
 	}
 	return (nh);
 }
-static void
+static void __init
 init_fs(enum init_level il __unused)
 {
 	printf("[..]\tFilesystem");
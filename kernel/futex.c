@@ -0,0 +1,286 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#include <kernel/futex.h>
+#include <kernel/thread.h>
+#include <kernel/swap.h>
+#include <kernel/unit_tests.h>
+#include <kernel/interrupts.h>
+#include <debug.h>
+
+extern struct spinlock thread_table_lock;
+
+/*
+** Fast user-space mutexes.
+**
+** A futex is a 32-bit word of user memory. User programs handle it with
+** atomic operations, and only enter the kernel to sleep while it holds a
+** given value, or to wake the threads sleeping on it.
+**
+** Sleeping threads are found through a hash table, keyed by the physical
+** address of the word, so threads sharing it through different mappings
+** find each other. Futexes of the same page share a bucket.
+**
+** The page of a futex is pinned while a thread sleeps on it, so the key
+** doesn't change if memory runs low. It is unpinned when the last thread
+** sleeping on that page goes away. Waking threads up doesn't pin anything:
+** a page that isn't present has no sleeper.
+**
+** Each sleeping thread has it's own wait queue. Like all wait queues,
+** they and the hash table are protected by the thread lock. A thread is
+** added to the hash table before it reads the value of the futex, so a
+** wake-up following a change of that value can't be missed.
+*/
+
+struct futex_waiter
+{
+	struct list_node node;		/* Node in the hash table */
+	phys_addr_t key;
+	struct vaspace *vaspace;
+	virt_addr_t page;
+	struct wait_queue wq;
+	bool woken;
+};
+
+static struct list_node futex_hash[FUTEX_HASH_SIZE];
+
+static inline struct list_node *
+futex_bucket(phys_addr_t key)
+{
+	return (futex_hash + (((key >> 12u) ^ (key >> 20u)) & (FUTEX_HASH_SIZE - 1)));
+}
+
+/*
+** Returns true if the given user address can hold a futex.
+*/
+static inline bool
+futex_valid(uint32 *uaddr)
+{
+	return (!((uintptr)uaddr % sizeof(uint32)) && (virt_addr_t)uaddr < KERNEL_VIRTUAL_BASE);
+}
+
+/*
+** Pins the page of the futex at the given user address and adds the given
+** waiter to the hash table.
+** The vaspace mutex must be held, so the page can't be unmapped.
+**
+** Returns ERR_INVALID_ARGS if the page isn't mapped.
+*/
+static status_t
+futex_enqueue(struct futex_waiter *w, uint32 *uaddr)
+{
+	phys_addr_t pa;
+
+	w->vaspace = get_current_thread()->vaspace;
+	w->page = (virt_addr_t)ROUND_DOWN((uintptr)uaddr, PAGE_SIZE);
+	do {
+		/* Swapping in sleeps, so it's done before taking the thread lock */
+		if (arch_swap_get_slot(w->page) != NULL_SLOT && swap_in(w->page) != OK) {
+			return (ERR_INVALID_ARGS);
+		}
+
+		LOCK_THREAD(state);
+		pa = swap_pin_page(w->page);
+		if (pa != NULL_FRAME) {
+			w->key = pa + ((uintptr)uaddr & (PAGE_SIZE - 1));
+			list_add_tail(&w->node, futex_bucket(w->key));
+		}
+		RELEASE_THREAD(state);
+
+	/* The page may have been swapped out again in between */
+	} while (pa == NULL_FRAME && arch_swap_get_slot(w->page) != NULL_SLOT);
+	return (pa == NULL_FRAME ? ERR_INVALID_ARGS : OK);
+}
+
+/*
+** Unpins the page of the given waiter, already removed from the hash table,
+** unless an other thread still sleeps on it.
+** The thread lock must be held.
+*/
+static void
+futex_unpin(struct futex_waiter *w)
+{
+	struct futex_waiter *other;
+	struct list_node *bucket;
+
+	assert(holding_lock(&thread_table_lock));
+	bucket = futex_bucket(w->key);
+	list_foreach_content(other, bucket, node) {
+		if (other->vaspace == w->vaspace && other->page == w->page) {
+			return ;
+		}
+	}
+	swap_unpin_page(w->page);
+}
+
+/*
+** Puts the current thread to sleep until the futex at the given user
+** address is woken up, if it still holds the given value.
+**
+** Returns ERR_INVALID_ARGS if the address isn't a valid futex, or
+** ERR_BAD_STATE if it doesn't hold the given value.
+*/
+status_t
+futex_wait(uint32 *uaddr, uint32 val)
+{
+	struct futex_waiter w;
+	status_t err;
+	uint32 cur;
+
+	if (!futex_valid(uaddr)) {
+		return (ERR_INVALID_ARGS);
+	}
+	w.woken = false;
+	wait_queue_init(&w.wq);
+
+	/* The page is pinned and can't be unmapped, so reading it can't fault */
+	LOCK_VASPACE();
+	err = futex_enqueue(&w, uaddr);
+	if (err == OK) {
+		cur = *(uint32 volatile *)uaddr;
+	}
+	RELEASE_VASPACE();
+	if (err != OK) {
+		return (err);
+	}
+
+	LOCK_THREAD(state);
+	if (cur != val && !w.woken) {
+		list_delete(&w.node);
+		err = ERR_BAD_STATE;
+	}
+	while (err == OK && !w.woken) {
+		wait_queue_sleep(&w.wq);
+	}
+	futex_unpin(&w);
+	RELEASE_THREAD(state);
+	return (err);
+}
+
+/*
+** Wakes up at most the given number of threads sleeping on the futex at
+** the given user address, in the order they went to sleep.
+**
+** Returns the number of threads woken up, or -1 if the address isn't a
+** valid futex.
+*/
+int
+futex_wake(uint32 *uaddr, uint nb)
+{
+	struct futex_waiter *w;
+	struct list_node *bucket;
+	struct list_node *node;
+	phys_addr_t key;
+	int woken;
+
+	if (!futex_valid(uaddr)) {
+		return (-1);
+	}
+
+	/* Threads sleeping on a futex keep it's page present */
+	key = get_paddr((virt_addr_t)ROUND_DOWN((uintptr)uaddr, PAGE_SIZE));
+	if (key == NULL_FRAME) {
+		return (0);
+	}
+	key += (uintptr)uaddr & (PAGE_SIZE - 1);
+	bucket = futex_bucket(key);
+	woken = 0;
+
+	LOCK_THREAD(state);
+	node = bucket->next;
+	while (node != bucket && (uint)woken < nb)
+	{
+		w = get_content(node, struct futex_waiter, node);
+		node = node->next;
+		if (w->key == key) {
+			list_delete(&w->node);
+			w->woken = true;
+			wait_queue_wake_one(&w->wq);
+			++woken;
+		}
+	}
+	RELEASE_THREAD(state);
+	return (woken);
+}
+
+static uint32 volatile *futex_test_word;
+
+static int __init
+futex_test_main(void)
+{
+	assert_eq(futex_wait((uint32 *)futex_test_word, 42), OK);
+	assert_eq(*futex_test_word, 43);
+	return (0);
+}
+
+/*
+** Futex tests, with a second thread sharing the address space of the
+** boot thread for the sleeping paths.
+*/
+static void __init
+futex_test(void)
+{
+	struct thread *t;
+	uint32 *word;
+	int_state_t int_state;
+
+	word = mmap(NULL, PAGE_SIZE, MMAP_USER | MMAP_WRITE);
+	assert_neq(word, NULL);
+	*word = 42;
+
+	/* Nothing is pinned when no thread sleeps */
+	assert_eq(futex_wait(word, 41), ERR_BAD_STATE);
+	assert_eq(futex_wake(word, 1), 0);
+	assert(arch_swap_is_swappable(word));
+
+	/* Misaligned or kernel addresses aren't futexes */
+	assert_eq(futex_wait((uint32 *)((char *)word + 1), 42), ERR_INVALID_ARGS);
+	assert_eq(futex_wake((uint32 *)KERNEL_VIRTUAL_BASE, 1), -1);
+
+	/* The second thread sleeps until the value changes and it's woken up */
+	futex_test_word = word;
+	t = thread_create("futex-test", &futex_test_main, DEFAULT_STACK_SIZE);
+	assert_neq(t, NULL);
+	assert_eq(thread_set_affinity(t, CPUMASK_CPU(current_cpu()->id)), OK);
+	while (t->state != SUSPENDED) {
+		thread_yield();
+	}
+	assert(!arch_swap_is_swappable(word));
+
+	*word = 43;
+	assert_eq(futex_wake(word, 2), 1);
+
+	/* thread_waitpid() expects interrupts to be enabled */
+	arch_push_interrupts(&int_state);
+	arch_enable_interrupts();
+	assert_eq(thread_waitpid(t->pid), 0);
+	arch_pop_interrupts(&int_state);
+
+	/* The page was unpinned by the last thread sleeping on it */
+	assert(arch_swap_is_swappable(word));
+	assert_eq(futex_wake(word, 1), 0);
+
+	munmap(word, PAGE_SIZE);
+}
+
+/*
+** Initializes the futex hash table.
+*/
+static void __init
+futex_init(enum init_level il __unused)
+{
+	size_t i;
+
+	for (i = 0; i < FUTEX_HASH_SIZE; ++i) {
+		LIST_INIT_HEAD(futex_hash + i);
+	}
+}
+
+NEW_INIT_HOOK(futex, &futex_init, CHAOS_INIT_LEVEL_EARLIEST);
+NEW_UNIT_TEST(futex, &futex_test, UNIT_TEST_LEVEL_FUTEX);
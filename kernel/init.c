@@ -8,6 +8,8 @@
 \* ------------------------------------------------------------------------ */
 
 #include <kernel/init.h>
+#include <kernel/vmm.h>
+#include <stdio.h>
 
 extern struct init_hook const __start_chaos_init[] __weak;
 extern struct init_hook const __stop_chaos_init[] __weak;
@@ -15,7 +17,7 @@ extern struct init_hook const __stop_chaos_init[] __weak;
 /*
 ** Find the next un-called hook which level is between the two given one.
 */
-static struct init_hook const *
+static struct init_hook const * __init
 find_next_hook(struct init_hook const *last, enum init_level last_level, enum init_level end_level)
 {
 	struct init_hook const *hook;
@@ -49,7 +51,7 @@ find_next_hook(struct init_hook const *last, enum init_level last_level, enum in
 /*
 ** Init all levels between the two one given in parameter, included.
 */
-void
+void __init
 kernel_init_level(enum init_level start_level, enum init_level end_level)
 {
 	struct init_hook const *hook;
@@ -60,3 +62,18 @@ kernel_init_level(enum init_level start_level, enum init_level end_level)
 		hook = find_next_hook(hook, hook->level, end_level);
 	}
 }
+
+/*
+** Frees the code and data only used during boot, marked with __init and
+** __initdata, and the boot stack.
+** Must be called once all init levels are done, from an other stack.
+*/
+void
+free_init_memory(void)
+{
+	size_t size;
+
+	size = KERNEL_INIT_END - KERNEL_INIT_START;
+	munmap(KERNEL_INIT_START, size);
+	printf("[OK]\tFreed init memory (%r)\n", size);
+}
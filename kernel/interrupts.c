@@ -8,6 +8,9 @@
 \* ------------------------------------------------------------------------ */
 
 #include <kernel/interrupts.h>
+#include <kernel/timer.h>
+#include <kernel/cpu.h>
+#include <arch/common_op.h>
 
 /*
 ** This file is about handling interrupts requests in an architecture independant way.
@@ -36,11 +39,31 @@ unregister_int_handler(uint vec)
 	return (OK);
 }
 
+/*
+** Calls the handler of the given vector, and accounts the time it took to
+** the current processor.
+*/
 enum handler_return
 handle_interrupt(uint vector)
 {
+	enum handler_return ret;
+	struct cpu *cpu;
+	uint64 start;
+	uint64 cycles;
+
+	start = read_cycle_counter();
+	timer_irq_enter(vector);
+	ret = IRQ_NO_RESCHEDULE;
 	if (irq_handlers[vector]) {
-		return (irq_handlers[vector]());
+		ret = irq_handlers[vector]();
+	}
+
+	cycles = read_cycle_counter() - start;
+	cpu = current_cpu();
+	cpu->irq_cycles += cycles;
+	cpu->nb_irqs++;
+	if (cycles > cpu->irq_max_cycles) {
+		cpu->irq_max_cycles = cycles > (uint32)-1 ? (uint32)-1 : (uint32)cycles;
 	}
-	return (IRQ_NO_RESCHEDULE);
+	return (ret);
 }
@@ -10,6 +10,7 @@
 #include <kernel/kalloc.h>
 #include <kernel/spinlock.h>
 #include <kernel/init.h>
+#include <kernel/shrinker.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -167,6 +168,28 @@ kfree(virt_addr_t ptr)
 	}
 }
 
+/*
+** Returns true if the kernel heap is being modified.
+**
+** In that case, calling kalloc() would corrupt it. This happens when
+** memory is reclaimed on behalf of the heap itself (eg: a page is swapped out
+** to make room for a new heap page).
+*/
+bool
+kalloc_busy(void)
+{
+	return (holding_lock(&kernel_heap_lock));
+}
+
+/*
+** Prints the statistics of the kernel heap lock, if they are enabled.
+*/
+void
+kalloc_dump_lock_stats(void)
+{
+	lock_dump_stats("kernel heap", &kernel_heap_lock);
+}
+
 /*
 ** realloc(), but using memory in kernel space.
 ** TODO Make this function safer (overflow)
@@ -202,7 +225,59 @@ kcalloc(size_t a, size_t b)
 	return (ptr);
 }
 
-static void
+/*
+** Returns the number of frames that could be given back by trimming the
+** free block at the end of the heap.
+*/
+static size_t
+kheap_shrinker_count(void)
+{
+	struct block *tail;
+	size_t count;
+
+	if (kalloc_busy()) {
+		return (0);
+	}
+	count = 0;
+	LOCK_KHEAP(state);
+	tail = alloc_datas.tail;
+	if (tail != NULL && !tail->used && tail->size > PAGE_SIZE) {
+		count = (tail->size - sizeof(void *)) / PAGE_SIZE;
+	}
+	RELEASE_KHEAP(state);
+	return (count);
+}
+
+/*
+** Trims the free block at the end of the heap.
+*/
+static size_t
+kheap_shrinker_scan(size_t nb_frames)
+{
+	struct block *tail;
+	size_t before;
+	size_t size;
+
+	if (kalloc_busy()) {
+		return (0);
+	}
+	before = nb_free_frames();
+	LOCK_KHEAP(state);
+	tail = alloc_datas.tail;
+	if (tail != NULL && !tail->used && tail->size > PAGE_SIZE)
+	{
+		/* Keep a few bytes in the block, so it doesn't disappear */
+		size = ROUND_DOWN(tail->size - sizeof(void *), PAGE_SIZE);
+		size = nb_frames * PAGE_SIZE < size ? nb_frames * PAGE_SIZE : size;
+		if (ksbrk(-size) != (virt_addr_t)-1u) {
+			tail->size -= size;
+		}
+	}
+	RELEASE_KHEAP(state);
+	return (nb_free_frames() - before);
+}
+
+static void __init
 init_kmalloc(enum init_level il __unused)
 {
 	init_lock(&kernel_heap_lock);
@@ -210,3 +285,4 @@ init_kmalloc(enum init_level il __unused)
 }
 
 NEW_INIT_HOOK(kmalloc, &init_kmalloc, CHAOS_INIT_LEVEL_VMM + 1);
+NEW_SHRINKER(kheap, SHRINKER_COST_LOW, &kheap_shrinker_count, &kheap_shrinker_scan);
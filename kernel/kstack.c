@@ -0,0 +1,86 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#include <kernel/kstack.h>
+#include <kernel/kalloc.h>
+#include <kernel/cpu.h>
+#include <kernel/interrupts.h>
+#include <config.h>
+
+/*
+** Per-processor caches of kernel stacks.
+**
+** The kernel stack of a thread that was waited is kept in a cache of the
+** processor that waited it, and given to the next thread created there,
+** instead of going back and forth through the kernel heap.
+**
+** Each cache is only used by it's own processor, with interrupts
+** disabled, so it doesn't need a lock. They are small enough not to be
+** worth shrinking.
+** Only stacks of DEFAULT_KERNEL_STACK_SIZE are cached.
+*/
+
+struct kstack_cache
+{
+	void *stacks[KSTACK_CACHE_SIZE];
+	uint nb_stacks;
+} __aligned(CACHE_LINE_SIZE);
+
+static struct kstack_cache kstack_caches[MAX_CPUS];
+
+/*
+** Allocates a kernel stack of the given size.
+** Returns NULL if there isn't enough memory.
+*/
+void *
+kstack_alloc(size_t size)
+{
+	struct kstack_cache *cache;
+	int_state_t state;
+	void *stack;
+
+	stack = NULL;
+	if (size == DEFAULT_KERNEL_STACK_SIZE)
+	{
+		arch_push_interrupts(&state);
+		arch_disable_interrupts();
+		cache = kstack_caches + current_cpu()->id;
+		if (cache->nb_stacks > 0) {
+			stack = cache->stacks[--cache->nb_stacks];
+		}
+		arch_pop_interrupts(&state);
+	}
+	return (stack ? stack : kalloc(size));
+}
+
+/*
+** Gives back the given kernel stack, of the given size.
+*/
+void
+kstack_free(void *stack, size_t size)
+{
+	struct kstack_cache *cache;
+	int_state_t state;
+
+	if (stack == NULL) {
+		return ;
+	}
+	if (size == DEFAULT_KERNEL_STACK_SIZE)
+	{
+		arch_push_interrupts(&state);
+		arch_disable_interrupts();
+		cache = kstack_caches + current_cpu()->id;
+		if (cache->nb_stacks < KSTACK_CACHE_SIZE) {
+			cache->stacks[cache->nb_stacks++] = stack;
+			stack = NULL;
+		}
+		arch_pop_interrupts(&state);
+	}
+	kfree(stack);
+}
@@ -14,7 +14,7 @@
 /*
 ** Common entry point of the kernel.
 */
-void
+void __init
 kernel_main(void)
 {
 	/* Put us in the boot thread */
@@ -23,8 +23,8 @@ kernel_main(void)
 	/* Ensure libc is working correctly */
 	trigger_unit_tests(UNIT_TEST_LEVEL_LIBC);
 
-	/* Go through all init levels */
-	kernel_init_level(CHAOS_INIT_LEVEL_EARLIEST, CHAOS_INIT_LEVEL_LATEST);
+	/* Go through all init levels, until kernel threads can be created */
+	kernel_init_level(CHAOS_INIT_LEVEL_EARLIEST, CHAOS_INIT_LEVEL_KTHREADS - 1);
 
 	/* Build the init process, print hello message, enable multithreading and let's go! */
 	thread_init();
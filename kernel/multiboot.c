@@ -23,23 +23,27 @@ struct multiboot_info multiboot_infos;
 struct cmd_options cmd_options =
 {
 	.unit_test = false,
+	.bench = false,
+	.zram = false,
 };
 
 /*
 ** Parse the command line arguments
 */
-static void
+static void __init
 parse_cmd_options(void)
 {
 	if (multiboot_infos.args) {
 		cmd_options.unit_test = strstr(multiboot_infos.args, "--unit-test") != NULL;
+		cmd_options.bench = strstr(multiboot_infos.args, "--bench") != NULL;
+		cmd_options.zram = strstr(multiboot_infos.args, "--zram") != NULL;
 	}
 }
 
 /*
 ** Goes through the multiboot structure, parsing it's content
 */
-static void
+static void __init
 multiboot_load(void)
 {
 	struct multiboot_tag *tag;
@@ -79,7 +83,7 @@ multiboot_load(void)
 	printf("\r[OK]\tMultiboot [%s] [%s] [%r]\n", multiboot_infos.bootloader, multiboot_infos.args, multiboot_infos.initrd.size);
 }
 
-static void
+static void __init
 multiboot_init(enum init_level il __unused)
 {
 	if (mb_tag) {
@@ -0,0 +1,223 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#include <kernel/mutex.h>
+#include <kernel/thread.h>
+#include <kernel/interrupts.h>
+#include <kernel/unit_tests.h>
+#include <arch/common_op.h>
+#include <string.h>
+#include <stdio.h>
+
+/*
+** The owner of a mutex is protected by it's own lock, so an uncontended
+** mutex never takes the thread lock. The thread lock is only taken to go
+** to sleep or to wake up a sleeper, always before the lock of the mutex.
+**
+** A thread going to sleep registers itself as a waiter while holding the
+** thread lock, so the thread releasing the mutex can't wake it up before
+** it's actually asleep.
+*/
+
+extern struct spinlock thread_table_lock;
+
+void
+mutex_init(struct mutex *m)
+{
+	memset(m, 0, sizeof(*m));
+	init_lock(&m->lock);
+	wait_queue_init(&m->waiters);
+}
+
+bool
+holding_mutex(struct mutex *m)
+{
+	return (m->owner == get_current_thread());
+}
+
+/*
+** Gives the given mutex to the given thread if it's free.
+** The lock of the mutex must be held.
+*/
+static bool
+mutex_try_take(struct mutex *m, struct thread *t)
+{
+	assert(holding_lock(&m->lock));
+	if (m->owner != NULL) {
+		return (false);
+	}
+	m->owner = t;
+	m->depth = 1;
+#ifdef ENABLE_LOCK_STATS
+	m->stats.nb_acquires++;
+	m->hold_start = read_cycle_counter();
+#endif /* ENABLE_LOCK_STATS */
+	return (true);
+}
+
+/*
+** Sleeps until the given mutex is given to the given thread.
+*/
+static void
+mutex_lock_slow(struct mutex *m, struct thread *t)
+{
+	bool taken;
+
+	LOCK_THREAD(state);
+	/* Sleeping with an other spinlock held would deadlock */
+	assert_eq(thread_table_lock.depth, 1);
+	do {
+		LOCK(&m->lock, state2);
+		taken = mutex_try_take(m, t);
+		m->nb_waiters += !taken;
+		RELEASE(&m->lock, state2);
+		if (!taken) {
+			wait_queue_sleep(&m->waiters);
+		}
+	} while (!taken);
+	RELEASE_THREAD(state);
+}
+
+/*
+** Takes the given mutex, sleeping until it's available.
+*/
+void
+mutex_lock(struct mutex *m)
+{
+	struct thread *t;
+	bool taken;
+
+	t = get_current_thread();
+	LOCK(&m->lock, state);
+	if (m->owner == t) {
+		m->depth++;
+		taken = true;
+	} else {
+		taken = mutex_try_take(m, t);
+#ifdef ENABLE_LOCK_STATS
+		m->stats.nb_contended += !taken;
+#endif /* ENABLE_LOCK_STATS */
+	}
+	RELEASE(&m->lock, state);
+	if (!taken) {
+		mutex_lock_slow(m, t);
+	}
+}
+
+/*
+** Releases the given mutex, waking up the thread that waited for it the
+** longest.
+*/
+void
+mutex_unlock(struct mutex *m)
+{
+	bool wake;
+#ifdef ENABLE_LOCK_STATS
+	uint64 hold;
+#endif /* ENABLE_LOCK_STATS */
+
+	wake = false;
+	LOCK(&m->lock, state);
+	assert(holding_mutex(m));
+	m->depth--;
+	if (!m->depth) {
+#ifdef ENABLE_LOCK_STATS
+		hold = read_cycle_counter() - m->hold_start;
+		if (hold > m->stats.max_hold) {
+			m->stats.max_hold = hold > (uint32)-1 ? (uint32)-1 : (uint32)hold;
+		}
+#endif /* ENABLE_LOCK_STATS */
+		m->owner = NULL;
+		if (m->nb_waiters) {
+			m->nb_waiters--;
+			wake = true;
+		}
+	}
+	RELEASE(&m->lock, state);
+	if (wake) {
+		wait_queue_wake_one(&m->waiters);
+	}
+}
+
+#ifdef ENABLE_LOCK_STATS
+
+void
+mutex_dump_stats(char const *name, struct mutex *m)
+{
+	struct spinlock_stats s;
+
+	LOCK(&m->lock, state);
+	s = m->stats;
+	RELEASE(&m->lock, state);
+	printf("%s mutex: %u acquisitions, %u contended, max hold %u cycles\n",
+		name,
+		s.nb_acquires,
+		s.nb_contended,
+		s.max_hold
+	);
+}
+
+#endif /* ENABLE_LOCK_STATS */
+
+static int __init
+mutex_test_main(void)
+{
+	struct mutex *m;
+
+	m = kthread_data();
+	mutex_lock(m);
+	assert(holding_mutex(m));
+	mutex_unlock(m);
+	return (0);
+}
+
+/*
+** Mutex tests, with a second thread of the current processor for the
+** contended case.
+*/
+static void __init
+mutex_test(void)
+{
+	struct thread *t;
+	struct mutex m;
+	int_state_t int_state;
+
+	mutex_init(&m);
+	assert(!holding_mutex(&m));
+
+	mutex_lock(&m);
+	assert(holding_mutex(&m));
+
+	/* Recursion */
+	mutex_lock(&m);
+	assert_eq(m.depth, 2);
+	mutex_unlock(&m);
+	assert(holding_mutex(&m));
+
+	/* The second thread sleeps until the mutex is released */
+	t = kthread_create("mutex-test", &mutex_test_main, &m);
+	assert_neq(t, NULL);
+	assert_eq(thread_set_affinity(t, CPUMASK_CPU(current_cpu()->id)), OK);
+	while (m.nb_waiters == 0) {
+		thread_yield();
+	}
+
+	mutex_unlock(&m);
+	assert(!holding_mutex(&m));
+	assert_eq(m.nb_waiters, 0);
+
+	/* thread_waitpid() expects interrupts to be enabled */
+	arch_push_interrupts(&int_state);
+	arch_enable_interrupts();
+	assert_eq(thread_waitpid(t->pid), 0);
+	arch_pop_interrupts(&int_state);
+	assert_eq(m.owner, NULL);
+}
+
+NEW_UNIT_TEST(mutex, &mutex_test, UNIT_TEST_LEVEL_MUTEX);
@@ -0,0 +1,206 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#include <kernel/pid.h>
+#include <kernel/thread.h>
+#include <kernel/unit_tests.h>
+#include <kernel/interrupts.h>
+#include <debug.h>
+
+/*
+** Pid allocator and pid to thread lookup.
+**
+** Pids are allocated from a three-level bitmap: a bit of the leaves is set
+** when the pid is taken, a bit of the middle level when the corresponding
+** leaf is full, and a bit of the top word when the corresponding middle
+** word is full. Finding the lowest free pid is then three
+** count-trailing-zeros, and freeing one is three bit clears.
+**
+** Threads are found by pid through a hash table, indexed by the low bits
+** of the pid.
+**
+** Everything is protected by the pid lock, which is only held for these
+** short operations. A thread returned by thread_lookup() must be kept
+** alive by the caller, as it may exit as soon as the lock is released.
+*/
+
+# define WORD_BITS	(32u)
+
+static_assert(MAX_PID % (WORD_BITS * WORD_BITS) == 0);
+static_assert(MAX_PID / (WORD_BITS * WORD_BITS) <= WORD_BITS);
+
+static uint32 pid_leaves[MAX_PID / WORD_BITS];
+static uint32 pid_middle[MAX_PID / (WORD_BITS * WORD_BITS)];
+
+/* The bits that don't match a middle word are marked as full */
+static uint32 pid_top = (uint32)~((1ull << (MAX_PID / (WORD_BITS * WORD_BITS))) - 1u);
+
+struct list_node pid_hash[PID_HASH_SIZE];
+struct spinlock pid_lock;
+
+/*
+** Returns the index of the first cleared bit of the given word, which
+** must not be full.
+*/
+static inline uint
+first_zero(uint32 word)
+{
+	return (__builtin_ctz(~word));
+}
+
+/*
+** Allocates the lowest available pid.
+** Returns -1 if there is none left.
+*/
+pid_t
+pid_alloc(void)
+{
+	uint top;
+	uint leaf;
+	uint bit;
+
+	LOCK_PID(state);
+	if (pid_top == (uint32)-1) {
+		RELEASE_PID(state);
+		return (-1);
+	}
+	top = first_zero(pid_top);
+	leaf = top * WORD_BITS + first_zero(pid_middle[top]);
+	bit = first_zero(pid_leaves[leaf]);
+
+	pid_leaves[leaf] |= 1u << bit;
+	if (pid_leaves[leaf] == (uint32)-1) {
+		pid_middle[top] |= 1u << (leaf % WORD_BITS);
+		if (pid_middle[top] == (uint32)-1) {
+			pid_top |= 1u << top;
+		}
+	}
+	RELEASE_PID(state);
+	return (leaf * WORD_BITS + bit);
+}
+
+/*
+** Gives back the given pid.
+*/
+void
+pid_free(pid_t pid)
+{
+	uint leaf;
+
+	assert(pid >= 0 && pid < MAX_PID);
+	leaf = pid / WORD_BITS;
+
+	LOCK_PID(state);
+	assert(pid_leaves[leaf] & (1u << (pid % WORD_BITS)));
+	pid_leaves[leaf] &= ~(1u << (pid % WORD_BITS));
+	pid_middle[leaf / WORD_BITS] &= ~(1u << (leaf % WORD_BITS));
+	pid_top &= ~(1u << (leaf / WORD_BITS));
+	RELEASE_PID(state);
+}
+
+static inline struct list_node *
+pid_bucket(pid_t pid)
+{
+	return (pid_hash + ((uint)pid & (PID_HASH_SIZE - 1)));
+}
+
+/*
+** Makes the given thread reachable through thread_lookup().
+*/
+void
+pid_hash_add(struct thread *t)
+{
+	LOCK_PID(state);
+	list_add(&t->pid_node, pid_bucket(t->pid));
+	RELEASE_PID(state);
+}
+
+void
+pid_hash_remove(struct thread *t)
+{
+	LOCK_PID(state);
+	list_delete(&t->pid_node);
+	RELEASE_PID(state);
+}
+
+/*
+** Returns the thread with the given pid, or NULL if there is none.
+** The pid lock must be held.
+*/
+struct thread *
+thread_lookup(pid_t pid)
+{
+	struct thread *t;
+
+	assert(holding_lock(&pid_lock));
+	if (pid < 0 || pid >= MAX_PID) {
+		return (NULL);
+	}
+	list_foreach_content(t, pid_bucket(pid), pid_node) {
+		if (t->pid == pid) {
+			return (t);
+		}
+	}
+	return (NULL);
+}
+
+/*
+** Pid allocator tests. The allocator must be in the state it's left in
+** by the boot.
+*/
+static void __init
+pid_test(void)
+{
+	pid_t first;
+	pid_t pid;
+
+	LOCK_PID(state);
+
+	/* The lowest free pid is always returned */
+	first = pid_alloc();
+	assert_neq(first, -1);
+	pid = pid_alloc();
+	assert_eq(pid, first + 1);
+	pid_free(first);
+	assert_eq(pid_alloc(), first);
+	pid_free(first);
+	pid_free(pid);
+
+	/* Fill the first middle word, so the top level is used */
+	for (pid = first; pid < (pid_t)(WORD_BITS * WORD_BITS); ++pid) {
+		assert_eq(pid_alloc(), pid);
+	}
+	assert(pid_top & 1u);
+	pid_free(first + 42);
+	assert(!(pid_top & 1u));
+	assert_eq(pid_alloc(), first + 42);
+	for (pid = first; pid < (pid_t)(WORD_BITS * WORD_BITS); ++pid) {
+		pid_free(pid);
+	}
+	assert_eq(pid_alloc(), first);
+	pid_free(first);
+
+	RELEASE_PID(state);
+}
+
+/*
+** Initializes the pid hash table.
+*/
+void __init
+pid_init(void)
+{
+	size_t i;
+
+	init_lock(&pid_lock);
+	for (i = 0; i < PID_HASH_SIZE; ++i) {
+		LIST_INIT_HEAD(pid_hash + i);
+	}
+}
+
+NEW_UNIT_TEST(pid, &pid_test, UNIT_TEST_LEVEL_PID);
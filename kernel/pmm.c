@@ -9,8 +9,11 @@
 
 #include <kernel/init.h>
 #include <kernel/pmm.h>
+#include <kernel/shrinker.h>
 #include <kernel/unit_tests.h>
 #include <kernel/multiboot.h>
+#include <kernel/spinlock.h>
+#include <kernel/interrupts.h>
 #include <string.h>
 #include <stdio.h>
 
@@ -19,13 +22,22 @@
 ** frames are free and which ones are not.
 **
 ** It can definitely be optimised, but that's not the point at this moment.
+**
+** The bitmap, next_frame and free_frames are protected by the pmm lock, as
+** frames are allocated and freed by all processors. It is never held while
+** the caches are shrunk.
 */
 
 uchar					frame_bitmap[FRAME_BITMAP_SIZE];
 static size_t				next_frame;
 
+/* Number of free frames, maintained once the allocator is initialized */
+static size_t				free_frames;
+
+static struct spinlock			pmm_lock;
+
 /*
-** Allocates a new frame and returns it, or NULL_FRAME if there is no physical
+** Looks for a free frame and returns it, or NULL_FRAME if there is no physical
 ** memory left.
 **
 ** The idea is that next_frame contains the index in frame_bitmap of our first
@@ -35,14 +47,15 @@ static size_t				next_frame;
 ** free frame was found, then NULL_FRAME is returned. In the other case,
 ** it also sets next_frame to the index of the following address.
 */
-phys_addr_t
-alloc_frame(void)
+static phys_addr_t
+find_free_frame(void)
 {
 	size_t i;
 	size_t j;
 	size_t final;
 	bool pass;
 
+	assert(holding_lock(&pmm_lock));
 	i = next_frame;
 	final = FRAME_BITMAP_SIZE;
 	pass = false;
@@ -70,6 +83,47 @@ look_for_address:
 	return (NULL_FRAME);
 }
 
+/*
+** Takes a free frame, without shrinking anything.
+** Returns NULL_FRAME if there is no physical memory left.
+*/
+static phys_addr_t
+take_free_frame(void)
+{
+	phys_addr_t frame;
+
+	LOCK(&pmm_lock, state);
+	frame = find_free_frame();
+	if (frame != NULL_FRAME) {
+		free_frames--;
+	}
+	RELEASE(&pmm_lock, state);
+	return (frame);
+}
+
+/*
+** Allocates a new frame and returns it, or NULL_FRAME if there is no physical
+** memory left.
+**
+** If the memory is full, the caches are shrunk until a frame is available
+** or nothing can be reclaimed anymore. The reclaim thread is woken up
+** if the amount of free memory is getting low.
+*/
+phys_addr_t
+alloc_frame(void)
+{
+	phys_addr_t frame;
+
+	frame = take_free_frame();
+	while (unlikely(frame == NULL_FRAME) && shrink_caches(RECLAIM_BATCH) != 0) {
+		frame = take_free_frame();
+	}
+	if (unlikely(free_frames < RECLAIM_LOW_WATERMARK)) {
+		reclaim_wakeup();
+	}
+	return (frame);
+}
+
 /*
 ** Frees a given frame.
 */
@@ -79,12 +133,17 @@ free_frame(phys_addr_t frame)
 	/* Ensure the address is page-aligned */
 	assert(IS_PAGE_ALIGNED(frame));
 
+	LOCK(&pmm_lock, state);
+
 	/* Ensure the given physical address is taken */
 	assert(is_frame_allocated(frame));
 
 	/* Set the bit corresponding to this frame to 0 */
 	frame_bitmap[GET_FRAME_IDX(frame)] &= ~(GET_FRAME_MASK(frame));
 	next_frame = GET_FRAME_IDX(frame);
+	free_frames++;
+
+	RELEASE(&pmm_lock, state);
 }
 
 /*
@@ -121,10 +180,10 @@ mark_range_as_free(phys_addr_t start, phys_addr_t end)
 }
 
 /*
-** Calculates the amount of free frames
+** Calculates the amount of free frames by going through the whole bitmap.
 */
-size_t
-nb_free_frames(void)
+static size_t
+count_free_frames(void)
 {
 	size_t i;
 	size_t nb;
@@ -148,14 +207,25 @@ nb_free_frames(void)
 	return (nb);
 }
 
+/*
+** Returns the amount of free frames.
+*/
+size_t
+nb_free_frames(void)
+{
+	return (free_frames);
+}
+
 /*
 ** Initializes the frame allocator.
 */
-static void
+static void __init
 pmm_init(enum init_level il __unused)
 {
 	multiboot_memory_map_t *mmap;
 
+	init_lock(&pmm_lock);
+
 	/* Trigger pmm unit tests before anything else */
 	trigger_unit_tests(UNIT_TEST_LEVEL_PMM);
 
@@ -186,6 +256,8 @@ pmm_init(enum init_level il __unused)
 		mark_range_as_allocated(multiboot_infos.initrd.pstart, multiboot_infos.initrd.pend);
 	}
 
+	free_frames = count_free_frames();
+
 	printf("[OK]\tPhysical Memory Managment (Size: %r)\n", (multiboot_infos.mem_stop - multiboot_infos.mem_start) * 1024u);
 }
 
@@ -193,7 +265,7 @@ pmm_init(enum init_level il __unused)
 ** Some unit tests for the frame allocator.
 ** These tests completely scratch the allocator.
 */
-static void
+static void __init
 pmm_test(void)
 {
 	/* Mark everything as free for the unit tests (will be reversed after) */
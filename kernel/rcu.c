@@ -0,0 +1,131 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#include <kernel/rcu.h>
+#include <kernel/cpu.h>
+#include <kernel/list.h>
+#include <kernel/thread.h>
+#include <kernel/unit_tests.h>
+#include <arch/common_op.h>
+#include <debug.h>
+
+/*
+** Each processor counts it's quiescent states, and flags itself while
+** it's idle thread waits for an interrupt.
+**
+** A grace period is over once each other processor counted a quiescent
+** state, or was seen idle. The current processor is quiescent by
+** definition, as it runs the writer.
+**
+** The counter is incremented with a locked instruction, so the reads of
+** the next read-side section can't be done before it is visible.
+*/
+
+/*
+** Notes a quiescent state of the current processor.
+** Called on context switches and timer ticks, with interrupts disabled.
+*/
+void
+rcu_note_qs(void)
+{
+	atomic_add(&current_cpu()->rcu_qs, 1);
+}
+
+/*
+** Called by the idle thread around the wait for an interrupt.
+*/
+void
+rcu_idle_enter(void)
+{
+	barrier();
+	current_cpu()->rcu_idle = true;
+}
+
+void
+rcu_idle_exit(void)
+{
+	atomic_exchange(&current_cpu()->rcu_idle, false);
+}
+
+/*
+** Waits until all the read-side sections that were running when it was
+** called are over.
+** Sleeps if an other processor is busy, so interrupts must be enabled
+** then.
+*/
+void
+synchronize_rcu(void)
+{
+	int snap[MAX_CPUS];
+	struct cpu *cpu;
+	uint self;
+
+	/* Pinned to the current processor while taking the snapshot */
+	RCU_READ_LOCK(state);
+	memory_fence();
+	self = current_cpu()->id;
+	for (cpu = cpus; cpu < cpus + nb_cpus; ++cpu) {
+		snap[cpu->id] = cpu->rcu_qs;
+	}
+	RCU_READ_UNLOCK(state);
+
+	for (cpu = cpus; cpu < cpus + nb_cpus; ++cpu)
+	{
+		if (cpu->id == self || !cpu->online) {
+			continue;
+		}
+		while (cpu->rcu_qs == snap[cpu->id] && !cpu->rcu_idle) {
+			assert(arch_are_int_enabled());
+			thread_yield();
+		}
+	}
+	memory_fence();
+}
+
+/*
+** RCU tests, on a single processor.
+*/
+static void __init
+rcu_test(void)
+{
+	struct list_node head;
+	struct list_node a;
+	struct list_node b;
+	struct list_node *pos;
+	int qs;
+	uint n;
+
+	/* Readers run with interrupts disabled */
+	RCU_READ_LOCK(state);
+	assert(!arch_are_int_enabled());
+	qs = current_cpu()->rcu_qs;
+	rcu_note_qs();
+	assert_eq(current_cpu()->rcu_qs, qs + 1);
+	RCU_READ_UNLOCK(state);
+
+	/* Publication and removal */
+	LIST_INIT_HEAD(&head);
+	list_add_rcu(&a, &head);
+	list_add_rcu(&b, &head);
+	n = 0;
+	list_foreach(pos, &head) {
+		++n;
+	}
+	assert_eq(n, 2);
+	assert_eq(head.next, &b);
+
+	list_delete_rcu(&b);
+	assert_eq(head.next, &a);
+	assert_eq(b.next, &a); /* A reader on it can go on */
+	synchronize_rcu();
+	list_delete_rcu(&a);
+	assert(list_empty(&head));
+}
+
+NEW_UNIT_TEST(rcu, &rcu_test, UNIT_TEST_LEVEL_RCU);
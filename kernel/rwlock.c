@@ -0,0 +1,120 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#include <kernel/rwlock.h>
+#include <kernel/interrupts.h>
+#include <kernel/unit_tests.h>
+#include <arch/common_op.h>
+#include <debug.h>
+
+void
+rwlock_init(struct rwlock *rw)
+{
+	rw->readers = 0;
+	rw->writer = false;
+	init_lock(&rw->lock);
+}
+
+bool
+holding_write_lock(struct rwlock *rw)
+{
+	return (holding_lock(&rw->lock));
+}
+
+/*
+** Takes the given lock for reading, spinning while a writer holds it or
+** waits for it.
+** Interrupts must be disabled.
+**
+** The reader announces itself before checking for a writer, and the
+** writer does the opposite, so at least one of them sees the other.
+** The locked instructions are full barriers.
+*/
+void
+read_lock(struct rwlock *rw)
+{
+	while (true)
+	{
+		while (rw->writer) {
+			pause();
+		}
+		atomic_add(&rw->readers, 1);
+		if (!rw->writer) {
+			break;
+		}
+		atomic_add(&rw->readers, -1);
+	}
+	barrier();
+}
+
+void
+read_unlock(struct rwlock *rw)
+{
+	int old;
+
+	barrier();
+	old = atomic_add(&rw->readers, -1);
+	assert_neq(old, 0);
+}
+
+/*
+** Takes the given lock for writing, waiting for the current readers to
+** leave.
+** Interrupts must be disabled.
+*/
+void
+write_lock(struct rwlock *rw)
+{
+	assert(!holding_write_lock(rw));
+	acquire_lock(&rw->lock);
+	atomic_exchange(&rw->writer, true);
+	while (rw->readers) {
+		pause();
+	}
+	barrier();
+}
+
+void
+write_unlock(struct rwlock *rw)
+{
+	assert(holding_write_lock(rw));
+	barrier();
+	rw->writer = false;
+	release_lock(&rw->lock);
+}
+
+/*
+** Reader-writer lock tests, on a single processor.
+*/
+static void __init
+rwlock_test(void)
+{
+	struct rwlock rw;
+
+	rwlock_init(&rw);
+
+	/* Readers share the lock */
+	LOCK_READ(&rw, state);
+	read_lock(&rw);
+	assert_eq(rw.readers, 2);
+	assert(!holding_write_lock(&rw));
+	read_unlock(&rw);
+	RELEASE_READ(&rw, state);
+	assert_eq(rw.readers, 0);
+
+	/* Writers don't */
+	LOCK_WRITE(&rw, state2);
+	assert(holding_write_lock(&rw));
+	assert(rw.writer);
+	RELEASE_WRITE(&rw, state2);
+	assert(!rw.writer);
+	assert(!holding_write_lock(&rw));
+}
+
+NEW_UNIT_TEST(rwlock, &rwlock_test, UNIT_TEST_LEVEL_RWLOCK);
@@ -10,93 +10,1079 @@
 #include <kernel/spinlock.h>
 #include <kernel/thread.h>
 #include <kernel/interrupts.h>
+#include <kernel/init.h>
+#include <kernel/timer.h>
+#include <kernel/cpu.h>
+#include <kernel/rcu.h>
+#include <kernel/kalloc.h>
+#include <kernel/benchmark.h>
+#include <arch/common_op.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
 #include <debug.h>
 
-extern struct thread thread_table[MAX_PID];
-extern struct thread *init_thread;
 extern struct spinlock thread_table_lock;
 
 /*
-** Looks for the next runnable thread.
+** Multi-level feedback queue scheduler.
+**
+** Runnable threads are kept in one run queue per priority level, level 0
+** being the most important one. The next thread to run is the head of the
+** first non-empty level.
+**
+** A thread using all of it's quantum is demoted to the next level, where
+** the quantum is longer. A thread waking up from a sleep is boosted back to
+** it's base level, so interactive threads (waiting for I/O most of the time)
+** stay at the top. The base level of a thread is given by it's niceness.
+**
+** Every SCHED_BOOST_PERIOD ticks, all threads are boosted back to their
+** base level so the CPU-bound ones can't starve.
+**
+** Each processor has it's own set of run queues. A waking thread goes back
+** to the processor it last ran on, unless an other one is idle or much less
+** loaded. Threads are moved between processors by:
+**   - An idle processor, stealing work from the busiest one.
+**   - Each processor, every SCHED_BALANCE_PERIOD ticks, pulling a thread
+**     from the busiest one if it's significantly busier.
+** A thread only ever runs on the processors of it's affinity mask.
+**
+** Each processor also has it's own idle thread, which isn't part of the run
+** queues: it only runs when they are all empty.
+**
+** Each run queue has it's own lock, so processors only contend when they
+** move threads between each other. The 'cpu' field of a thread only
+** changes while the lock of the run queue it designates is held, which is
+** what lock_thread_rq() relies on.
+**
+** The lock of the run queue of a processor is held across it's context
+** switches, and released by the incoming thread. Taking the lock of the
+** run queue of a thread that stopped running thus waits until it's
+** switched out, which is how a thread going to sleep is kept from being
+** woken up on an other processor while it still runs on it's stack.
+** The thread lock may be held when taking a run queue lock, never the
+** other way around.
+*/
+
+struct run_queue
+{
+	struct spinlock lock;
+
+	/* Runnable threads, in the order they will be executed, for each level */
+	struct list_node levels[SCHED_NB_LEVELS];
+
+	/* Number of threads in the levels. The running thread isn't counted */
+	uint nb_threads;
+
+	uint nb_migrations;
+	uint ticks;
+
+	/* Thread switched out by the last context switch */
+	struct thread *prev;
+
+	struct sched_stats stats[SCHED_NB_LEVELS];
+} __aligned(CACHE_LINE_SIZE);
+
+static struct run_queue run_queues[MAX_CPUS];
+
+static uint sched_ticks;
+
+/*
+** Returns the quantum of the given level, in timer ticks.
+** It doubles at each level.
+*/
+static inline uint
+level_quantum(uint level)
+{
+	return (1u << level);
+}
+
+/*
+** Returns the level a thread with the given niceness starts at.
+*/
+static inline uint
+base_level(int nice)
+{
+	return ((uint)nice * SCHED_NB_LEVELS / (SCHED_NICE_MAX + 1));
+}
+
+/*
+** Moves the given thread back to it's base level, with a full quantum.
+*/
+static void
+sched_reset(struct thread *t)
+{
+	t->sched_level = base_level(t->nice);
+	t->quantum = level_quantum(t->sched_level);
+}
+
+static inline bool
+cpu_allowed(struct thread const *t, struct cpu const *cpu)
+{
+	return ((t->affinity & CPUMASK_CPU(cpu->id)) != 0);
+}
+
+static inline bool
+cpu_is_idle(struct cpu const *cpu)
+{
+	return (cpu->current_thread == cpu->idle_thread && run_queues[cpu->id].nb_threads == 0);
+}
+
+/*
+** Returns the number of threads competing for the given processor.
+*/
+static inline uint
+cpu_load(struct cpu const *cpu)
+{
+	return (run_queues[cpu->id].nb_threads + (cpu->current_thread != cpu->idle_thread));
+}
+
+static bool
+is_idle_thread(struct thread *t)
+{
+	struct cpu *cpu;
+
+	for (cpu = cpus; cpu < cpus + nb_cpus; ++cpu) {
+		if (cpu->idle_thread == t) {
+			return (true);
+		}
+	}
+	return (false);
+}
+
+/*
+** Returns true if the given thread is in a run queue.
+*/
+static inline bool
+queued(struct thread const *t)
+{
+	return (t->state == RUNNABLE && t->rq_node.next != NULL);
+}
+
+/*
+** Locks and returns the run queue the given thread is assigned to.
+** Interrupts must be disabled.
+*/
+static struct run_queue *
+lock_thread_rq(struct thread *t)
+{
+	struct run_queue *rq;
+
+	assert(!arch_are_int_enabled());
+	while (42)
+	{
+		rq = run_queues + t->cpu;
+		acquire_lock(&rq->lock);
+		if (rq == run_queues + t->cpu) {
+			return (rq);
+		}
+		release_lock(&rq->lock);
+	}
+}
+
+/*
+** Chooses the processor a waking thread is queued on.
+**
+** The processor it last ran on is preferred, as it's cache may still be
+** warm, unless it's busy while an other one is idle, or it's more than
+** one thread more loaded than the least loaded one.
+*/
+static struct cpu *
+select_cpu(struct thread *t)
+{
+	struct cpu *last;
+	struct cpu *best;
+	struct cpu *cpu;
+
+	last = cpus + t->cpu;
+	if (last->online && cpu_allowed(t, last) && cpu_is_idle(last)) {
+		return (last);
+	}
+
+	best = NULL;
+	for (cpu = cpus; cpu < cpus + nb_cpus; ++cpu)
+	{
+		if (!cpu->online || !cpu_allowed(t, cpu)) {
+			continue;
+		}
+		if (cpu_is_idle(cpu)) {
+			return (cpu);
+		}
+		if (best == NULL || cpu_load(cpu) < cpu_load(best)) {
+			best = cpu;
+		}
+	}
+
+	/* No processor is allowed and online yet, the thread waits for one */
+	if (best == NULL) {
+		return (cpu_allowed(t, last) ? last : cpus + __builtin_ctz(t->affinity));
+	}
+
+	if (last->online && cpu_allowed(t, last) && cpu_load(last) <= cpu_load(best) + 1) {
+		return (last);
+	}
+	return (best);
+}
+
+/*
+** Removes the given runnable thread from it's run queue.
+*/
+static void
+rq_remove(struct thread *t)
+{
+	assert(holding_lock(&run_queues[t->cpu].lock));
+	list_delete(&t->rq_node);
+	run_queues[t->cpu].nb_threads--;
+}
+
+/*
+** Marks the given thread as runnable and adds it at the end of the
+** run queue of it's level, on the processor it's assigned to.
+** If that processor is idle, it's woken up.
+** The lock of that run queue must be held.
+*/
+static void
+sched_enqueue(struct thread *t)
+{
+	struct run_queue *rq;
+	struct cpu *cpu;
+
+	rq = run_queues + t->cpu;
+	assert(holding_lock(&rq->lock));
+	assert_lo(t->sched_level, SCHED_NB_LEVELS);
+	t->state = RUNNABLE;
+	t->enqueue_time = read_cycle_counter();
+	list_add_tail(&t->rq_node, rq->levels + t->sched_level);
+	rq->nb_threads++;
+
+	cpu = cpus + t->cpu;
+	if (cpu != current_cpu() && cpu->current_thread == cpu->idle_thread) {
+		arch_cpu_kick(cpu);
+	}
+}
+
+/*
+** Same as sched_enqueue(), but the thread starts from it's base level, and
+** may be queued on an other processor than the one it last ran on.
+** Used for new and woken-up threads.
+**
+** If the thread is still being switched out of it's processor (it just
+** went to sleep), this waits for the switch to be over.
+*/
+void
+sched_enqueue_new(struct thread *t)
+{
+	struct run_queue *rq;
+	int_state_t state;
+	uint cpu;
+
+	arch_push_interrupts(&state);
+	arch_disable_interrupts();
+	rq = lock_thread_rq(t);
+	sched_reset(t);
+	cpu = select_cpu(t)->id;
+	if (cpu != t->cpu) {
+		t->cpu = cpu;
+		release_lock(&rq->lock);
+		rq = run_queues + cpu;
+		acquire_lock(&rq->lock);
+		rq->nb_migrations++;
+	}
+	sched_enqueue(t);
+	release_lock(&rq->lock);
+	arch_pop_interrupts(&state);
+}
+
+/*
+** Waits until the given thread, which stopped running, is switched out of
+** it's processor, so it's kernel stack can be freed.
+*/
+void
+sched_wait_switched_out(struct thread *t)
+{
+	struct run_queue *rq;
+	int_state_t state;
+
+	arch_push_interrupts(&state);
+	arch_disable_interrupts();
+	rq = lock_thread_rq(t);
+	release_lock(&rq->lock);
+	arch_pop_interrupts(&state);
+}
+
+/*
+** Returns the index of the first non-empty level of the given run queue,
+** or SCHED_NB_LEVELS if all of them are empty.
+*/
+static uint
+first_runnable_level(struct run_queue *rq)
+{
+	uint level;
+
+	level = 0;
+	while (level < SCHED_NB_LEVELS && list_empty(rq->levels + level)) {
+		++level;
+	}
+	return (level);
+}
+
+/*
+** Updates the statistics of the given level with the time the given thread
+** spent waiting in it's run queue.
+*/
+static void
+update_stats(struct sched_stats *s, struct thread *t)
+{
+	uint64 wait;
+	uint32 cycles;
+
+	wait = read_cycle_counter() - t->enqueue_time;
+	cycles = wait > UINT_MAX ? UINT_MAX : (uint32)wait;
+	s->nb_picks++;
+	s->avg_wait = s->avg_wait - s->avg_wait / 8u + cycles / 8u;
+	s->max_wait = cycles > s->max_wait ? cycles : s->max_wait;
+}
+
+/*
+** Looks for a thread of the given run queue that may run on the given
+** processor, starting with the ones that will run last (their cache is
+** the coldest).
 */
 static struct thread *
-find_next_thread(void)
+find_stealable(struct run_queue *rq, struct cpu *thief)
+{
+	struct list_node *node;
+	struct thread *t;
+	uint level;
+
+	level = SCHED_NB_LEVELS;
+	while (level-- > 0)
+	{
+		node = rq->levels[level].prev;
+		while (node != rq->levels + level)
+		{
+			t = get_content(node, struct thread, rq_node);
+			if (cpu_allowed(t, thief)) {
+				return (t);
+			}
+			node = node->prev;
+		}
+	}
+	return (NULL);
+}
+
+/*
+** Moves a thread from the busiest processor to the given one.
+** The busiest processor must have at least 'min_imbalance' threads more
+** than the given one.
+** Returns true if a thread was moved.
+**
+** The lock of the run queue of the given processor must be held. The
+** busiest one is only tried, as waiting for it while holding our own could
+** deadlock with a processor doing the same the other way around.
+*/
+static bool
+pull_thread(struct cpu *self, uint min_imbalance)
 {
-	bool pass;
-	struct thread *limit;
+	struct run_queue *rq;
+	struct cpu *busiest;
+	struct cpu *cpu;
 	struct thread *t;
 
-	pass = false;
-	t = get_current_thread() + 1;
-	limit = thread_table + MAX_PID;
+	assert(holding_lock(&run_queues[self->id].lock));
 
-look_for_next:
-	while (t < limit)
+	busiest = NULL;
+	for (cpu = cpus; cpu < cpus + nb_cpus; ++cpu)
 	{
-		if (t->state == RUNNABLE) {
-			return (t);
+		if (cpu == self || run_queues[cpu->id].nb_threads == 0) {
+			continue;
+		}
+		if (busiest == NULL || cpu_load(cpu) > cpu_load(busiest)) {
+			busiest = cpu;
 		}
-		t++;
 	}
-	if (!pass)
+	if (busiest == NULL || cpu_load(busiest) < cpu_load(self) + min_imbalance) {
+		return (false);
+	}
+
+	rq = run_queues + busiest->id;
+	if (!try_acquire_lock(&rq->lock)) {
+		return (false);
+	}
+	t = find_stealable(rq, self);
+	if (t != NULL) {
+		rq_remove(t);
+		t->cpu = self->id;
+		list_add_tail(&t->rq_node, run_queues[self->id].levels + t->sched_level);
+		run_queues[self->id].nb_threads++;
+		run_queues[self->id].nb_migrations++;
+	}
+	release_lock(&rq->lock);
+	return (t != NULL);
+}
+
+/*
+** Pops the next runnable thread from the run queues of the current
+** processor, stealing one from an other processor if they are empty.
+** The lock of the run queue of the current processor must be held.
+** Returns the idle thread of the current processor if there is none (or
+** the current thread, if the idle thread doesn't exist yet).
+*/
+static struct thread *
+find_next_thread(void)
+{
+	struct run_queue *rq;
+	struct thread *t;
+	struct thread *idle;
+	struct cpu *self;
+	uint level;
+
+	self = current_cpu();
+	rq = run_queues + self->id;
+	level = first_runnable_level(rq);
+	if (level == SCHED_NB_LEVELS && pull_thread(self, 1)) {
+		level = first_runnable_level(rq);
+	}
+	if (level == SCHED_NB_LEVELS) {
+		idle = self->idle_thread;
+		return (idle ? idle : get_current_thread());
+	}
+	t = get_content(rq->levels[level].next, struct thread, rq_node);
+	rq_remove(t);
+	update_stats(rq->stats + level, t);
+	return (t);
+}
+
+/*
+** Boosts all threads back to their base level.
+** The time they entered the run queue is kept, for the statistics.
+** The run queues are locked one at a time.
+*/
+static void
+sched_boost(void)
+{
+	struct list_node requeue;
+	struct run_queue *rq;
+	struct thread *t;
+	struct cpu *cpu;
+	uint level;
+
+	for (cpu = cpus; cpu < cpus + nb_cpus; ++cpu)
 	{
-		t = thread_table;
-		limit = get_current_thread() + 1;
-		pass = true;
-		goto look_for_next;
+		rq = run_queues + cpu->id;
+		LOCK(&rq->lock, state);
+		for (level = 1; level < SCHED_NB_LEVELS; ++level)
+		{
+			LIST_INIT_HEAD(&requeue);
+			list_zip(rq->levels + level, &requeue);
+			LIST_INIT_HEAD(rq->levels + level);
+			while (!list_empty(&requeue))
+			{
+				t = get_content(requeue.next, struct thread, rq_node);
+				list_delete(&t->rq_node);
+				sched_reset(t);
+				list_add_tail(&t->rq_node, rq->levels + t->sched_level);
+			}
+		}
+		if (cpu->current_thread && cpu->current_thread != cpu->idle_thread) {
+			sched_reset(cpu->current_thread);
+		}
+		RELEASE(&rq->lock, state);
+	}
+}
+
+/*
+** Sets the niceness of the given thread, between 0 and SCHED_NICE_MAX.
+** The higher it is, the lower the priority of the thread.
+*/
+status_t
+thread_set_nice(struct thread *t, int nice)
+{
+	struct run_queue *rq;
+	int_state_t state;
+
+	if (nice < 0 || nice > SCHED_NICE_MAX) {
+		return (ERR_INVALID_ARGS);
+	}
+
+	arch_push_interrupts(&state);
+	arch_disable_interrupts();
+	rq = lock_thread_rq(t);
+	t->nice = nice;
+	sched_reset(t);
+	if (queued(t)) {
+		rq_remove(t);
+		sched_enqueue(t);
 	}
-	return (get_current_thread());
+	release_lock(&rq->lock);
+	arch_pop_interrupts(&state);
+	return (OK);
+}
+
+/*
+** Restricts the given thread to the given set of processors.
+** Processors that don't exist are ignored.
+** A running thread moves at it's next reschedule.
+*/
+status_t
+thread_set_affinity(struct thread *t, cpumask_t mask)
+{
+	struct run_queue *rq;
+	struct cpu *cpu;
+	int_state_t state;
+	bool online;
+
+	if (is_idle_thread(t)) {
+		return (ERR_INVALID_ARGS);
+	}
+
+	online = false;
+	for (cpu = cpus; cpu < cpus + nb_cpus; ++cpu) {
+		online |= cpu->online && (mask & CPUMASK_CPU(cpu->id));
+	}
+	if (!online) {
+		return (ERR_INVALID_ARGS);
+	}
+
+	arch_push_interrupts(&state);
+	arch_disable_interrupts();
+	rq = lock_thread_rq(t);
+	t->affinity = mask;
+	if (queued(t) && !(mask & CPUMASK_CPU(t->cpu))) {
+		rq_remove(t);
+		t->cpu = select_cpu(t)->id;
+		release_lock(&rq->lock);
+		rq = run_queues + t->cpu;
+		acquire_lock(&rq->lock);
+		sched_enqueue(t);
+	}
+	release_lock(&rq->lock);
+	arch_pop_interrupts(&state);
+	return (OK);
+}
+
+/*
+** Finishes the context switch that brought the current thread here, with
+** the lock of the run queue of the current processor held.
+**
+** A thread that yielded while it wasn't allowed on this processor anymore
+** is runnable but not queued: it's queued on an other processor now that
+** it's switched out.
+*/
+static void
+finish_switch(void)
+{
+	struct run_queue *rq;
+	struct thread *prev;
+	struct cpu *self;
+	uint cpu;
+
+	self = current_cpu();
+	rq = run_queues + self->id;
+	prev = rq->prev;
+	rq->prev = NULL;
+	if (prev == NULL || prev == self->idle_thread
+	    || prev->state != RUNNABLE || queued(prev)) {
+		return ;
+	}
+
+	cpu = select_cpu(prev)->id;
+	prev->cpu = cpu;
+	release_lock(&rq->lock);
+	acquire_lock(&run_queues[cpu].lock);
+	sched_enqueue(prev);
+	release_lock(&run_queues[cpu].lock);
+	acquire_lock(&rq->lock);
 }
 
 /*
 ** Finds and executes the next runnable thread.
+**
+** The lock of the run queue of the current processor must be held once.
+** It's released by the incoming thread, so when this function returns (or
+** when a new thread starts) it's the lock of the processor the current
+** thread runs on now that is held.
 */
-void
-thread_reschedule(void)
+static void
+reschedule(void)
 {
+	struct run_queue *rq;
 	struct thread *new;
 	struct thread *old;
 
 	assert(!arch_are_int_enabled());
-	assert(holding_lock(&thread_table_lock));
+	rq = run_queues + current_cpu()->id;
+	assert(holding_lock(&rq->lock));
+	assert_eq(rq->lock.depth, 1);
+
+	rcu_note_qs();
 
 	old = get_current_thread();
 	new = find_next_thread();
 	new->state = RUNNING;
+	new->cpu = current_cpu()->id;
 	if (new != old)
 	{
+		rq->prev = old;
 		set_current_thread(new);
-
-		/* TODO memory space switch */
-
 		arch_context_switch(old, new);
+		finish_switch();
 	}
 }
 
+/*
+** Called by each thread the first time it runs, to finish the context
+** switch that brought it here.
+*/
+void
+sched_first_run(void)
+{
+	finish_switch();
+	release_lock(&run_queues[current_cpu()->id].lock);
+}
+
 /*
 ** Yield the cpu to an other thread.
 ** This function will return at a later time, or
 ** possibly immediately if no other threads are waiting
 ** to be executed. (don't worry, they are guilty)
+**
+** The current thread keeps what's left of it's quantum.
 */
 void
 thread_yield(void)
 {
 	struct thread *t;
+	struct cpu *self;
 
 	t = get_current_thread();
-	LOCK_THREAD(state);
+	LOCK(&run_queues[current_cpu()->id].lock, state);
 
 	assert(t->state == RUNNING);
+	assert(!holding_lock(&thread_table_lock));
 
-	t->state = RUNNABLE;
-	thread_reschedule();
+	/* A thread not allowed here anymore is queued by finish_switch() */
+	self = current_cpu();
+	if (t != self->idle_thread && cpu_allowed(t, self)) {
+		sched_enqueue(t);
+	} else {
+		t->state = RUNNABLE;
+	}
+	reschedule();
 
-	RELEASE_THREAD(state);
+	RELEASE(&run_queues[current_cpu()->id].lock, state);
+}
+
+/*
+** Switches to an other thread, the current one having been put to sleep
+** by the caller (it's state isn't RUNNING anymore).
+**
+** The caller must hold the thread lock once. It's released once the run
+** queue is locked, so a thread waking us up waits until we are switched
+** out, and taken back before returning.
+*/
+void
+sched_sleep(void)
+{
+	assert(!arch_are_int_enabled());
+	assert(holding_lock(&thread_table_lock));
+	assert_eq(thread_table_lock.depth, 1);
+	assert_neq(get_current_thread()->state, RUNNING);
+
+	acquire_lock(&run_queues[current_cpu()->id].lock);
+	release_lock(&thread_table_lock);
+	reschedule();
+	release_lock(&run_queues[current_cpu()->id].lock);
+	acquire_lock(&thread_table_lock);
 }
 
+/*
+** Accounts the tick to the running thread, and asks for a reschedule if it
+** used all of it's quantum or if a more important thread is waiting.
+** Also balances the load of the current processor once in a while.
+*/
 enum handler_return
-irq_timer_handler(void)
+sched_tick(void)
+{
+	struct thread *t;
+	struct cpu *self;
+	struct run_queue *rq;
+	enum handler_return ret;
+
+	ret = IRQ_NO_RESCHEDULE;
+	t = get_current_thread();
+	self = current_cpu();
+	rq = run_queues + self->id;
+
+	/* Readers run with interrupts disabled, so none was interrupted */
+	rcu_note_qs();
+
+	/* All processors tick, but the boost period is counted on one of them */
+	if (self->id == BOOT_CPU_ID) {
+		++sched_ticks;
+		if (sched_ticks % SCHED_BOOST_PERIOD == 0) {
+			sched_boost();
+		}
+	}
+
+	LOCK(&rq->lock, state);
+
+	++rq->ticks;
+	if (rq->ticks % SCHED_BALANCE_PERIOD == 0) {
+		pull_thread(self, 2);
+	}
+
+	/* The idle thread leaves as soon as an other thread is runnable */
+	if (t == self->idle_thread) {
+		if (rq->nb_threads > 0 || pull_thread(self, 1)) {
+			ret = IRQ_RESCHEDULE;
+		}
+		goto end;
+	}
+
+	if (t->quantum > 1) {
+		t->quantum--;
+	} else {
+		if (t->sched_level < SCHED_NB_LEVELS - 1) {
+			t->sched_level++;
+		}
+		t->quantum = level_quantum(t->sched_level);
+		ret = IRQ_RESCHEDULE;
+	}
+
+	if (first_runnable_level(rq) < t->sched_level) {
+		ret = IRQ_RESCHEDULE;
+	}
+end:
+	RELEASE(&rq->lock, state);
+	return (ret);
+}
+
+/*
+** Copies the scheduling statistics of each level in the given array,
+** summed over all processors.
+*/
+void
+sched_get_stats(struct sched_stats s[SCHED_NB_LEVELS])
 {
-	return (IRQ_RESCHEDULE);
+	struct sched_stats *rs;
+	struct run_queue *rq;
+	uint32 picks;
+	uint level;
+
+	memset(s, 0, SCHED_NB_LEVELS * sizeof(*s));
+	for (rq = run_queues; rq < run_queues + nb_cpus; ++rq)
+	{
+		LOCK(&rq->lock, state);
+		for (level = 0; level < SCHED_NB_LEVELS; ++level)
+		{
+			rs = rq->stats + level;
+			picks = s[level].nb_picks + rs->nb_picks;
+			if (picks != 0) {
+				s[level].avg_wait = udiv64_32(
+					(uint64)s[level].avg_wait * s[level].nb_picks
+					+ (uint64)rs->avg_wait * rs->nb_picks,
+					picks
+				);
+			}
+			s[level].nb_picks = picks;
+			s[level].max_wait = rs->max_wait > s[level].max_wait ? rs->max_wait : s[level].max_wait;
+		}
+		RELEASE(&rq->lock, state);
+	}
+}
+
+/*
+** Copies the scheduling statistics of the given processor.
+*/
+void
+sched_get_cpu_stats(uint cpu, struct sched_cpu_stats *s)
+{
+	assert_lo(cpu, nb_cpus);
+	LOCK(&run_queues[cpu].lock, state);
+	s->nb_queued = run_queues[cpu].nb_threads;
+	s->nb_migrations = run_queues[cpu].nb_migrations;
+	RELEASE(&run_queues[cpu].lock, state);
+}
+
+/*
+** Prints the scheduling statistics of each level and each processor.
+** Waiting times are in cycles.
+*/
+void
+sched_dump_stats(void)
+{
+	struct sched_stats s[SCHED_NB_LEVELS];
+	struct sched_cpu_stats cs;
+	uint level;
+	uint cpu;
+
+	sched_get_stats(s);
+	for (level = 0; level < SCHED_NB_LEVELS; ++level) {
+		printf("level %u (quantum %u): %u picks, avg wait %u, max wait %u\n",
+			level,
+			level_quantum(level),
+			s[level].nb_picks,
+			s[level].avg_wait,
+			s[level].max_wait
+		);
+	}
+	for (cpu = 0; cpu < nb_cpus; ++cpu) {
+		sched_get_cpu_stats(cpu, &cs);
+		printf("cpu%u: %u queued, %u migrations\n",
+			cpu,
+			cs.nb_queued,
+			cs.nb_migrations
+		);
+	}
 }
+
+/* Number of threads queued, and number of picks, of the pick benchmark */
+# define BENCH_PICK_THREADS	(256u)
+# define BENCH_PICK_ROUNDS	(100000u)
+
+/* Number of round trips of the switch and ping-pong benchmarks */
+# define BENCH_SWITCH_ROUNDS	(10000u)
+# define BENCH_PINGPONG_ROUNDS	(100000u)
+
+/*
+** Measures the cost of picking the next thread and queuing it back, with
+** enough threads queued that they don't all fit in the first level cache.
+** The threads are never run, so they only need what the scheduler reads.
+*/
+static void __init
+sched_pick_bench(void)
+{
+	struct thread *threads;
+	struct thread *t;
+	struct bench b;
+	void *alloc;
+	uint i;
+
+	alloc = kalloc(BENCH_PICK_THREADS * sizeof(*threads) + CACHE_LINE_SIZE - 1);
+	assert_neq(alloc, NULL);
+	threads = (struct thread *)ALIGN((uintptr)alloc, CACHE_LINE_SIZE);
+	memset(threads, 0, BENCH_PICK_THREADS * sizeof(*threads));
+
+	LOCK(&run_queues[current_cpu()->id].lock, state);
+	for (t = threads; t < threads + BENCH_PICK_THREADS; ++t) {
+		t->cpu = current_cpu()->id;
+		t->affinity = CPUMASK_CPU(t->cpu);
+		sched_reset(t);
+		sched_enqueue(t);
+	}
+
+	bench_start(&b);
+	for (i = 0; i < BENCH_PICK_ROUNDS; ++i) {
+		sched_enqueue(find_next_thread());
+	}
+	bench_stop(&b, "pick + enqueue", BENCH_PICK_ROUNDS);
+
+	for (t = threads; t < threads + BENCH_PICK_THREADS; ++t) {
+		rq_remove(t);
+	}
+	RELEASE(&run_queues[current_cpu()->id].lock, state);
+	kfree(alloc);
+}
+
+static volatile uint bench_switch_count;
+
+static int __init
+sched_switch_bench_main(void)
+{
+	while (bench_switch_count < BENCH_SWITCH_ROUNDS)
+	{
+		++bench_switch_count;
+		thread_yield();
+	}
+	return (0);
+}
+
+/*
+** Measures the cost of a context switch, with two threads of the same
+** processor yielding to each other.
+*/
+static void __init
+sched_switch_bench(void)
+{
+	struct thread *t;
+	struct bench b;
+
+	bench_switch_count = 0;
+	t = thread_create("bench-switch", &sched_switch_bench_main, DEFAULT_STACK_SIZE);
+	assert_neq(t, NULL);
+	assert_eq(thread_set_affinity(t, CPUMASK_CPU(current_cpu()->id)), OK);
+
+	bench_start(&b);
+	while (bench_switch_count < BENCH_SWITCH_ROUNDS) {
+		thread_yield();
+	}
+	bench_stop(&b, "yield switches", 2 * BENCH_SWITCH_ROUNDS);
+
+	thread_waitpid(t->pid);
+}
+
+static struct wait_queue bench_ping_wq = WAIT_QUEUE_INIT_VALUE(bench_ping_wq);
+static struct wait_queue bench_pong_wq = WAIT_QUEUE_INIT_VALUE(bench_pong_wq);
+static bool bench_pong_turn;
+
+static int __init
+sched_pingpong_bench_main(void)
+{
+	uint i;
+
+	LOCK_THREAD(state);
+	for (i = 0; i < BENCH_PINGPONG_ROUNDS; ++i)
+	{
+		while (!bench_pong_turn) {
+			wait_queue_sleep(&bench_pong_wq);
+		}
+		bench_pong_turn = false;
+		wait_queue_wake_one(&bench_ping_wq);
+	}
+	RELEASE_THREAD(state);
+	return (0);
+}
+
+/*
+** Measures the switch latency, with two threads of the same processor
+** waking up each other and going to sleep, as threads waiting for each
+** other's messages would do.
+*/
+static void __init
+sched_pingpong_bench(void)
+{
+	struct thread *t;
+	struct bench b;
+	uint i;
+
+	bench_pong_turn = false;
+	t = thread_create("bench-pingpong", &sched_pingpong_bench_main, DEFAULT_STACK_SIZE);
+	assert_neq(t, NULL);
+	assert_eq(thread_set_affinity(t, CPUMASK_CPU(current_cpu()->id)), OK);
+
+	bench_start(&b);
+	LOCK_THREAD(state);
+	for (i = 0; i < BENCH_PINGPONG_ROUNDS; ++i)
+	{
+		bench_pong_turn = true;
+		wait_queue_wake_one(&bench_pong_wq);
+		while (bench_pong_turn) {
+			wait_queue_sleep(&bench_ping_wq);
+		}
+	}
+	RELEASE_THREAD(state);
+	bench_stop(&b, "ping-pong switches", 2 * BENCH_PINGPONG_ROUNDS);
+
+	thread_waitpid(t->pid);
+}
+
+/*
+** Initializes the run queues.
+** The boot processor runs the scheduler from now on.
+*/
+void __init
+sched_init(void)
+{
+	struct run_queue *rq;
+	uint level;
+
+	for (rq = run_queues; rq < run_queues + MAX_CPUS; ++rq) {
+		init_lock(&rq->lock);
+		for (level = 0; level < SCHED_NB_LEVELS; ++level) {
+			LIST_INIT_HEAD(rq->levels + level);
+		}
+	}
+	cpus[BOOT_CPU_ID].online = true;
+}
+
+/*
+** Returns true if the current processor has something else to do than
+** running it's idle thread.
+** A run queue that can't be locked right away is being worked on, and is
+** counted as having work.
+*/
+static bool
+idle_has_work(void)
+{
+	struct run_queue *rq;
+	struct cpu *self;
+	struct cpu *cpu;
+	bool work;
+
+	self = current_cpu();
+	LOCK(&run_queues[self->id].lock, state);
+	work = run_queues[self->id].nb_threads > 0;
+	for (cpu = cpus; !work && cpu < cpus + nb_cpus; ++cpu)
+	{
+		rq = run_queues + cpu->id;
+		if (cpu == self) {
+			continue;
+		}
+		if (!try_acquire_lock(&rq->lock)) {
+			work = true;
+			break;
+		}
+		work = find_stealable(rq, self) != NULL;
+		release_lock(&rq->lock);
+	}
+	RELEASE(&run_queues[self->id].lock, state);
+	return (work);
+}
+
+/*
+** Main loop of the idle thread.
+**
+** Halts until the next interrupt, with the periodic tick stopped, as long
+** as no thread is runnable on this processor or can be stolen from an
+** other one.
+** RCU doesn't wait for the processor while it is halted.
+*/
+static int
+idle_main(void)
+{
+	while (42)
+	{
+		arch_disable_interrupts();
+		if (!idle_has_work()) {
+			timer_nohz_enter();
+			rcu_idle_enter();
+			arch_wait_for_interrupt();
+			rcu_idle_exit();
+		}
+		arch_enable_interrupts();
+		thread_yield();
+	}
+	return (0);
+}
+
+/*
+** Creates the idle thread of each processor and takes them out of the
+** run queues.
+*/
+static void __init
+idle_init(enum init_level il __unused)
+{
+	struct run_queue *rq;
+	struct thread *t;
+	struct cpu *cpu;
+
+	for (cpu = cpus; cpu < cpus + nb_cpus; ++cpu)
+	{
+		t = kthread_create("idle", &idle_main, NULL);
+		assert_neq(t, NULL);
+
+		rq = run_queues + t->cpu;
+		LOCK(&rq->lock, state);
+		rq_remove(t);
+		t->cpu = cpu->id;
+		t->affinity = CPUMASK_CPU(cpu->id);
+		cpu->idle_thread = t;
+		RELEASE(&rq->lock, state);
+	}
+}
+
+NEW_INIT_HOOK(idle, &idle_init, CHAOS_INIT_LEVEL_KTHREADS);
+NEW_BENCHMARK(sched_pick, &sched_pick_bench);
+NEW_BENCHMARK(sched_switch, &sched_switch_bench);
+NEW_BENCHMARK(sched_pingpong, &sched_pingpong_bench);
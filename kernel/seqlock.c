@@ -0,0 +1,68 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#include <kernel/seqlock.h>
+#include <kernel/interrupts.h>
+#include <kernel/unit_tests.h>
+#include <debug.h>
+
+void
+seqlock_init(struct seqlock *sl)
+{
+	sl->sequence = 0;
+	init_lock(&sl->lock);
+}
+
+/*
+** Starts an update of the data protected by the given seqlock.
+** Interrupts must be disabled.
+*/
+void
+write_seqlock(struct seqlock *sl)
+{
+	acquire_lock(&sl->lock);
+	assert(!(sl->sequence & 1u));
+	sl->sequence++;
+	barrier();
+}
+
+void
+write_sequnlock(struct seqlock *sl)
+{
+	assert(holding_lock(&sl->lock));
+	barrier();
+	sl->sequence++;
+	release_lock(&sl->lock);
+}
+
+/*
+** Seqlock tests, on a single processor.
+*/
+static void __init
+seqlock_test(void)
+{
+	struct seqlock sl;
+	uint seq;
+
+	seqlock_init(&sl);
+
+	/* No update, no retry */
+	seq = read_seqbegin(&sl);
+	assert(!read_seqretry(&sl, seq));
+
+	/* An update forces the readers to retry */
+	seq = read_seqbegin(&sl);
+	LOCK_SEQ(&sl, state);
+	assert(sl.sequence & 1u);
+	RELEASE_SEQ(&sl, state);
+	assert(read_seqretry(&sl, seq));
+	assert(!read_seqretry(&sl, read_seqbegin(&sl)));
+}
+
+NEW_UNIT_TEST(seqlock, &seqlock_test, UNIT_TEST_LEVEL_RWLOCK);
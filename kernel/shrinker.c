@@ -0,0 +1,153 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#include <kernel/shrinker.h>
+#include <kernel/thread.h>
+#include <kernel/workqueue.h>
+#include <kernel/kalloc.h>
+#include <kernel/init.h>
+#include <kernel/pmm.h>
+#include <kernel/unit_tests.h>
+#include <stdio.h>
+
+/*
+** Memory reclaim.
+**
+** Caches register a shrinker with NEW_SHRINKER(). They are asked to give
+** memory back by the frame allocator, when it runs dry, and by the reclaim
+** work, when the number of free frames goes under RECLAIM_LOW_WATERMARK.
+** The reclaim work has it's own queue, with a low priority worker, so it
+** doesn't hold back the other deferred work.
+*/
+
+extern struct shrinker const __start_chaos_shrinker[] __weak;
+extern struct shrinker const __stop_chaos_shrinker[] __weak;
+
+static struct workqueue *reclaim_wq;
+static struct work reclaim_work;
+
+/*
+** Asks the shrinkers to free the given amount of frames, cheapest first.
+** Returns the number of frames that were freed.
+**
+** The shrinkers may sleep (eg: to write pages to a device), so no lock is
+** held while they run, and several threads may shrink the caches at the
+** same time: none of them fails because an other one is already at it.
+** The shrinkers may allocate frames too, so a thread that is already
+** shrinking the caches doesn't do it again.
+*/
+size_t
+shrink_caches(size_t nb_frames)
+{
+	struct shrinker const *shrinker;
+	struct thread *t;
+	enum shrinker_cost cost;
+	size_t freed;
+	size_t count;
+
+	t = get_current_thread();
+	if (t->reclaiming) {
+		return (0);
+	}
+	t->reclaiming = true;
+	freed = 0;
+	cost = SHRINKER_COST_LOW;
+	while (cost < SHRINKER_COST_MAX && freed < nb_frames)
+	{
+		shrinker = __start_chaos_shrinker;
+		while (shrinker < __stop_chaos_shrinker && freed < nb_frames)
+		{
+			if (shrinker->cost == cost) {
+				count = shrinker->count();
+				if (count) {
+					count = count > nb_frames - freed ? nb_frames - freed : count;
+					freed += shrinker->scan(count);
+				}
+			}
+			++shrinker;
+		}
+		++cost;
+	}
+	t->reclaiming = false;
+	return (freed);
+}
+
+/*
+** Queues the reclaim work, if it isn't already.
+** The frame allocator may run low before the reclaim queue exists.
+*/
+void
+reclaim_wakeup(void)
+{
+	if (reclaim_wq != NULL) {
+		queue_work(reclaim_wq, &reclaim_work);
+	}
+}
+
+/*
+** Shrinks the caches until the number of free frames reaches
+** RECLAIM_HIGH_WATERMARK, or nothing can be freed anymore.
+*/
+static void
+reclaim(void *arg __unused)
+{
+	while (nb_free_frames() < RECLAIM_HIGH_WATERMARK
+	       && shrink_caches(RECLAIM_BATCH) != 0) {
+		thread_yield();
+	}
+}
+
+static void __init
+reclaimd_init(enum init_level il __unused)
+{
+	struct workqueue *wq;
+
+	work_init(&reclaim_work, &reclaim, NULL);
+	wq = create_workqueue("reclaimd");
+	assert_neq(wq, NULL);
+	assert_eq(thread_set_nice(wq->worker, SCHED_NICE_MAX), OK);
+	reclaim_wq = wq;
+}
+
+/*
+** Shrinker tests, using the kernel heap shrinker.
+*/
+static void __init
+shrinker_test(void)
+{
+	void *ptr;
+	size_t before;
+	size_t freed;
+
+	/* Leave some free space at the end of the heap */
+	ptr = kalloc(16 * PAGE_SIZE);
+	assert_neq(ptr, NULL);
+	kfree(ptr);
+
+	before = nb_free_frames();
+	freed = shrink_caches(4);
+	assert_eq(freed, 4);
+	assert_eq(nb_free_frames(), before + freed);
+
+	/* The heap can still grow back */
+	ptr = kalloc(16 * PAGE_SIZE);
+	assert_neq(ptr, NULL);
+	kfree(ptr);
+}
+
+static void __init
+shrinker_init(enum init_level il __unused)
+{
+	trigger_unit_tests(UNIT_TEST_LEVEL_SHRINKER);
+	printf("[OK]\tMemory Reclaim\n");
+}
+
+NEW_INIT_HOOK(shrinker, &shrinker_init, CHAOS_INIT_LEVEL_VMM + 2);
+NEW_INIT_HOOK(reclaimd, &reclaimd_init, CHAOS_INIT_LEVEL_KTHREADS);
+NEW_UNIT_TEST(shrinker, &shrinker_test, UNIT_TEST_LEVEL_SHRINKER);
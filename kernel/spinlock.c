@@ -8,34 +8,150 @@
 \* ------------------------------------------------------------------------ */
 
 #include <kernel/spinlock.h>
+#include <kernel/cpu.h>
+#include <kernel/interrupts.h>
 #include <arch/common_op.h>
 #include <stdio.h>
 
 void
 init_lock(struct spinlock *lock)
 {
-	lock->locked = 0;
+	lock->next = 0;
+	lock->serving = 0;
+	lock->owner = 0;
 	lock->depth = 0;
+#ifdef ENABLE_LOCK_STATS
+	lock->hold_start = 0;
+	lock->stats.nb_acquires = 0;
+	lock->stats.nb_contended = 0;
+	lock->stats.max_hold = 0;
+#endif /* ENABLE_LOCK_STATS */
 }
 
 bool
 holding_lock(struct spinlock *lock)
 {
-	return (lock->locked && lock->depth);
+	return (lock->depth && lock->owner == current_cpu()->id + 1);
 }
 
+/*
+** Takes the given lock, spinning until it's available.
+** Interrupts must be disabled, or an interrupt handler taking the same
+** lock would spin forever.
+**
+** The owner can only be set to the id of the current processor by the
+** current processor itself, so it can be checked without the lock.
+*/
 void
 acquire_lock(struct spinlock *lock)
 {
-	lock->depth++;
-	while (!atomic_exchange(&lock->locked, 1));
+	uint id;
+	int ticket;
+#ifdef ENABLE_LOCK_STATS
+	bool contended;
+#endif /* ENABLE_LOCK_STATS */
+
+	id = current_cpu()->id + 1;
+	if (lock->owner == id) {
+		lock->depth++;
+		return ;
+	}
+	ticket = atomic_add(&lock->next, 1);
+#ifdef ENABLE_LOCK_STATS
+	contended = (lock->serving != ticket);
+#endif /* ENABLE_LOCK_STATS */
+	while (lock->serving != ticket) {
+		pause();
+	}
+	barrier();
+	lock->owner = id;
+	lock->depth = 1;
+#ifdef ENABLE_LOCK_STATS
+	lock->stats.nb_acquires++;
+	lock->stats.nb_contended += contended;
+	lock->hold_start = read_cycle_counter();
+#endif /* ENABLE_LOCK_STATS */
+}
+
+/*
+** Takes the given lock if it's available, without waiting.
+** Returns true if it was taken.
+**
+** The lock is free when the next ticket is the one being served, so
+** taking that ticket atomically takes the lock.
+*/
+bool
+try_acquire_lock(struct spinlock *lock)
+{
+	uint id;
+	int ticket;
+
+	id = current_cpu()->id + 1;
+	if (lock->owner == id) {
+		lock->depth++;
+		return (true);
+	}
+	ticket = lock->serving;
+	if (atomic_cmpxchg(&lock->next, ticket, ticket + 1) != ticket) {
+		return (false);
+	}
+	barrier();
+	lock->owner = id;
+	lock->depth = 1;
+#ifdef ENABLE_LOCK_STATS
+	lock->stats.nb_acquires++;
+	lock->hold_start = read_cycle_counter();
+#endif /* ENABLE_LOCK_STATS */
+	return (true);
 }
 
 void
 release_lock(struct spinlock *lock)
 {
+#ifdef ENABLE_LOCK_STATS
+	uint64 hold;
+#endif /* ENABLE_LOCK_STATS */
+
 	assert(holding_lock(lock));
 	lock->depth--;
-	if (!lock->depth)
-		atomic_exchange(&lock->locked, 0);
+	if (!lock->depth) {
+#ifdef ENABLE_LOCK_STATS
+		hold = read_cycle_counter() - lock->hold_start;
+		if (hold > lock->stats.max_hold) {
+			lock->stats.max_hold = hold > (uint32)-1 ? (uint32)-1 : (uint32)hold;
+		}
+#endif /* ENABLE_LOCK_STATS */
+		lock->owner = 0;
+		barrier();
+		lock->serving++;
+	}
+}
+
+#ifdef ENABLE_LOCK_STATS
+
+/*
+** Copies the statistics of the given lock.
+*/
+void
+lock_get_stats(struct spinlock *lock, struct spinlock_stats *s)
+{
+	LOCK(lock, state);
+	*s = lock->stats;
+	RELEASE(lock, state);
+}
+
+void
+lock_dump_stats(char const *name, struct spinlock *lock)
+{
+	struct spinlock_stats s;
+
+	lock_get_stats(lock, &s);
+	printf("%s lock: %u acquisitions, %u contended, max hold %u cycles\n",
+		name,
+		s.nb_acquires,
+		s.nb_contended,
+		s.max_hold
+	);
 }
+
+#endif /* ENABLE_LOCK_STATS */
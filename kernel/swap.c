@@ -0,0 +1,472 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#include <kernel/swap.h>
+#include <kernel/init.h>
+#include <kernel/kalloc.h>
+#include <kernel/shrinker.h>
+#include <kernel/unit_tests.h>
+#include <lib/bdev/mem.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+** Anonymous memory swapping.
+**
+** When memory runs low, the swap shrinker chooses a victim page with a clock
+** algorithm (using the accessed bit maintained by the MMU). The page is
+** written to the swap device and it's frame is given back to the frame
+** allocator.
+** The page table entry then remembers the slot the page was written to,
+** so the page can be brought back by the page fault handler.
+**
+** Slots are reference counted because fork() shares them between the
+** parent and the child.
+**
+** The device is read and written without the swap lock held, through a
+** reference taken under it, so swap_off() can't close it in between.
+** Several pages may be swapped out at once: a page that was swapped out,
+** written, unmapped or pinned while it was written to the device is simply
+** kept in memory.
+*/
+
+static struct swap_device swap;
+static struct spinlock swap_lock;
+
+/*
+** Looks for a free slot and reserves it.
+** Returns NULL_SLOT if the swap device is full.
+*/
+static swap_slot_t
+alloc_slot(void)
+{
+	size_t i;
+	size_t n;
+
+	assert(holding_lock(&swap_lock));
+	if (swap.nb_free_slots == 0) {
+		return (NULL_SLOT);
+	}
+	i = swap.next_slot;
+	n = 0;
+	while (n < swap.nb_slots)
+	{
+		if (swap.slot_map[i] == 0) {
+			swap.slot_map[i] = 1;
+			swap.nb_free_slots--;
+			swap.next_slot = (i + 1) % swap.nb_slots;
+			return (i);
+		}
+		i = (i + 1) % swap.nb_slots;
+		++n;
+	}
+	return (NULL_SLOT);
+}
+
+/*
+** Drops a reference on the given slot, releasing it if it reaches 0.
+*/
+static void
+put_slot(swap_slot_t slot)
+{
+	assert(holding_lock(&swap_lock));
+	assert_lo(slot, swap.nb_slots);
+	assert_neq(swap.slot_map[slot], 0);
+
+	swap.slot_map[slot]--;
+	if (swap.slot_map[slot] == 0) {
+		swap.nb_free_slots++;
+		swap.next_slot = slot;
+	}
+}
+
+/*
+** Uses the given block device as the swap device.
+*/
+status_t
+swap_on(char const *name)
+{
+	struct bdev *bdev;
+	uchar *slot_map;
+	size_t nb_slots;
+
+	bdev = bdev_open(name);
+	if (bdev == NULL) {
+		return (ERR_NOT_FOUND);
+	}
+
+	/* The slot index must fit in the frame field of a page table entry */
+	nb_slots = (bdev->block_size * bdev->block_count) / PAGE_SIZE;
+	nb_slots = nb_slots > NB_FRAMES ? NB_FRAMES : nb_slots;
+	if (nb_slots == 0) {
+		bdev_close(bdev);
+		return (ERR_INVALID_ARGS);
+	}
+
+	slot_map = kcalloc(nb_slots, sizeof(*slot_map));
+	if (slot_map == NULL) {
+		bdev_close(bdev);
+		return (ERR_NO_MEMORY);
+	}
+
+	LOCK_SWAP(state);
+	if (swap.bdev != NULL) {
+		RELEASE_SWAP(state);
+		kfree(slot_map);
+		bdev_close(bdev);
+		return (ERR_ALREADY_EXIST);
+	}
+	memset(&swap, 0, sizeof(swap));
+	swap.bdev = bdev;
+	swap.slot_map = slot_map;
+	swap.nb_slots = nb_slots;
+	swap.nb_free_slots = nb_slots;
+	RELEASE_SWAP(state);
+	return (OK);
+}
+
+/*
+** Stops using the current swap device.
+** Fails if some pages are still swapped out.
+*/
+status_t
+swap_off(void)
+{
+	struct bdev *bdev;
+	uchar *slot_map;
+
+	LOCK_SWAP(state);
+	if (swap.bdev == NULL) {
+		RELEASE_SWAP(state);
+		return (ERR_NOT_FOUND);
+	}
+	if (swap.nb_free_slots != swap.nb_slots) {
+		RELEASE_SWAP(state);
+		return (ERR_TARGET_BUSY);
+	}
+	bdev = swap.bdev;
+	slot_map = swap.slot_map;
+	swap.bdev = NULL;
+	swap.slot_map = NULL;
+	RELEASE_SWAP(state);
+
+	kfree(slot_map);
+	bdev_close(bdev);
+	return (OK);
+}
+
+/*
+** Writes the given page to the swap device and frees it's frame.
+**
+** The swap lock isn't held while the page is written: the slot is
+** reserved and the page marked clean first, and the page is only replaced
+** by the slot if it wasn't written, unmapped or pinned in the meantime.
+*/
+status_t
+swap_out_page(virt_addr_t va)
+{
+	struct bdev *bdev;
+	swap_slot_t slot;
+	phys_addr_t pa;
+	status_t err;
+
+	assert(IS_PAGE_ALIGNED(va));
+
+	LOCK_SWAP(state);
+	if (swap.bdev == NULL) {
+		RELEASE_SWAP(state);
+		return (ERR_NOT_SUPPORTED);
+	}
+	if (!arch_swap_is_swappable(va)) {
+		RELEASE_SWAP(state);
+		return (ERR_INVALID_ARGS);
+	}
+	slot = alloc_slot();
+	if (slot == NULL_SLOT) {
+		RELEASE_SWAP(state);
+		return (ERR_NO_MEMORY);
+	}
+	bdev = bdev_dup(swap.bdev);
+	pa = arch_swap_clean(va);
+	RELEASE_SWAP(state);
+
+	err = OK;
+	if (bdev_write(bdev, va, slot * PAGE_SIZE, PAGE_SIZE) != PAGE_SIZE) {
+		err = ERR_BAD_DEVICE;
+	}
+	bdev_close(bdev);
+
+	LOCK_SWAP(state2);
+	if (err == OK && !arch_swap_unchanged(va, pa)) {
+		err = ERR_TARGET_BUSY;
+	}
+	if (err == OK) {
+		free_frame(arch_swap_set_slot(va, slot));
+		swap.nb_swapped_out++;
+	} else {
+		put_slot(slot);
+	}
+	RELEASE_SWAP(state2);
+	return (err);
+}
+
+/*
+** Frees a frame by swapping out a page of the current virtual address space.
+*/
+status_t
+swap_out(void)
+{
+	virt_addr_t va;
+	status_t err;
+
+	LOCK_SWAP(state);
+	if (swap.bdev == NULL) {
+		err = ERR_NOT_SUPPORTED;
+	} else {
+		err = arch_swap_select_victim(&va);
+	}
+	RELEASE_SWAP(state);
+	if (err == OK) {
+		err = swap_out_page(va);
+	}
+	return (err);
+}
+
+/*
+** Brings back the given swapped page.
+** Returns ERR_NOT_FOUND if the page isn't swapped out.
+**
+** The page is read in a buffer without holding the swap lock, keeping a
+** reference on the slot so it isn't reused in the meantime. The frame
+** holding the data is then given to the page, if it is still swapped out
+** to that slot.
+*/
+status_t
+swap_in(virt_addr_t va)
+{
+	struct bdev *bdev;
+	swap_slot_t slot;
+	phys_addr_t pa;
+	void *alloc;
+	void *buffer;
+	status_t err;
+
+	assert(IS_PAGE_ALIGNED(va));
+
+	LOCK_SWAP(state);
+	slot = arch_swap_get_slot(va);
+	if (slot == NULL_SLOT || swap.bdev == NULL) {
+		RELEASE_SWAP(state);
+		return (ERR_NOT_FOUND);
+	}
+	assert_neq(swap.slot_map[slot], UCHAR_MAX);
+	swap.slot_map[slot]++;
+	bdev = bdev_dup(swap.bdev);
+	RELEASE_SWAP(state);
+
+	/* This may swap out an other page to make some room */
+	alloc = kalloc(2 * PAGE_SIZE); /* Dirty way to have page-aligned allocations */
+	pa = alloc_frame();
+	if (alloc == NULL || pa == NULL_FRAME) {
+		err = ERR_NO_MEMORY;
+		goto end;
+	}
+	buffer = (void *)ALIGN((uintptr)alloc, PAGE_SIZE);
+	if (bdev_read(bdev, buffer, slot * PAGE_SIZE, PAGE_SIZE) != PAGE_SIZE) {
+		panic("Failed to read back swapped page %p (slot %u)", va, slot);
+	}
+
+	LOCK_SWAP(state2);
+	if (arch_swap_get_slot(va) == slot) {
+		arch_swap_restore(va, arch_swap_exchange_frame(buffer, pa));
+		put_slot(slot);
+		swap.nb_swapped_in++;
+		pa = NULL_FRAME;
+	}
+	RELEASE_SWAP(state2);
+	err = OK;
+end:
+	if (pa != NULL_FRAME) {
+		free_frame(pa);
+	}
+	kfree(alloc);
+	bdev_close(bdev);
+	LOCK_SWAP(state3);
+	put_slot(slot);
+	RELEASE_SWAP(state3);
+	return (err);
+}
+
+/*
+** Keeps the given present user page of the current virtual address space
+** in memory for as long as it's mapped. Used for pages whose frame must
+** not change, like the ones holding futexes.
+** Pages that were swapped out must be brought back with swap_in() first.
+** This function doesn't sleep, so it can be called with a spinlock held.
+**
+** Returns the frame the page is mapped to, or NULL_FRAME if it isn't a
+** present user page.
+*/
+phys_addr_t
+swap_pin_page(virt_addr_t va)
+{
+	phys_addr_t pa;
+
+	va = (virt_addr_t)ROUND_DOWN((uintptr)va, PAGE_SIZE);
+	LOCK_SWAP(state);
+	pa = arch_swap_pin(va);
+	RELEASE_SWAP(state);
+	return (pa);
+}
+
+/*
+** Lets the given page of the current virtual address space be swapped out
+** again.
+*/
+void
+swap_unpin_page(virt_addr_t va)
+{
+	va = (virt_addr_t)ROUND_DOWN((uintptr)va, PAGE_SIZE);
+	LOCK_SWAP(state);
+	arch_swap_unpin(va);
+	RELEASE_SWAP(state);
+}
+
+/*
+** Adds a reference to the given slot.
+** Used when a virtual address space holding swapped pages is cloned.
+*/
+void
+swap_dup_slot(swap_slot_t slot)
+{
+	LOCK_SWAP(state);
+	assert_lo(slot, swap.nb_slots);
+	assert_neq(swap.slot_map[slot], 0);
+	assert_neq(swap.slot_map[slot], UCHAR_MAX);
+	swap.slot_map[slot]++;
+	RELEASE_SWAP(state);
+}
+
+/*
+** Drops a reference to the given slot.
+** Used when a swapped page is unmapped.
+*/
+void
+swap_free_slot(swap_slot_t slot)
+{
+	LOCK_SWAP(state);
+	put_slot(slot);
+	RELEASE_SWAP(state);
+}
+
+/*
+** Returns the number of pages that could be swapped out.
+*/
+static size_t
+swap_shrinker_count(void)
+{
+	return (swap.bdev ? swap.nb_free_slots : 0);
+}
+
+/*
+** A page chosen by an other thread swapping out at the same time is kept
+** in memory, so an other victim is tried, a bounded number of times.
+*/
+static size_t
+swap_shrinker_scan(size_t nb_frames)
+{
+	size_t freed;
+	size_t tries;
+	status_t err;
+
+	freed = 0;
+	tries = 0;
+	while (freed < nb_frames && tries < 2 * nb_frames)
+	{
+		err = swap_out();
+		if (err == OK) {
+			++freed;
+		} else if (err != ERR_TARGET_BUSY) {
+			break;
+		}
+		++tries;
+	}
+	return (freed);
+}
+
+/*
+** Swap tests, using a RAM-backed block device.
+*/
+static void __init
+swap_test(void)
+{
+	struct bdev *bdev;
+	void *area;
+	virt_addr_t va;
+
+	area = kalloc(4 * PAGE_SIZE);
+	assert_neq(area, NULL);
+	assert_eq(register_membdev("swap-test", area, 4 * PAGE_SIZE), OK);
+	assert_eq(swap_on("swap-test"), OK);
+	assert_eq(swap_on("swap-test"), ERR_ALREADY_EXIST);
+	assert_eq(swap.nb_slots, 4);
+
+	va = (virt_addr_t)0x10000000;
+	assert_eq(mmap(va, 2 * PAGE_SIZE, MMAP_USER | MMAP_WRITE), va);
+	memset(va, 0x5A, PAGE_SIZE);
+	memset(va + PAGE_SIZE, 0xA5, PAGE_SIZE);
+
+	/* Kernel pages can't be swapped */
+	assert_eq(swap_out_page(area), ERR_INVALID_ARGS);
+
+	/* Explicit swap out, brought back by the page fault handler */
+	assert_eq(swap_out_page(va), OK);
+	assert(!arch_is_allocated(va));
+	assert_eq(arch_swap_get_slot(va), 0);
+	assert_eq(swap.nb_free_slots, 3);
+	assert_eq(*(volatile uchar *)(va + 42), 0x5A);
+	assert(arch_is_allocated(va));
+	assert_eq(arch_swap_get_slot(va), NULL_SLOT);
+	assert_eq(swap.nb_free_slots, 4);
+
+	/* Clock algorithm */
+	assert_eq(swap_out(), OK);
+	assert_eq(swap_out(), OK);
+	assert(!arch_is_allocated(va));
+	assert(!arch_is_allocated(va + PAGE_SIZE));
+	assert_eq(swap.nb_free_slots, 2);
+	assert_eq(*(volatile uchar *)(va + PAGE_SIZE + 42), 0xA5);
+	assert_eq(*(volatile uchar *)(va + 1), 0x5A);
+
+	/* Unmapping a swapped page frees it's slot */
+	assert_eq(swap_out_page(va), OK);
+	assert_eq(swap_off(), ERR_TARGET_BUSY);
+	munmap(va, 2 * PAGE_SIZE);
+	assert_eq(swap.nb_free_slots, 4);
+
+	assert_eq(swap_off(), OK);
+	assert_eq(swap_out(), ERR_NOT_SUPPORTED);
+	bdev = bdev_open("swap-test");
+	assert_neq(bdev, NULL);
+	bdev_unregister(bdev);
+	bdev_close(bdev);
+	kfree(area);
+}
+
+static void __init
+swap_init(enum init_level il __unused)
+{
+	init_lock(&swap_lock);
+	trigger_unit_tests(UNIT_TEST_LEVEL_SWAP);
+	printf("[OK]\tSwap\n");
+}
+
+NEW_INIT_HOOK(swap, &swap_init, CHAOS_INIT_LEVEL_BDEV);
+NEW_UNIT_TEST(swap, &swap_test, UNIT_TEST_LEVEL_SWAP);
+NEW_SHRINKER(swap, SHRINKER_COST_HIGH, &swap_shrinker_count, &swap_shrinker_scan);
@@ -10,6 +10,8 @@
 #include <kernel/thread.h>
 #include <kernel/fs.h>
 #include <kernel/kalloc.h>
+#include <kernel/timer.h>
+#include <kernel/futex.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -119,15 +121,16 @@ sys_fork(void)
 }
 
 /*
-** Does the execve system call.
+** Copies the given NULL-terminated argument array, and the strings it
+** points to, in kernel memory, as they may not be reachable once the
+** program is changed.
 */
-int
-sys_execve(char const *name, int (*main)(), char const *args[])
+static char **
+copy_args(char const *args[])
 {
 	char **argv;
 	int argc;
 
-	/* We need to copy args or they will point to invalid memory */
 	argc = 0;
 	while (args[argc]) {
 		++argc;
@@ -140,8 +143,16 @@ sys_execve(char const *name, int (*main)(), char const *args[])
 		++argc;
 	}
 	argv[argc] = NULL;
+	return (argv);
+}
 
-	thread_execve(name, main, argc, argv);
+/*
+** Frees an argument array returned by copy_args().
+*/
+void
+free_args(char **argv)
+{
+	int argc;
 
 	argc = 0;
 	while (argv[argc]) {
@@ -149,5 +160,92 @@ sys_execve(char const *name, int (*main)(), char const *args[])
 		++argc;
 	}
 	kfree(argv);
+}
+
+/*
+** Does the execve system call.
+*/
+int
+sys_execve(char const *name, int (*main)(), char const *args[])
+{
+	char **argv;
+	int argc;
+
+	/* We need to copy args or they will point to invalid memory */
+	argv = copy_args(args);
+	argc = 0;
+	while (argv[argc]) {
+		++argc;
+	}
+
+	thread_execve(name, main, argc, argv);
+
+	free_args(argv);
+	return (0);
+}
+
+/*
+** Does the spawn system call.
+** Creates a child process running the given program, and returns it's
+** pid, or -1 if the operation failed.
+*/
+pid_t
+sys_spawn(char const *name, int (*main)(), char const *args[])
+{
+	struct thread *new;
+
+	new = thread_spawn(name, main, copy_args(args));
+	if (new) {
+		return (new->pid);
+	}
+	return (-1);
+}
+
+/*
+** Does the futex system call.
+** FUTEX_WAIT returns 0 once woken up, FUTEX_WAKE the number of threads
+** woken up, and both return -1 if the operation failed.
+*/
+int
+sys_futex(uint32 *uaddr, int op, uint32 val)
+{
+	switch (op)
+	{
+		case FUTEX_WAIT:
+			return (futex_wait(uaddr, val) == OK ? 0 : -1);
+		case FUTEX_WAKE:
+			return (futex_wake(uaddr, val));
+		default:
+			return (-1);
+	}
+}
+
+/*
+** Does the sleep system call.
+** Returns the number of seconds left, which is always 0 as sleeps
+** can't be interrupted.
+*/
+uint
+sys_sleep(uint seconds)
+{
+	timer_sleep(SEC_TO_TICKS((uint64)seconds));
+	return (0);
+}
+
+/*
+** Does the nanosleep system call.
+** The duration is rounded up to the next tick.
+*/
+int
+sys_nanosleep(struct timespec const *req)
+{
+	uint64 nb_ticks;
+
+	if (req == NULL || req->tv_nsec >= 1000000000u) {
+		return (-1);
+	}
+	nb_ticks = SEC_TO_TICKS((uint64)req->tv_sec);
+	nb_ticks += (req->tv_nsec + (1000000000u / HZ) - 1) / (1000000000u / HZ);
+	timer_sleep(nb_ticks);
 	return (0);
 }
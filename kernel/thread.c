@@ -8,61 +8,115 @@
 \* ------------------------------------------------------------------------ */
 
 #include <kernel/thread.h>
+#include <kernel/cpu.h>
 #include <kernel/kalloc.h>
+#include <kernel/init.h>
+#include <kernel/unit_tests.h>
+#include <kernel/benchmark.h>
 #include <kernel/fs.h>
 #include <kernel/syscall.h>
+#include <kernel/workqueue.h>
+#include <arch/common_op.h>
 #include <stdio.h>
 #include <string.h>
 
-/* Next pid available */
-static pid_t next_pid = 1;
+/* Thread running the boot, until the init thread is created */
+static struct thread boot_thread;
 
-/* Thread table */
-struct thread thread_table[MAX_PID];
-struct thread *init_thread = thread_table + 1;
+struct thread *init_thread;
 struct spinlock thread_table_lock;
 
+/* Virtual address space of the kernel threads */
+static struct vaspace *kernel_vaspace;
+
+/*
+** Sets the name of the given thread.
+*/
+static void
+thread_set_name(struct thread *t, char const *name)
+{
+	strncpy(t->name, name, sizeof(t->name) - 1);
+	t->name[sizeof(t->name) - 1] = '\0';
+}
+
+/*
+** Allocates a zeroed thread structure.
+** kalloc() doesn't align on cache lines, so the block is a bit larger
+** than needed and the structure is aligned within it.
+*/
+static struct thread *
+thread_alloc(void)
+{
+	struct thread *t;
+	void *alloc;
+
+	alloc = kalloc(sizeof(*t) + CACHE_LINE_SIZE - 1);
+	if (alloc == NULL) {
+		return (NULL);
+	}
+	t = (struct thread *)ALIGN((uintptr)alloc, CACHE_LINE_SIZE);
+	memset(t, 0, sizeof(*t));
+	t->alloc = alloc;
+	return (t);
+}
+
+static void
+thread_free(struct thread *t)
+{
+	assert_neq(t->alloc, NULL);
+	kfree(t->alloc);
+}
+
 /*
-** Look for the next available pid.
-** Returns -1 if no pid are available.
+** Allocates a new thread running the given entry point within the given
+** virtual address space. It isn't visible nor runnable yet.
+**
+** Returns NULL if the thread couldn't be allocated.
 */
-static pid_t
-find_next_pid(void)
+static struct thread *
+thread_setup(char const *name, thread_entry_cb entry, struct vaspace *vaspace)
 {
-	bool pass;
+	struct thread *current;
+	struct thread *t;
 	pid_t pid;
-	pid_t limit;
 
-	pass = false;
-	pid = next_pid;
-	limit = MAX_PID;
-	assert(holding_lock(&thread_table_lock));
-find_pid:
-	while (pid < limit)
-	{
-		if (thread_table[pid].state == NONE) {
-			return (pid);
-		}
-		++pid;
+	current = get_current_thread();
+	t = thread_alloc();
+	if (t == NULL) {
+		return (NULL);
 	}
-	if (!pass)
-	{
-		pid = 1;
-		limit = next_pid;
-		pass = true;
-		goto find_pid;
+
+	pid = pid_alloc();
+	if (pid == -1) {
+		thread_free(t);
+		return (NULL);
 	}
-	return (-1);
+
+	thread_set_name(t, name);
+	t->pid = pid;
+	t->entry = entry;
+	t->parent = current->parent;
+	t->affinity = CPUMASK_ALL;
+	t->cpu = current_cpu()->id;
+	wait_queue_init(&t->exit_wq);
+	init_lock(&t->lock);
+	t->vaspace = vaspace;
+	atomic_add(&t->vaspace->ref_count, 1);
+	LOCK(&current->lock, state);
+	t->cwd = strdup(current->cwd);
+	RELEASE(&current->lock, state);
+
+	arch_init_thread(t);
+	return (t);
 }
 
 /*
-** Sets the name of the given thread.
+** Returns the lowest address of the user stack of the given thread.
 */
-static void
-thread_set_name(struct thread *t, char const *name)
+static inline virt_addr_t
+thread_stack_base(struct thread const *t)
 {
-	strncpy(t->name, name, sizeof(t->name) - 1);
-	t->name[sizeof(t->name) - 1] = '\0';
+	return ((virt_addr_t)(ROUND_DOWN((uintptr)t->stack, PAGE_SIZE) + PAGE_SIZE - t->stack_size));
 }
 
 /*
@@ -76,96 +130,151 @@ struct thread *
 thread_create(char const *name, thread_entry_cb entry, size_t stack_size)
 {
 	struct thread *t;
-	pid_t pid;
-
-	LOCK_THREAD(state)
+	virt_addr_t stack;
 
-	pid = find_next_pid();
-	if (pid == -1) {
-		goto err;
+	t = thread_setup(name, entry, get_current_thread()->vaspace);
+	if (t == NULL) {
+		return (NULL);
 	}
 
-	t = thread_table + pid;
-	memset(t, 0, sizeof(*t));
-	thread_set_name(t, name);
-	t->pid = pid;
-	t->entry = entry;
-	t->state = RUNNABLE;
-	t->parent = get_current_thread()->parent;
-	t->vaspace = get_current_thread()->vaspace;
-	t->vaspace->ref_count++;
-	t->cwd = strdup(get_current_thread()->cwd);
+	stack = alloc_user_stack(stack_size);
+	assert_neq(stack, NULL);
 
 	t->stack_size = stack_size;
-	t->stack = mmap(NULL, stack_size, MMAP_USER | MMAP_WRITE);
-	assert_neq(t->stack, NULL);
-	t->stack += stack_size - 1;
-	t->stack = (void *)ROUND_DOWN((uintptr)t->stack, sizeof(void *));
+	t->stack = stack + stack_size - 1;
+	t->stack = (void *)ROUND_DOWN((uintptr)t->stack, USER_STACK_ALIGN);
 
-	arch_init_thread(t);
+	pid_hash_add(t);
+	sched_enqueue_new(t);
+	return (t);
+}
 
-	RELEASE_THREAD(state);
+/*
+** Creates a kernel thread.
+**
+** Kernel threads only run kernel code, on their kernel stack: they share
+** a virtual address space with nothing mapped in user space, and have no
+** user stack. The given data can be read back with kthread_data().
+**
+** Returns NULL if the thread couldn't be created.
+*/
+struct thread *
+kthread_create(char const *name, thread_entry_cb entry, void *data)
+{
+	struct thread *t;
+
+	assert_neq(kernel_vaspace, NULL);
+	t = thread_setup(name, entry, kernel_vaspace);
+	if (t == NULL) {
+		return (NULL);
+	}
+	t->data = data;
+
+	pid_hash_add(t);
+	sched_enqueue_new(t);
 	return (t);
+}
 
-err:
-	RELEASE_THREAD(state);
-	return (NULL);
+/*
+** Returns the data given to kthread_create() for the current thread.
+*/
+void *
+kthread_data(void)
+{
+	return (get_current_thread()->data);
 }
 
 /*
-** Fork the given thread and it's virtual space
+** Duplicates the file descriptors of the given thread, and stores their
+** number in fd_size.
+** The lock of the thread must be held.
+*/
+static struct filedesc *
+clone_fds(struct thread *old, size_t *fd_size)
+{
+	struct filedesc *fd_tab;
+	size_t i;
+
+	assert(holding_lock(&old->lock));
+	*fd_size = old->fd_size;
+	fd_tab = kalloc(old->fd_size * sizeof(*old->fd_tab));
+	assert_neq(fd_tab, NULL);
+	for (i = 0; i < old->fd_size; ++i)
+	{
+		fd_tab[i].taken = old->fd_tab[i].taken;
+		if (old->fd_tab[i].taken) {
+			fd_tab[i].handler = fs_dup_handler(old->fd_tab[i].handler);
+			assert_neq(fd_tab[i].handler, NULL);
+		}
+	}
+	return (fd_tab);
+}
+
+/*
+** Fork the given thread and it's virtual space.
+**
+** The address space and the file descriptors are cloned first, as it may
+** take a while. The new thread is only made visible at the end.
 */
 struct thread *
 thread_fork(void)
 {
 	pid_t pid;
 	struct vaspace *vaspace;
+	struct filedesc *fd_tab;
 	struct thread *new;
 	struct thread *old;
-	size_t i;
-
-	LOCK_THREAD(state);
+	void *alloc;
+	size_t fd_size;
+	char *cwd;
 
 	old = get_current_thread();
 
-	pid = find_next_pid();
+	new = thread_alloc();
+	if (new == NULL) {
+		return (NULL);
+	}
+
+	pid = pid_alloc();
 	if (pid == -1) {
-		goto err;
+		goto err_thread;
 	}
 
 	/* clone virtual address space */
+	mutex_lock(&old->vaspace->lock);
 	vaspace = arch_clone_vaspace(old->vaspace);
+	mutex_unlock(&old->vaspace->lock);
 	if (!vaspace) {
-		goto err;
+		goto err_pid;
 	}
 
-	new = thread_table + pid;
+	/* clone file descriptors and working directory */
+	LOCK(&old->lock, state);
+	fd_tab = clone_fds(old, &fd_size);
+	cwd = strdup(old->cwd);
+	RELEASE(&old->lock, state);
+
+	alloc = new->alloc;
 	memcpy(new, old, sizeof(*new));
+	new->alloc = alloc;
+	init_lock(&new->lock);
 	new->pid = pid;
-	new->state = RUNNABLE;
 	new->parent = old;
+	wait_queue_init(&new->exit_wq);
 	new->vaspace = vaspace;
-	new->cwd = strdup(old->cwd);
-
-	/* clone file descriptors */
-	new->fd_tab = kalloc(old->fd_size * sizeof(*old->fd_tab));
-	assert_neq(new->fd_tab, NULL);
-	new->fd_size = old->fd_size;
-	for (i = 0; i < old->fd_size; ++i)
-	{
-		new->fd_tab[i].taken = old->fd_tab[i].taken;
-		if (old->fd_tab[i].taken) {
-			new->fd_tab[i].handler = fs_dup_handler(old->fd_tab[i].handler);
-			assert_neq(new->fd_tab[i].handler, NULL);
-		}
-	}
+	new->cwd = cwd;
+	new->fd_tab = fd_tab;
+	new->fd_size = fd_size;
 
 	arch_init_fork_thread(new);
-
-	RELEASE_THREAD(state);
+	pid_hash_add(new);
+	sched_enqueue_new(new);
 	return (new);
-err:
-	RELEASE_THREAD(state);
+
+err_pid:
+	pid_free(pid);
+err_thread:
+	thread_free(new);
 	return (NULL);
 }
 
@@ -180,8 +289,6 @@ thread_exit(int status)
 
 	t = get_current_thread();
 
-	LOCK_THREAD(state);
-
 	assert_eq(t->state, RUNNING);
 
 	/* init should never finish */
@@ -198,30 +305,69 @@ thread_exit(int status)
 		++fd;
 	}
 
+	/* Give back the user stack, for the next thread created */
+	if (t->stack_size != 0) {
+		free_user_stack(thread_stack_base(t), t->stack_size);
+	}
+
 	/* free the virtual address space if we are the last thread using it */
-	t->vaspace->ref_count--;
-	if (t->vaspace->ref_count == 0) {
+	if (atomic_add(&t->vaspace->ref_count, -1) == 1) {
 		free_vaspace();
 	}
 
+	LOCK_THREAD(state);
 	t->exit_status = status & 0xFFu;
 	t->state = ZOMBIE;
-	thread_reschedule();
+	wait_queue_wake_all(&t->exit_wq);
+	sched_sleep();
 
 	panic("Reached end of thread_exit()"); /* We shoudln't reach this portion of code. */
 }
 
 /*
 ** Called when a zombie thread is waited. Used to free it's
-** kernel memory.
+** kernel memory and it's pid.
+** The thread lock must be held.
 */
 void
 thread_zombie_exit(struct thread *zombie)
 {
+	assert(holding_lock(&thread_table_lock));
+
+	/* It may still be running on it's kernel stack, on an other processor */
+	sched_wait_switched_out(zombie);
 	free_zombie_thread(zombie);
 	zombie->state = NONE;
-	next_pid = zombie->pid;
 	kfree(zombie->fd_tab);
+	pid_hash_remove(zombie);
+	pid_free(zombie->pid);
+	thread_free(zombie);
+}
+
+/*
+** Loads the given program in the virtual address space of the given
+** thread, which must be the current one, and sets it up to start it with
+** the given arguments.
+** The mutex of the virtual address space must be held, and the previous
+** program must already be unmapped.
+*/
+static void
+load_program(struct thread *t, int argc, char *argv[])
+{
+	/* TODO load the given binary here */
+	t->vaspace->binary_limit = PAGE_SIZE;
+
+	/* Initialize the new vaspace */
+	init_vaspace();
+
+	/* Allocate main-thread's stack */
+	t->stack = mmap(NULL, t->stack_size, MMAP_USER | MMAP_WRITE);
+	assert_neq(t->stack, NULL);
+	t->stack += t->stack_size - 1;
+	t->stack = (void *)ROUND_DOWN((uintptr)t->stack, USER_STACK_ALIGN);
+
+	/* set IP and other arch-related stuff */
+	arch_thread_execve(argc, argv);
 }
 
 /*
@@ -232,7 +378,7 @@ thread_execve(char const *name, int (*main)(), int argc, char *argv[])
 {
 	struct thread *t;
 
-	LOCK_VASPACE(state)
+	LOCK_VASPACE();
 
 	t = get_current_thread();
 	thread_set_name(t, name);
@@ -242,24 +388,88 @@ thread_execve(char const *name, int (*main)(), int argc, char *argv[])
 	assert_eq(get_current_thread()->vaspace->ref_count, 1);
 
 	free_vaspace();
+	load_program(t, argc, argv);
 
-	/* TODO load the given binary here */
-	get_current_thread()->vaspace->binary_limit = PAGE_SIZE;
+	RELEASE_VASPACE();
+	return (OK);
+}
 
-	/* Initialize the new vaspace */
-	init_vaspace();
+/*
+** Creates a child of the current thread, running the given program with
+** the given arguments, as a fork() followed by an execve() would.
+**
+** The child starts with an empty virtual address space, in which the
+** program is loaded by the child itself, on it's first run (see
+** thread_spawn_exec()): the address space of the parent is never cloned
+** only to be thrown away. The file descriptors and the working directory
+** are inherited.
+**
+** The NULL-terminated argument array, and the strings it points to, must
+** be allocated with kalloc(). They are freed by the child, or by this
+** function if it fails.
+**
+** Returns NULL if the thread couldn't be created.
+*/
+struct thread *
+thread_spawn(char const *name, int (*main)(), char *argv[])
+{
+	struct thread *current;
+	struct vaspace *vaspace;
+	struct thread *t;
 
-	/* Allocate main-thread's stack */
-	t->stack = mmap(NULL, t->stack_size, MMAP_USER | MMAP_WRITE);
-	assert_neq(t->stack, NULL);
-	t->stack += t->stack_size - 1;
-	t->stack = (void *)ROUND_DOWN((uintptr)t->stack, sizeof(void *));
+	current = get_current_thread();
+	vaspace = create_vaspace();
+	if (vaspace == NULL) {
+		goto err;
+	}
+	t = thread_setup(name, main, vaspace);
+	if (t == NULL) {
+		destroy_vaspace(vaspace);
+		goto err;
+	}
+	t->parent = current;
+	t->stack_size = current->stack_size ? current->stack_size : DEFAULT_STACK_SIZE;
+	t->data = argv;
 
-	/* set IP and other arch-related stuff */
-	arch_thread_execve(argc, argv);
+	LOCK(&current->lock, state);
+	t->fd_tab = clone_fds(current, &t->fd_size);
+	RELEASE(&current->lock, state);
 
-	RELEASE_VASPACE(state);
-	return (OK);
+	arch_init_spawn_thread(t);
+	pid_hash_add(t);
+	sched_enqueue_new(t);
+	return (t);
+
+err:
+	free_args(argv);
+	return (NULL);
+}
+
+/*
+** Loads the program of the current thread, created by thread_spawn().
+** Called by the architecture on the first run of the thread, before
+** jumping to the program.
+*/
+void
+thread_spawn_exec(void)
+{
+	struct thread *t;
+	char **argv;
+	int argc;
+
+	t = get_current_thread();
+	argv = t->data;
+	t->data = NULL;
+	argc = 0;
+	while (argv[argc]) {
+		++argc;
+	}
+
+	LOCK_VASPACE();
+	load_program(t, argc, argv);
+	RELEASE_VASPACE();
+
+	free_args(argv);
 }
 
 /*
@@ -272,7 +482,7 @@ thread_resume(struct thread *t)
 	LOCK_THREAD(state);
 	assert_neq(t->state, ZOMBIE);
 	if (t->state == SUSPENDED) {
-		t->state = RUNNABLE;
+		sched_enqueue_new(t);
 		RELEASE_THREAD(state);
 		thread_yield();
 	}
@@ -280,9 +490,25 @@ thread_resume(struct thread *t)
 		RELEASE_THREAD(state);
 }
 
+/*
+** Returns the thread with the given pid.
+** The thread lock, held by the caller, keeps it alive once it's a zombie.
+*/
+static struct thread *
+waitpid_lookup(pid_t pid)
+{
+	struct thread *t;
+
+	LOCK_PID(state);
+	t = thread_lookup(pid);
+	RELEASE_PID(state);
+	return (t);
+}
+
 /*
 ** Waits for the process with the given pid to finish.
-** Returns the exit status of the targeted process.
+** Returns the exit status of the targeted process, or -1 if it doesn't
+** exist (or was waited by an other thread meanwhile).
 */
 int
 thread_waitpid(pid_t pid)
@@ -290,20 +516,20 @@ thread_waitpid(pid_t pid)
 	struct thread *t;
 	int val;
 
-	t = thread_table + pid;
 	assert(arch_are_int_enabled());
 
-	while (42) { /* TODO This is unsafe, a wakeup() approach is safer */
-		LOCK_THREAD(state);
-		if (t->state == ZOMBIE) {
-			val = t->exit_status;
-			thread_zombie_exit(t);
-
-			RELEASE_THREAD(state);
-			return (val);
-		}
+	LOCK_THREAD(state);
+	while ((t = waitpid_lookup(pid)) != NULL && t->state != ZOMBIE) {
+		wait_queue_sleep(&t->exit_wq);
+	}
+	if (t == NULL || t->state != ZOMBIE) {
 		RELEASE_THREAD(state);
+		return (-1);
 	}
+	val = t->exit_status;
+	thread_zombie_exit(t);
+	RELEASE_THREAD(state);
+	return (val);
 }
 
 /*
@@ -313,19 +539,21 @@ thread_waitpid(pid_t pid)
 char *
 thread_getcwd(char *buff, size_t buffsize)
 {
+	struct thread *t;
 	char *path;
 	size_t path_len;
 
-	LOCK_THREAD(state);
-	path = get_current_thread()->cwd;
+	t = get_current_thread();
+	LOCK(&t->lock, state);
+	path = t->cwd;
 	path_len = strlen(path);
 	if (path_len >= buffsize) {
-		RELEASE_THREAD(state);
+		RELEASE(&t->lock, state);
 		return (NULL);
 	}
 	memcpy(buff, path, path_len);
 	buff[path_len] = '\0';
-	RELEASE_THREAD(state);
+	RELEASE(&t->lock, state);
 	return (buff);
 }
 
@@ -341,7 +569,7 @@ thread_reserve_fd(void)
 
 	i = 0;
 	t = get_current_thread();
-	LOCK_THREAD(state);
+	LOCK(&t->lock, state);
 	while (i < t->fd_size)
 	{
 		if (!t->fd_tab[i].taken) {
@@ -351,14 +579,14 @@ thread_reserve_fd(void)
 	}
 	tmp = krealloc(t->fd_tab, (i + 1) * sizeof(*t->fd_tab));
 	if (tmp == NULL) {
-		RELEASE_THREAD(state);
+		RELEASE(&t->lock, state);
 		return (-1);
 	}
 	t->fd_size = i + 1;
 	t->fd_tab = tmp;
 fd_found:
 	t->fd_tab[i].taken = true;
-	RELEASE_THREAD(state);
+	RELEASE(&t->lock, state);
 	return (i);
 }
 
@@ -369,7 +597,12 @@ fd_found:
 void
 thread_set_fd_handler(int fd, struct filehandler *hd)
 {
-	get_current_thread()->fd_tab[fd].handler = hd;
+	struct thread *t;
+
+	t = get_current_thread();
+	LOCK(&t->lock, state);
+	t->fd_tab[fd].handler = hd;
+	RELEASE(&t->lock, state);
 }
 
 /*
@@ -378,8 +611,13 @@ thread_set_fd_handler(int fd, struct filehandler *hd)
 void
 thread_free_fd(int fd)
 {
-	get_current_thread()->fd_tab[fd].taken = false;
-	get_current_thread()->fd_tab[fd].handler = NULL;
+	struct thread *t;
+
+	t = get_current_thread();
+	LOCK(&t->lock, state);
+	t->fd_tab[fd].taken = false;
+	t->fd_tab[fd].handler = NULL;
+	RELEASE(&t->lock, state);
 }
 
 /*
@@ -388,18 +626,79 @@ thread_free_fd(int fd)
 struct filehandler *
 thread_get_fd_handler(int fd)
 {
-	if (get_current_thread()->fd_tab[fd].taken)
-		return (get_current_thread()->fd_tab[fd].handler);
-	return (NULL);
+	struct filehandler *hd;
+	struct thread *t;
+
+	t = get_current_thread();
+	LOCK(&t->lock, state);
+	hd = t->fd_tab[fd].taken ? t->fd_tab[fd].handler : NULL;
+	RELEASE(&t->lock, state);
+	return (hd);
+}
+
+/* Number of threads created and waited by the create benchmark */
+# define BENCH_CREATE_ROUNDS	(1000u)
+
+static int __init
+thread_create_bench_main(void)
+{
+	return (0);
+}
+
+/*
+** Measures the cost of creating a thread, running it and waiting it, as a
+** server spawning a thread per request would do. Once the first threads
+** are gone, their kernel and user stacks are taken back from the caches.
+*/
+static void __init
+thread_create_bench(void)
+{
+	struct thread *t;
+	struct bench b;
+	uint i;
+
+	bench_start(&b);
+	for (i = 0; i < BENCH_CREATE_ROUNDS; ++i)
+	{
+		t = thread_create("bench-create", &thread_create_bench_main, DEFAULT_STACK_SIZE);
+		assert_neq(t, NULL);
+		thread_waitpid(t->pid);
+	}
+	bench_stop(&b, "thread create + exit", BENCH_CREATE_ROUNDS);
+}
+
+/*
+** First function executed by the init thread.
+**
+** It first waits until the boot thread is gone for good: it may still be
+** running init code on the boot stack, if it was preempted or put to sleep
+** after this thread was created.
+** The benchmarks are then run, while only this processor runs threads.
+** The init memory (including the boot stack) is freed before running the
+** init routine. The other processors can then start running threads.
+*/
+static int
+init_thread_main(void)
+{
+	while (boot_thread.state != NONE) {
+		thread_yield();
+	}
+	sched_wait_switched_out(&boot_thread);
+
+	run_benchmarks();
+	free_init_memory();
+	smp_boot_done();
+	return (init_routine());
 }
 
 /*
 ** Finishes the init of the thread system.
 */
-void
+void __init
 thread_init(void)
 {
 	struct thread *t;
+	pid_t init_pid;
 
 	assert(!arch_are_int_enabled());
 
@@ -409,57 +708,80 @@ thread_init(void)
 	/* This needs to be done now to prevent strdup() with null ptr */
 	get_current_thread()->cwd = strdup("/");
 
+	/* Keep the pid of init away from the kernel threads created below */
+	init_pid = pid_alloc();
+	assert_eq(init_pid, 1);
+
+	/* Kernel threads can be created from now on */
+	kernel_vaspace = setup_kernel_vaspace();
+	workqueue_init();
+
+	trigger_unit_tests(UNIT_TEST_LEVEL_PID);
+	trigger_unit_tests(UNIT_TEST_LEVEL_WAITQUEUE);
+	trigger_unit_tests(UNIT_TEST_LEVEL_MUTEX);
+	trigger_unit_tests(UNIT_TEST_LEVEL_RWLOCK);
+	trigger_unit_tests(UNIT_TEST_LEVEL_RCU);
+	trigger_unit_tests(UNIT_TEST_LEVEL_WORKQUEUE);
+	trigger_unit_tests(UNIT_TEST_LEVEL_FUTEX);
+
 	/* Create the init thread */
-	t = thread_create("init", &init_routine, DEFAULT_STACK_SIZE);
+	pid_free(init_pid);
+	t = thread_create("init", &init_thread_main, DEFAULT_STACK_SIZE);
 	assert_neq(t, NULL);
-	assert_eq(t, init_thread);
 	assert_eq(t->pid, 1);
+	init_thread = t;
+
+	/* Go through the remaining init levels */
+	kernel_init_level(CHAOS_INIT_LEVEL_KTHREADS, CHAOS_INIT_LEVEL_LATEST);
 
 	printf("[OK]\tMulti-threading\n");
 
 	/* Print HelloWorld message */
 	printf("\nWelcome to ChaOS\n\n");
 
-	/* Enable interrupts (hurrah!) */
-	arch_enable_interrupts();
-
+	/*
+	** Interrupts are enabled by the switch to the next thread (hurrah!),
+	** so no tick can switch to init while this thread still runs.
+	*/
 	LOCK_THREAD(state);
 
 	/* Remove the boot thread from the active threads */
 	get_current_thread()->state = NONE;
 
-	/* Set the init thread as runnable */
-	t->state = RUNNABLE;
-
 	/* Free the pwd */
-	kfree(t->cwd);
+	kfree(get_current_thread()->cwd);
 
 	/* Reschedule */
-	thread_reschedule();
+	sched_sleep();
 }
 
 /*
 ** Put us in some sort of thread context.
 ** Called from kmain.
 */
-void
+void __init
 thread_early_init(void)
 {
 	struct thread *t;
 
-	t = thread_table;
-	memset(thread_table, 0, sizeof(thread_table));
+	t = &boot_thread;
+	memset(t, 0, sizeof(*t));
+	sched_init();
+	pid_init();
 
 	thread_set_name(t, "boot");
-	t->pid = 0;
+	t->pid = pid_alloc();
+	assert_eq(t->pid, 0);
+	pid_hash_add(t);
+	wait_queue_init(&t->exit_wq);
+	init_lock(&t->lock);
+	t->affinity = CPUMASK_ALL;
+	t->cpu = BOOT_CPU_ID;
 	t->state = RUNNING;
 	t->vaspace = setup_boot_vaspace();
 
 	/* Set current thread */
 	set_current_thread(t);
-
-	/* Register the timer handler. */
-	register_int_handler(IRQ_TIMER_VECTOR, &irq_timer_handler);
 }
 
 /*
@@ -469,13 +791,29 @@ void
 thread_dump(void)
 {
 	struct thread *t;
+	size_t bucket;
 
-	t = thread_table;
-	while (t < thread_table + MAX_PID)
-	{
+	LOCK_THREAD(state);
+	LOCK_PID(state2);
+	pid_foreach_thread(t, bucket) {
 		if (t->state != NONE) {
-			printf("%i:[%s] - [%s]\n", t->pid, t->name, thread_state_str[t->state]);
+			printf("%i:[%s] - [%s] (nice %i, level %u)\n",
+				t->pid,
+				t->name,
+				thread_state_str[t->state],
+				t->nice,
+				t->sched_level
+			);
+			mutex_dump_stats("\tvaspace", &t->vaspace->lock);
 		}
-		++t;
 	}
+	RELEASE_PID(state2);
+	RELEASE_THREAD(state);
+	sched_dump_stats();
+	cpu_dump();
+	lock_dump_stats("thread table", &thread_table_lock);
+	lock_dump_stats("pid", &pid_lock);
+	kalloc_dump_lock_stats();
 }
+
+NEW_BENCHMARK(thread_create, &thread_create_bench);
@@ -0,0 +1,422 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#include <kernel/timer.h>
+#include <kernel/thread.h>
+#include <kernel/waitqueue.h>
+#include <kernel/spinlock.h>
+#include <kernel/init.h>
+#include <kernel/cpu.h>
+#include <kernel/unit_tests.h>
+#include <arch/common_op.h>
+#include <stdio.h>
+#include <debug.h>
+
+/*
+** Kernel timers.
+**
+** Pending timers are kept in a hashed timer wheel: each one lies in the
+** bucket given by it's expiration tick modulo TIMER_WHEEL_SIZE. At each
+** tick, only the bucket of the current tick is looked at, and the timers
+** that aren't due yet (they are at least one turn of the wheel away) are
+** left in it.
+**
+** When the CPU goes idle, the periodic tick is stopped until the next
+** timer is due (or completely if there is none). The ticks that were
+** skipped are caught up at the next interrupt, using the cycle counter.
+**
+** Only the boot processor receives the platform timer interrupt, so it's
+** the only one running the timers and stopping it's tick.
+*/
+
+static struct list_node wheel[TIMER_WHEEL_SIZE];
+static struct spinlock timer_lock;
+
+/* Monotonic number of ticks since the timer was started */
+static uint64 ticks;
+
+static size_t nb_pending;
+
+/* Set while the periodic tick is stopped */
+static bool tick_stopped;
+
+/* Cycle counter at the last tick, and average number of cycles per tick */
+static uint64 last_tick_cycles;
+static uint32 cycles_per_tick;
+
+/* Cleared when the time since the last tick can't be used to calibrate */
+static bool calibrate;
+
+extern struct spinlock thread_table_lock;
+
+static inline struct list_node *
+wheel_bucket(uint64 tick)
+{
+	return (wheel + ((uint)tick & (TIMER_WHEEL_SIZE - 1)));
+}
+
+/*
+** Returns the number of ticks since boot.
+*/
+uint64
+get_ticks(void)
+{
+	uint64 now;
+
+	LOCK(&timer_lock, state);
+	now = ticks;
+	RELEASE(&timer_lock, state);
+	return (now);
+}
+
+void
+timer_setup(struct timer *timer, timer_cb cb, void *arg)
+{
+	timer->callback = cb;
+	timer->arg = arg;
+	timer->pending = false;
+}
+
+/*
+** Arms the given timer, so it expires when the tick count reaches 'expires'.
+** A timer that is already due will expire at the next tick.
+**
+** If the tick of the boot processor is stopped, it is woken up so it
+** restarts it, as the new timer may be due before the programmed one.
+*/
+void
+timer_add(struct timer *timer, uint64 expires)
+{
+	bool kick;
+
+	LOCK(&timer_lock, state);
+	assert(!timer->pending);
+	if (expires <= ticks) {
+		expires = ticks + 1;
+	}
+	timer->expires = expires;
+	timer->pending = true;
+	nb_pending++;
+	list_add_tail(&timer->node, wheel_bucket(expires));
+	kick = tick_stopped && current_cpu()->id != BOOT_CPU_ID;
+	RELEASE(&timer_lock, state);
+
+	if (kick) {
+		arch_cpu_kick(cpus + BOOT_CPU_ID);
+	}
+}
+
+/*
+** Disarms the given timer.
+** Returns false if the timer wasn't pending (it already expired).
+*/
+bool
+timer_cancel(struct timer *timer)
+{
+	bool pending;
+
+	LOCK(&timer_lock, state);
+	pending = timer->pending;
+	if (pending) {
+		list_delete(&timer->node);
+		timer->pending = false;
+		nb_pending--;
+	}
+	RELEASE(&timer_lock, state);
+	return (pending);
+}
+
+/*
+** Increments the tick count and runs the timers that expired.
+** The callbacks are called without the timer lock held, so they can
+** re-arm their timer.
+*/
+static void
+timer_advance(void)
+{
+	struct list_node expired;
+	struct list_node *bucket;
+	struct list_node *node;
+	struct timer *timer;
+
+	LIST_INIT_HEAD(&expired);
+
+	LOCK(&timer_lock, state);
+	++ticks;
+	bucket = wheel_bucket(ticks);
+	node = bucket->next;
+	while (node != bucket)
+	{
+		timer = get_content(node, struct timer, node);
+		node = node->next;
+		if (timer->expires <= ticks) {
+			list_delete(&timer->node);
+			list_add_tail(&timer->node, &expired);
+			timer->pending = false;
+			nb_pending--;
+		}
+	}
+	RELEASE(&timer_lock, state);
+
+	while (!list_empty(&expired))
+	{
+		timer = get_content(expired.next, struct timer, node);
+		list_delete(&timer->node);
+		timer->callback(timer->arg);
+	}
+}
+
+/*
+** Returns the tick the next timer is due at, or 0 if there is no timer.
+** Timers more than one turn of the wheel away aren't looked for, the
+** tick one turn away is returned instead.
+*/
+static uint64
+next_expiry(void)
+{
+	struct timer *timer;
+	uint64 tick;
+
+	assert(holding_lock(&timer_lock));
+	if (nb_pending == 0) {
+		return (0);
+	}
+	for (tick = ticks + 1; tick <= ticks + TIMER_WHEEL_SIZE; ++tick)
+	{
+		list_foreach_content(timer, wheel_bucket(tick), node) {
+			if (timer->expires == tick) {
+				return (tick);
+			}
+		}
+	}
+	return (ticks + TIMER_WHEEL_SIZE);
+}
+
+/*
+** Stops the periodic tick until the next timer is due.
+** Called by the idle thread, with interrupts disabled, right before halting.
+** Does nothing on the application processors.
+*/
+void
+timer_nohz_enter(void)
+{
+	uint64 next;
+
+	assert(!arch_are_int_enabled());
+
+	if (current_cpu()->id != BOOT_CPU_ID) {
+		return ;
+	}
+
+	LOCK(&timer_lock, state);
+	if (tick_stopped || cycles_per_tick == 0) {
+		goto end;
+	}
+	next = next_expiry();
+	if (next == 0) {
+		platform_timer_stop();
+	} else if (next > ticks + 1) {
+		platform_timer_oneshot((uint)(next - ticks));
+	} else {
+		goto end;
+	}
+	tick_stopped = true;
+end:
+	RELEASE(&timer_lock, state);
+}
+
+/*
+** Restarts the periodic tick if it was stopped, and catches up the
+** ticks that were skipped meanwhile.
+** Called before handling any interrupt.
+*/
+void
+timer_irq_enter(uint vector)
+{
+	uint64 nb_ticks;
+
+	LOCK(&timer_lock, state);
+	if (!tick_stopped) {
+		RELEASE(&timer_lock, state);
+		return ;
+	}
+	tick_stopped = false;
+	platform_timer_periodic();
+	nb_ticks = udiv64_32(read_cycle_counter() - last_tick_cycles, cycles_per_tick);
+
+	/* The timer interrupt accounts for the last tick itself */
+	if (vector == IRQ_TIMER_VECTOR && nb_ticks > 0) {
+		nb_ticks--;
+	}
+	RELEASE(&timer_lock, state);
+
+	while (nb_ticks > 0) {
+		timer_advance();
+		nb_ticks--;
+	}
+
+	/* The next tick comes less than a period after this one */
+	LOCK(&timer_lock, state2);
+	last_tick_cycles = read_cycle_counter();
+	calibrate = false;
+	RELEASE(&timer_lock, state2);
+}
+
+/*
+** Measures the number of cycles per tick, used to catch up the ticks that
+** were skipped while the tick was stopped.
+*/
+static void
+timer_calibrate(void)
+{
+	uint64 now;
+	uint32 delta;
+
+	LOCK(&timer_lock, state);
+	now = read_cycle_counter();
+	delta = (uint32)(now - last_tick_cycles);
+	if (calibrate) {
+		if (cycles_per_tick == 0) {
+			cycles_per_tick = delta;
+		} else {
+			cycles_per_tick = cycles_per_tick - cycles_per_tick / 8u + delta / 8u;
+		}
+	}
+	last_tick_cycles = now;
+	calibrate = true;
+	RELEASE(&timer_lock, state);
+}
+
+enum handler_return
+irq_timer_handler(void)
+{
+	timer_calibrate();
+	timer_advance();
+	return (sched_tick());
+}
+
+/*
+** A thread sleeping in timer_sleep().
+** The thread only returns once woken is set, so the callback can't touch
+** it's stack after it returned.
+*/
+struct timer_sleeper
+{
+	struct wait_queue wq;
+	bool woken;
+};
+
+static void
+timer_sleep_timeout(void *arg)
+{
+	struct timer_sleeper *sleeper;
+
+	sleeper = arg;
+	LOCK_THREAD(state);
+	sleeper->woken = true;
+	wait_queue_wake_all(&sleeper->wq);
+	RELEASE_THREAD(state);
+}
+
+/*
+** Suspends the current thread for at least the given number of ticks.
+**
+** The timer isn't pending anymore as soon as it's taken out of the wheel,
+** before it's callback runs, so the woken flag is waited for instead.
+*/
+void
+timer_sleep(uint64 nb_ticks)
+{
+	struct timer_sleeper sleeper;
+	struct timer timer;
+
+	wait_queue_init(&sleeper.wq);
+	sleeper.woken = false;
+	timer_setup(&timer, &timer_sleep_timeout, &sleeper);
+
+	LOCK_THREAD(state);
+	timer_add(&timer, get_ticks() + nb_ticks);
+	while (!sleeper.woken) {
+		wait_queue_sleep(&sleeper.wq);
+	}
+	RELEASE_THREAD(state);
+}
+
+static void
+timer_test_cb(void *arg)
+{
+	++*(uint *)arg;
+}
+
+/*
+** Timer wheel tests, ticking by hand before interrupts are enabled.
+*/
+static void __init
+timer_test(void)
+{
+	struct timer first;
+	struct timer next_turn;
+	struct timer cancelled;
+	uint nb_first;
+	uint nb_next_turn;
+	uint nb_cancelled;
+	uint64 start;
+	uint i;
+
+	nb_first = 0;
+	nb_next_turn = 0;
+	nb_cancelled = 0;
+	timer_setup(&first, &timer_test_cb, &nb_first);
+	timer_setup(&next_turn, &timer_test_cb, &nb_next_turn);
+	timer_setup(&cancelled, &timer_test_cb, &nb_cancelled);
+
+	start = get_ticks();
+	timer_add(&first, start + 1);
+	timer_add(&next_turn, start + 1 + TIMER_WHEEL_SIZE);
+	timer_add(&cancelled, start + 5);
+	assert(timer_cancel(&cancelled));
+	assert(!timer_cancel(&cancelled));
+
+	/* Same bucket, but only the first one is due */
+	timer_advance();
+	assert_eq(nb_first, 1);
+	assert_eq(nb_next_turn, 0);
+	assert(!first.pending);
+	assert(next_turn.pending);
+
+	for (i = 0; i < TIMER_WHEEL_SIZE; ++i) {
+		timer_advance();
+	}
+	assert_eq(get_ticks(), start + 1 + TIMER_WHEEL_SIZE);
+	assert_eq(nb_first, 1);
+	assert_eq(nb_next_turn, 1);
+	assert_eq(nb_cancelled, 0);
+	assert(!timer_cancel(&next_turn));
+
+	/* Timers in the past expire at the next tick */
+	timer_add(&first, start);
+	timer_advance();
+	assert_eq(nb_first, 2);
+}
+
+static void __init
+timer_init(enum init_level il __unused)
+{
+	size_t i;
+
+	init_lock(&timer_lock);
+	for (i = 0; i < TIMER_WHEEL_SIZE; ++i) {
+		LIST_INIT_HEAD(wheel + i);
+	}
+	trigger_unit_tests(UNIT_TEST_LEVEL_TIMER);
+	register_int_handler(IRQ_TIMER_VECTOR, &irq_timer_handler);
+}
+
+NEW_INIT_HOOK(timer, &timer_init, CHAOS_INIT_LEVEL_ARCH);
+NEW_UNIT_TEST(timer, &timer_test, UNIT_TEST_LEVEL_TIMER);
@@ -15,7 +15,7 @@
 extern struct unit_test_hook const __start_chaos_unit_tests[] __weak;
 extern struct unit_test_hook const __stop_chaos_unit_tests[] __weak;
 
-static void
+static void __init
 trigger_unit_test_hooks(enum unit_test_level utl)
 {
 	struct unit_test_hook const *hook;
@@ -30,7 +30,7 @@ trigger_unit_test_hooks(enum unit_test_level utl)
 	}
 }
 
-void
+void __init
 trigger_unit_tests(enum unit_test_level utl)
 {
 	if (cmd_options.unit_test)
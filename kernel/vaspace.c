@@ -10,10 +10,14 @@
 #include <kernel/vaspace.h>
 #include <kernel/thread.h>
 #include <kernel/kalloc.h>
+#include <kernel/interrupts.h>
 #include <string.h>
 
 struct vaspace boot_vaspace; /* virtual address space of boot and init. */
 
+/* Virtual address space of the kernel threads, with nothing in user space */
+static struct vaspace kernel_vaspace;
+
 /*
 ** Set up a new virtual address space
 **
@@ -29,16 +33,55 @@ init_vaspace(void)
 
 	arch_init_vaspace();
 
+	LOCK_SEQ(&vaspace->layout, state);
 	vaspace->mmapping_start = KERNEL_VIRTUAL_BASE - PAGE_SIZE;
 	vaspace->mmapping_size = 0;
 
 	vaspace->heap_start = (void *)ALIGN(vaspace->binary_limit + PAGE_SIZE, PAGE_SIZE);
 	vaspace->heap_size = 0;
+	RELEASE_SEQ(&vaspace->layout, state);
+
+	vaspace->nb_free_stacks = 0;
 
 	/* Allocate the first heap page or the ubrk algorithm will not work. */
 	assert_neq(mmap(vaspace->heap_start, PAGE_SIZE, MMAP_USER | MMAP_WRITE), NULL);
 }
 
+/*
+** Creates a new virtual address space, with nothing mapped in user space.
+** Returns NULL if there isn't enough memory.
+*/
+struct vaspace *
+create_vaspace(void)
+{
+	struct vaspace *vas;
+
+	vas = kalloc(sizeof(*vas));
+	if (vas == NULL) {
+		return (NULL);
+	}
+	memset(vas, 0, sizeof(*vas));
+	mutex_init(&vas->lock);
+	seqlock_init(&vas->layout);
+	if (arch_init_kernel_vaspace(vas) != OK) {
+		kfree(vas);
+		return (NULL);
+	}
+	return (vas);
+}
+
+/*
+** Frees a virtual address space returned by create_vaspace() that was
+** never used by any thread.
+*/
+void
+destroy_vaspace(struct vaspace *vas)
+{
+	assert_eq(vas->ref_count, 0);
+	arch_destroy_vaspace(vas);
+	kfree(vas);
+}
+
 /*
 ** Clone the given virtual space into a new one.
 ** Returns NULL if the clone failed.
@@ -68,6 +111,65 @@ free_vaspace(void)
 	arch_free_vaspace();
 }
 
+/*
+** Allocates a user stack of the given size in the current virtual address
+** space.
+**
+** The stack regions of the exited threads are kept in the virtual address
+** space and given back here first: it saves mapping (and faulting in) the
+** pages again, and the memory mapping segment, whose holes are never
+** reused, doesn't keep growing when threads come and go.
+**
+** Returns NULL if there isn't enough memory.
+*/
+virt_addr_t
+alloc_user_stack(size_t size)
+{
+	struct vaspace *vaspace;
+	virt_addr_t base;
+	uint i;
+
+	vaspace = get_current_thread()->vaspace;
+	base = NULL;
+	LOCK_VASPACE();
+	i = vaspace->nb_free_stacks;
+	while (i > 0)
+	{
+		--i;
+		if (vaspace->free_stacks[i].size == size) {
+			base = vaspace->free_stacks[i].base;
+			vaspace->free_stacks[i] = vaspace->free_stacks[--vaspace->nb_free_stacks];
+			break;
+		}
+	}
+	if (base == NULL) {
+		base = mmap(NULL, size, MMAP_USER | MMAP_WRITE);
+	}
+	RELEASE_VASPACE();
+	return (base);
+}
+
+/*
+** Gives back the user stack of the given base and size, of the current
+** virtual address space, so it can be reused by alloc_user_stack().
+*/
+void
+free_user_stack(virt_addr_t base, size_t size)
+{
+	struct vaspace *vaspace;
+
+	vaspace = get_current_thread()->vaspace;
+	LOCK_VASPACE();
+	if (vaspace->nb_free_stacks < USER_STACK_CACHE_SIZE) {
+		vaspace->free_stacks[vaspace->nb_free_stacks].base = base;
+		vaspace->free_stacks[vaspace->nb_free_stacks].size = size;
+		++vaspace->nb_free_stacks;
+	} else {
+		munmap(base, size);
+	}
+	RELEASE_VASPACE();
+}
+
 /*
 ** Called by thread_zombie_exit() when waiting for a zombie thread.
 ** Used to finish cleaning up this thread, by freeing it's kernel memory.
@@ -91,9 +193,27 @@ setup_boot_vaspace(void)
 {
 	memset(&boot_vaspace, 0, sizeof(boot_vaspace));
 
-	init_lock(&boot_vaspace.lock);
+	mutex_init(&boot_vaspace.lock);
+	seqlock_init(&boot_vaspace.layout);
 	boot_vaspace.binary_limit = PAGE_SIZE; /* boot doesn't have a binary */
 	boot_vaspace.ref_count = 0;
 
 	return (&boot_vaspace);
 }
+
+/*
+** Sets up the virtual address space shared by the kernel threads.
+** It holds a reference on itself, so it's never freed.
+*/
+struct vaspace *
+setup_kernel_vaspace(void)
+{
+	memset(&kernel_vaspace, 0, sizeof(kernel_vaspace));
+
+	mutex_init(&kernel_vaspace.lock);
+	seqlock_init(&kernel_vaspace.layout);
+	kernel_vaspace.ref_count = 1;
+	assert_eq(arch_init_kernel_vaspace(&kernel_vaspace), OK);
+
+	return (&kernel_vaspace);
+}
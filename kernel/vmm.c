@@ -29,6 +29,10 @@ size_t kernel_heap_size;
 ** the destination address.
 ** Size must be page aligned.
 **
+** User mappings are protected by the mutex of the current virtual
+** address space, so this may sleep. Kernel mappings are done by the
+** kernel heap, under it's own lock, and never sleep.
+**
 ** Returns the virtual address holding the mapping, or NULL if
 ** it fails.
 **
@@ -40,11 +44,15 @@ mmap(virt_addr_t va, size_t size, mmap_flags_t flags)
 {
 	virt_addr_t ori_va;
 	struct vaspace *vaspace;
+	bool user;
 
 	assert(IS_PAGE_ALIGNED(va));
 	assert(IS_PAGE_ALIGNED(size));
 
-	LOCK_VASPACE(state);
+	user = (va < KERNEL_VIRTUAL_BASE);
+	if (user) {
+		LOCK_VASPACE();
+	}
 
 	ori_va = va;
 	if (va == NULL) /* Allocate on the memory mapping segment */
@@ -53,7 +61,9 @@ mmap(virt_addr_t va, size_t size, mmap_flags_t flags)
 		vaspace = get_current_thread()->vaspace;
 		ori_va = mmap((char *)vaspace->mmapping_start - vaspace->mmapping_size - size + PAGE_SIZE, size, flags);
 		if (ori_va != NULL) {
+			LOCK_SEQ(&vaspace->layout, state);
 			vaspace->mmapping_size += size;
+			RELEASE_SEQ(&vaspace->layout, state);
 		}
 		goto ok_ret;
 	}
@@ -71,11 +81,15 @@ mmap(virt_addr_t va, size_t size, mmap_flags_t flags)
 	}
 
 ok_ret:
-	RELEASE_VASPACE(state);
+	if (user) {
+		RELEASE_VASPACE();
+	}
 	return (ori_va);
 
 err_ret:
-	RELEASE_VASPACE(state);
+	if (user) {
+		RELEASE_VASPACE();
+	}
 	return (NULL);
 }
 
@@ -86,15 +100,24 @@ void
 munmap(virt_addr_t va, size_t size)
 {
 	virt_addr_t ori_va;
+	bool user;
 
 	assert(IS_PAGE_ALIGNED(va));
 	assert(IS_PAGE_ALIGNED(size));
+
+	user = (va < KERNEL_VIRTUAL_BASE);
+	if (user) {
+		LOCK_VASPACE();
+	}
 	ori_va = va;
 	while (va < ori_va + size)
 	{
 		arch_munmap_va(va);
 		va += PAGE_SIZE;
 	}
+	if (user) {
+		RELEASE_VASPACE();
+	}
 }
 
 /*
@@ -164,7 +187,7 @@ ubrk(virt_addr_t new_brk)
 	intptr round_add;
 	struct vaspace *vaspace;
 
-	LOCK_VASPACE(state);
+	LOCK_VASPACE();
 	vaspace = get_current_thread()->vaspace;
 	if (new_brk >= vaspace->heap_start)
 	{
@@ -172,27 +195,32 @@ ubrk(virt_addr_t new_brk)
 		new_brk = (virt_addr_t)ROUND_DOWN((uintptr)new_brk, PAGE_SIZE);
 		brk = (virt_addr_t)(ROUND_DOWN((uintptr)(vaspace->heap_start + vaspace->heap_size), PAGE_SIZE));
 		round_add = new_brk - brk;
-		vaspace->heap_size += add;
 		if (round_add > 0)
 		{
 			if (unlikely(mmap(brk + PAGE_SIZE, round_add, MMAP_USER | MMAP_WRITE) == NULL)) {
-				vaspace->heap_size -= add;
-				RELEASE_VASPACE(state);
+				RELEASE_VASPACE();
 				return (ERR_NO_MEMORY);
 			}
 		}
-		else if (round_add < 0) {
+
+		/* The new break is published once the pages are mapped */
+		LOCK_SEQ(&vaspace->layout, state);
+		vaspace->heap_size += add;
+		RELEASE_SEQ(&vaspace->layout, state);
+
+		if (round_add < 0) {
 			munmap(brk + round_add + PAGE_SIZE, -round_add);
 		}
-		RELEASE_VASPACE(state);
+		RELEASE_VASPACE();
 		return (OK);
 	}
-	RELEASE_VASPACE(state);
+	RELEASE_VASPACE();
 	return (ERR_INVALID_ARGS);
 }
 
 /*
 ** Increments or decrement the user heap of 'inc' bytes.
+** Reading the current break, the common case, doesn't take the mutex.
 ** TODO Make this function safer (overflow, bounds)
 */
 virt_addr_t
@@ -200,15 +228,24 @@ usbrk(intptr inc)
 {
 	void *old_brk;
 	struct vaspace *vaspace;
+	uint seq;
 
 	vaspace = get_current_thread()->vaspace;
-	LOCK_VASPACE(state);
+	if (inc == 0) {
+		do {
+			seq = read_seqbegin(&vaspace->layout);
+			old_brk = vaspace->heap_start + vaspace->heap_size;
+		} while (read_seqretry(&vaspace->layout, seq));
+		return (old_brk);
+	}
+
+	LOCK_VASPACE();
 	old_brk = vaspace->heap_start + vaspace->heap_size;
 	if (ubrk(vaspace->heap_start + vaspace->heap_size + inc) == OK) {
-		RELEASE_VASPACE(state);
+		RELEASE_VASPACE();
 		return (old_brk);
 	}
-	RELEASE_VASPACE(state);
+	RELEASE_VASPACE();
 	return ((virt_addr_t)-1u);
 }
 
@@ -216,7 +253,7 @@ usbrk(intptr inc)
 ** Initalises the arch-independant stuff of virtual memory management.
 ** Calls the arch-dependent vmm init function.
 */
-static void
+static void __init
 vmm_init(enum init_level il __unused)
 {
 	/* Some assertions that can't be static_assert() */
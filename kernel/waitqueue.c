@@ -0,0 +1,169 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#include <kernel/waitqueue.h>
+#include <kernel/thread.h>
+#include <kernel/spinlock.h>
+#include <kernel/interrupts.h>
+#include <kernel/unit_tests.h>
+#include <debug.h>
+
+extern struct spinlock thread_table_lock;
+
+/*
+** Sleeping threads are linked through their run queue node, as they
+** can't be runnable and waiting at the same time.
+*/
+
+void
+wait_queue_init(struct wait_queue *wq)
+{
+	LIST_INIT_HEAD(&wq->waiters);
+}
+
+/*
+** Suspends the current thread until the given wait queue is woken up.
+**
+** The caller must hold the thread lock once. It is released while the
+** thread sleeps, and held again when this function returns. The condition
+** the caller is waiting for should be checked again, as an other thread
+** may have consumed it in between.
+*/
+void
+wait_queue_sleep(struct wait_queue *wq)
+{
+	struct thread *t;
+
+	assert(holding_lock(&thread_table_lock));
+
+	t = get_current_thread();
+	assert_eq(t->state, RUNNING);
+	t->state = SUSPENDED;
+	list_add_tail(&t->rq_node, &wq->waiters);
+	sched_sleep();
+}
+
+/*
+** Makes runnable the thread that waited the longest on the given queue.
+** It starts again from it's base priority level, as it was probably
+** waiting for some I/O.
+**
+** Returns false if there was no thread to wake up.
+*/
+bool
+wait_queue_wake_one(struct wait_queue *wq)
+{
+	struct thread *t;
+	bool woken;
+
+	LOCK_THREAD(state);
+	woken = !list_empty(&wq->waiters);
+	if (woken) {
+		t = get_content(wq->waiters.next, struct thread, rq_node);
+		list_delete(&t->rq_node);
+		sched_enqueue_new(t);
+	}
+	RELEASE_THREAD(state);
+	return (woken);
+}
+
+/*
+** Makes runnable all the threads waiting on the given queue.
+** Returns the number of threads woken up.
+*/
+size_t
+wait_queue_wake_all(struct wait_queue *wq)
+{
+	size_t nb;
+
+	LOCK_THREAD(state);
+	nb = 0;
+	while (wait_queue_wake_one(wq)) {
+		++nb;
+	}
+	RELEASE_THREAD(state);
+	return (nb);
+}
+
+static struct wait_queue waitqueue_test_wq = WAIT_QUEUE_INIT_VALUE(waitqueue_test_wq);
+static uint waitqueue_test_asleep[2];
+static uint waitqueue_test_woken[2];
+static uint volatile waitqueue_test_nb_asleep;
+static uint volatile waitqueue_test_nb_woken;
+
+static int __init
+waitqueue_test_main(void)
+{
+	uint id;
+
+	id = (uint)(uintptr)kthread_data();
+	LOCK_THREAD(state);
+	waitqueue_test_asleep[waitqueue_test_nb_asleep++] = id;
+	wait_queue_sleep(&waitqueue_test_wq);
+	waitqueue_test_woken[waitqueue_test_nb_woken++] = id;
+	RELEASE_THREAD(state);
+	return (0);
+}
+
+/*
+** Yields until the given counter of the wait queue test reaches the
+** given value.
+*/
+static void __init
+waitqueue_test_wait(uint volatile *counter, uint value)
+{
+	while (*counter != value) {
+		thread_yield();
+	}
+}
+
+/*
+** Wait queue tests, with two threads of the current processor sleeping on
+** the same queue.
+*/
+static void __init
+waitqueue_test(void)
+{
+	struct thread *threads[2];
+	int_state_t int_state;
+	uint i;
+
+	waitqueue_test_nb_asleep = 0;
+	waitqueue_test_nb_woken = 0;
+	assert(!wait_queue_wake_one(&waitqueue_test_wq));
+	assert_eq(wait_queue_wake_all(&waitqueue_test_wq), 0);
+
+	for (i = 0; i < 2; ++i) {
+		threads[i] = kthread_create("waitqueue-test", &waitqueue_test_main, (void *)(uintptr)i);
+		assert_neq(threads[i], NULL);
+		assert_eq(thread_set_affinity(threads[i], CPUMASK_CPU(current_cpu()->id)), OK);
+	}
+	waitqueue_test_wait(&waitqueue_test_nb_asleep, 2);
+
+	/* The thread that waited the longest is woken up first */
+	assert(wait_queue_wake_one(&waitqueue_test_wq));
+	waitqueue_test_wait(&waitqueue_test_nb_woken, 1);
+	assert_eq(waitqueue_test_woken[0], waitqueue_test_asleep[0]);
+
+	/* Then all the remaining ones */
+	assert_eq(wait_queue_wake_all(&waitqueue_test_wq), 1);
+	waitqueue_test_wait(&waitqueue_test_nb_woken, 2);
+	assert_eq(waitqueue_test_woken[1], waitqueue_test_asleep[1]);
+	assert(!wait_queue_wake_one(&waitqueue_test_wq));
+
+	/* thread_waitpid() expects interrupts to be enabled */
+	arch_push_interrupts(&int_state);
+	arch_enable_interrupts();
+	for (i = 0; i < 2; ++i) {
+		assert_eq(thread_waitpid(threads[i]->pid), 0);
+	}
+	arch_pop_interrupts(&int_state);
+}
+
+NEW_UNIT_TEST(waitqueue, &waitqueue_test, UNIT_TEST_LEVEL_WAITQUEUE);
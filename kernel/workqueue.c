@@ -0,0 +1,309 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#include <kernel/workqueue.h>
+#include <kernel/thread.h>
+#include <kernel/kalloc.h>
+#include <kernel/unit_tests.h>
+#include <kernel/interrupts.h>
+#include <debug.h>
+
+/*
+** Work queues, to defer work to thread context.
+**
+** Interrupt handlers run with interrupts disabled, so they should only do
+** what can't wait (acknowledging the device, reading it's data) and queue
+** the rest. Each queue has a kernel thread, it's worker, that runs the
+** queued works one after the other.
+**
+** The list of a queue is protected by it's own lock, which interrupt
+** handlers can take. The worker sleeps on a wait queue, so it's protected
+** by the thread lock against missed wake-ups.
+** The state of the delayed works is protected by the delayed work lock,
+** taken before the lock of a queue.
+*/
+
+extern struct spinlock thread_table_lock;
+
+static struct spinlock delayed_work_lock;
+
+/* Queue shared by the drivers, for short works */
+struct workqueue *system_wq;
+
+void
+work_init(struct work *work, work_cb func, void *arg)
+{
+	work->node.next = NULL;
+	work->node.prev = NULL;
+	work->func = func;
+	work->arg = arg;
+	work->wq = NULL;
+}
+
+static void
+delayed_work_timeout(void *arg)
+{
+	struct delayed_work *dw;
+
+	dw = arg;
+	LOCK(&delayed_work_lock, state);
+	if (dw->target != NULL) {
+		queue_work(dw->target, &dw->work);
+	}
+	dw->armed = false;
+	RELEASE(&delayed_work_lock, state);
+}
+
+void
+delayed_work_init(struct delayed_work *dw, work_cb func, void *arg)
+{
+	work_init(&dw->work, func, arg);
+	timer_setup(&dw->timer, &delayed_work_timeout, dw);
+	dw->target = NULL;
+	dw->armed = false;
+}
+
+/*
+** Queues the given work at the end of the given queue, and wakes up it's
+** worker. May be called from an interrupt handler.
+**
+** Returns false if the work was already pending.
+*/
+bool
+queue_work(struct workqueue *wq, struct work *work)
+{
+	LOCK(&wq->lock, state);
+	if (work->wq != NULL) {
+		RELEASE(&wq->lock, state);
+		return (false);
+	}
+	work->wq = wq;
+	list_add_tail(&work->node, &wq->works);
+	RELEASE(&wq->lock, state);
+
+	wait_queue_wake_one(&wq->waiters);
+	return (true);
+}
+
+/*
+** Queues the given work once the given number of ticks passed.
+**
+** Returns false if the work was already pending.
+*/
+bool
+queue_delayed_work(struct workqueue *wq, struct delayed_work *dw, uint64 delay)
+{
+	bool queued;
+
+	LOCK(&delayed_work_lock, state);
+	queued = !dw->armed && dw->work.wq == NULL;
+	if (queued) {
+		dw->armed = true;
+		dw->target = wq;
+		timer_add(&dw->timer, get_ticks() + delay);
+	}
+	RELEASE(&delayed_work_lock, state);
+	return (queued);
+}
+
+/*
+** Removes the given work from the queue it's pending on.
+** A work that is already running isn't waited for.
+**
+** Returns false if it wasn't pending.
+*/
+bool
+cancel_work(struct work *work)
+{
+	struct workqueue *wq;
+	bool pending;
+
+	wq = work->wq;
+	if (wq == NULL) {
+		return (false);
+	}
+	LOCK(&wq->lock, state);
+	pending = (work->wq == wq);
+	if (pending) {
+		list_delete(&work->node);
+		work->wq = NULL;
+	}
+	RELEASE(&wq->lock, state);
+	return (pending);
+}
+
+/*
+** A delayed work whose timer already expired, but that isn't queued yet,
+** is cancelled too: the timer callback won't queue it.
+*/
+bool
+cancel_delayed_work(struct delayed_work *dw)
+{
+	bool pending;
+
+	LOCK(&delayed_work_lock, state);
+	if (dw->armed && dw->target != NULL) {
+		if (timer_cancel(&dw->timer)) {
+			dw->armed = false;
+		}
+		dw->target = NULL;
+		pending = true;
+	} else {
+		pending = cancel_work(&dw->work);
+	}
+	RELEASE(&delayed_work_lock, state);
+	return (pending);
+}
+
+/*
+** Waits until the given queue is empty and it's worker idle.
+*/
+void
+flush_workqueue(struct workqueue *wq)
+{
+	LOCK_THREAD(state);
+	while (!list_empty(&wq->works) || wq->running != NULL) {
+		wait_queue_sleep(&wq->flushers);
+	}
+	RELEASE_THREAD(state);
+}
+
+/*
+** Main loop of the worker of a queue.
+*/
+static int
+worker_main(void)
+{
+	struct workqueue *wq;
+	struct work *work;
+
+	wq = kthread_data();
+	while (42)
+	{
+		LOCK(&wq->lock, state);
+		work = NULL;
+		if (!list_empty(&wq->works)) {
+			work = get_content(wq->works.next, struct work, node);
+			list_delete(&work->node);
+			work->wq = NULL;
+		}
+		wq->running = work;
+		RELEASE(&wq->lock, state);
+
+		if (work != NULL) {
+			work->func(work->arg);
+			continue ;
+		}
+
+		LOCK_THREAD(state2);
+		wait_queue_wake_all(&wq->flushers);
+		while (list_empty(&wq->works)) {
+			wait_queue_sleep(&wq->waiters);
+		}
+		RELEASE_THREAD(state2);
+	}
+	return (0);
+}
+
+/*
+** Creates a new queue, and it's worker thread with the given name.
+** Returns NULL if it failed.
+*/
+struct workqueue *
+create_workqueue(char const *name)
+{
+	struct workqueue *wq;
+
+	wq = kalloc(sizeof(*wq));
+	if (wq == NULL) {
+		return (NULL);
+	}
+	init_lock(&wq->lock);
+	LIST_INIT_HEAD(&wq->works);
+	wq->running = NULL;
+	wait_queue_init(&wq->waiters);
+	wait_queue_init(&wq->flushers);
+	wq->worker = kthread_create(name, &worker_main, wq);
+	if (wq->worker == NULL) {
+		kfree(wq);
+		return (NULL);
+	}
+	return (wq);
+}
+
+static void
+workqueue_test_cb(void *arg)
+{
+	++*(uint *)arg;
+}
+
+/*
+** Work queue tests.
+** The worker enables interrupts when it first runs, so the boot thread may
+** be preempted from then on: the checks that rely on the worker or the
+** timer not running in between are done with interrupts disabled.
+*/
+static void __init
+workqueue_test(void)
+{
+	struct delayed_work dw;
+	struct work work;
+	int_state_t int_state;
+	uint nb;
+	uint nb_delayed;
+
+	nb = 0;
+	work_init(&work, &workqueue_test_cb, &nb);
+	assert(queue_work(system_wq, &work));
+	assert(!queue_work(system_wq, &work));
+	flush_workqueue(system_wq);
+	assert_eq(nb, 1);
+	assert(!cancel_work(&work));
+
+	/* Cancelled before the worker runs */
+	arch_push_interrupts(&int_state);
+	arch_disable_interrupts();
+	assert(queue_work(system_wq, &work));
+	assert(cancel_work(&work));
+	arch_pop_interrupts(&int_state);
+	flush_workqueue(system_wq);
+	assert_eq(nb, 1);
+
+	/* Queued again once cancelled */
+	assert(queue_work(system_wq, &work));
+	flush_workqueue(system_wq);
+	assert_eq(nb, 2);
+
+	/* Delayed work stays out of the queue until it's timer expires */
+	nb_delayed = 0;
+	delayed_work_init(&dw, &workqueue_test_cb, &nb_delayed);
+	arch_push_interrupts(&int_state);
+	arch_disable_interrupts();
+	assert(queue_delayed_work(system_wq, &dw, 10));
+	assert(!queue_delayed_work(system_wq, &dw, 10));
+	assert(list_empty(&system_wq->works));
+	assert(cancel_delayed_work(&dw));
+	assert(!cancel_delayed_work(&dw));
+	arch_pop_interrupts(&int_state);
+	flush_workqueue(system_wq);
+	assert_eq(nb_delayed, 0);
+}
+
+/*
+** Creates the system queue.
+*/
+void __init
+workqueue_init(void)
+{
+	init_lock(&delayed_work_lock);
+	system_wq = create_workqueue("kworker");
+	assert_neq(system_wq, NULL);
+}
+
+NEW_UNIT_TEST(workqueue, &workqueue_test, UNIT_TEST_LEVEL_WORKQUEUE);
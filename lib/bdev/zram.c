@@ -0,0 +1,439 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#include <kernel/init.h>
+#include <kernel/kalloc.h>
+#include <kernel/multiboot.h>
+#include <kernel/swap.h>
+#include <kernel/unit_tests.h>
+#include <lib/bdev/zram.h>
+#include <arch/common_op.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+** A block device storing it's content compressed in kernel memory.
+**
+** It is meant to be used as a swap device, to trade some CPU time for RAM
+** instead of hitting the disk. Therefore it works with page-sized blocks,
+** and each block is stored in one of the following ways:
+**   - Pages filled with the same word (usually zeroes) are stored within
+**     their slot, without using any memory.
+**   - Other pages are compressed using LZ4, or stored as is if they don't
+**     compress well.
+*/
+
+static void
+zram_update_latency(uint32 *avg, uint32 *max, uint64 start)
+{
+	uint32 cycles;
+
+	cycles = (uint32)(read_cycle_counter() - start);
+	*avg = *avg - *avg / 8u + cycles / 8u;
+	*max = cycles > *max ? cycles : *max;
+}
+
+/*
+** Returns true if the given page is filled with the same word, which is
+** stored in 'fill'.
+*/
+static bool
+zram_is_same_filled(uint32 const *page, uint32 *fill)
+{
+	size_t i;
+
+	i = 1;
+	while (i < PAGE_SIZE / sizeof(uint32)) {
+		if (page[i] != page[0]) {
+			return (false);
+		}
+		++i;
+	}
+	*fill = page[0];
+	return (true);
+}
+
+static void
+zram_free_slot(struct zram_bdev *zram, struct zram_slot *slot)
+{
+	switch (slot->type)
+	{
+	case ZRAM_SLOT_EMPTY:
+		return ;
+	case ZRAM_SLOT_SAME_FILLED:
+		zram->stats.nb_same_filled--;
+		break;
+	case ZRAM_SLOT_RAW:
+		zram->stats.nb_raw--;
+		/* Fallthrough */
+	case ZRAM_SLOT_COMPRESSED:
+		zram->stats.compr_size -= slot->size;
+		kfree(slot->data);
+		break;
+	}
+	zram->stats.nb_stored--;
+	zram->stats.orig_size -= PAGE_SIZE;
+	memset(slot, 0, sizeof(*slot));
+}
+
+/*
+** Stores the given page in the given slot.
+*/
+static bool
+zram_store_page(struct zram_bdev *zram, struct zram_slot *slot, void const *page)
+{
+	struct zram_slot new;
+	size_t size;
+
+	memset(&new, 0, sizeof(new));
+	if (zram_is_same_filled(page, &new.fill)) {
+		new.type = ZRAM_SLOT_SAME_FILLED;
+		zram->stats.nb_same_filled++;
+		goto store;
+	}
+
+	/*
+	** The device may be used to swap out a page on behalf of kalloc()
+	** itself, in which case no memory can be allocated.
+	*/
+	if (kalloc_busy()) {
+		return (false);
+	}
+
+	size = lz4_compress(page, PAGE_SIZE, zram->buffer, ZRAM_MAX_COMPRESSED, zram->ctx);
+	new.type = size ? ZRAM_SLOT_COMPRESSED : ZRAM_SLOT_RAW;
+	new.size = size ? size : PAGE_SIZE;
+	new.data = kalloc(new.size);
+	if (new.data == NULL) {
+		return (false);
+	}
+	memcpy(new.data, size ? zram->buffer : page, new.size);
+	zram->stats.nb_raw += (new.type == ZRAM_SLOT_RAW);
+	zram->stats.compr_size += new.size;
+
+store:
+	zram_free_slot(zram, slot);
+	zram->stats.nb_stored++;
+	zram->stats.orig_size += PAGE_SIZE;
+	*slot = new;
+	return (true);
+}
+
+/*
+** Loads the page stored in the given slot.
+** Empty slots read as zeroes.
+*/
+static bool
+zram_load_page(struct zram_slot const *slot, void *page)
+{
+	size_t i;
+
+	switch (slot->type)
+	{
+	case ZRAM_SLOT_EMPTY:
+		memset(page, 0, PAGE_SIZE);
+		break;
+	case ZRAM_SLOT_SAME_FILLED:
+		i = 0;
+		while (i < PAGE_SIZE / sizeof(uint32)) {
+			((uint32 *)page)[i] = slot->fill;
+			++i;
+		}
+		break;
+	case ZRAM_SLOT_COMPRESSED:
+		return (lz4_decompress(slot->data, slot->size, page, PAGE_SIZE) == PAGE_SIZE);
+	case ZRAM_SLOT_RAW:
+		memcpy(page, slot->data, PAGE_SIZE);
+		break;
+	}
+	return (true);
+}
+
+static ssize_t
+zram_read(struct bdev *bdev, void *buf, size_t offset, size_t len)
+{
+	struct zram_bdev *zram;
+	uint64 start;
+	size_t done;
+
+	zram = (struct zram_bdev *)bdev;
+	if (!IS_PAGE_ALIGNED(offset) || !IS_PAGE_ALIGNED(len)) {
+		return (-1);
+	}
+
+	done = 0;
+	LOCK(&zram->lock, state);
+	while (done < len)
+	{
+		start = read_cycle_counter();
+		if (!zram_load_page(zram->slots + (offset + done) / PAGE_SIZE, (uchar *)buf + done)) {
+			break;
+		}
+		zram->stats.nb_reads++;
+		zram_update_latency(&zram->stats.read_latency, &zram->stats.max_read_latency, start);
+		done += PAGE_SIZE;
+	}
+	RELEASE(&zram->lock, state);
+	return (done);
+}
+
+static ssize_t
+zram_write(struct bdev *bdev, void const *buf, size_t offset, size_t len)
+{
+	struct zram_bdev *zram;
+	uint64 start;
+	size_t done;
+
+	zram = (struct zram_bdev *)bdev;
+	if (!IS_PAGE_ALIGNED(offset) || !IS_PAGE_ALIGNED(len)) {
+		return (-1);
+	}
+
+	done = 0;
+	LOCK(&zram->lock, state);
+	while (done < len)
+	{
+		start = read_cycle_counter();
+		if (!zram_store_page(zram, zram->slots + (offset + done) / PAGE_SIZE, (uchar const *)buf + done)) {
+			zram->stats.nb_failed_writes++;
+			break;
+		}
+		zram->stats.nb_writes++;
+		zram_update_latency(&zram->stats.write_latency, &zram->stats.max_write_latency, start);
+		done += PAGE_SIZE;
+	}
+	RELEASE(&zram->lock, state);
+	return (done);
+}
+
+static void
+zram_close(struct bdev *bdev)
+{
+	struct zram_bdev *zram;
+	size_t i;
+
+	zram = (struct zram_bdev *)bdev;
+	i = 0;
+	while (i < zram->nb_slots) {
+		zram_free_slot(zram, zram->slots + i);
+		++i;
+	}
+	kfree(zram->slots);
+	kfree(zram->ctx);
+	kfree(zram->buffer);
+	kfree(zram);
+}
+
+/*
+** Creates a new zram device of the given size, rounded down to a multiple
+** of the page size.
+*/
+status_t
+register_zram(char const *name, size_t size)
+{
+	struct zram_bdev *zram;
+	status_t ret;
+
+	if (size / PAGE_SIZE == 0) {
+		return (ERR_INVALID_ARGS);
+	}
+	zram = kcalloc(1, sizeof(struct zram_bdev));
+	if (zram == NULL) {
+		return (ERR_NO_MEMORY);
+	}
+	zram->nb_slots = size / PAGE_SIZE;
+	zram->slots = kcalloc(zram->nb_slots, sizeof(struct zram_slot));
+	zram->ctx = kalloc(sizeof(struct lz4_ctx));
+	zram->buffer = kalloc(ZRAM_MAX_COMPRESSED);
+	if (zram->slots == NULL || zram->ctx == NULL || zram->buffer == NULL) {
+		ret = ERR_NO_MEMORY;
+		goto err;
+	}
+	ret = bdev_init(&zram->bdev,
+			name,
+			ZRAM_BLOCKSIZE,
+			zram->nb_slots,
+			BDEV_FLAGS_NONE
+	);
+	if (ret) {
+		goto err;
+	}
+
+	init_lock(&zram->lock);
+	zram->bdev.read = &zram_read;
+	zram->bdev.write = &zram_write;
+	zram->bdev.close = &zram_close;
+	bdev_register(&zram->bdev);
+	return (OK);
+
+err:
+	kfree(zram->slots);
+	kfree(zram->ctx);
+	kfree(zram->buffer);
+	kfree(zram);
+	return (ret);
+}
+
+/*
+** Copies the statistics of the given zram device.
+*/
+status_t
+zram_get_stats(struct bdev *bdev, struct zram_stats *stats)
+{
+	struct zram_bdev *zram;
+
+	if (bdev->read != &zram_read) {
+		return (ERR_INVALID_ARGS);
+	}
+	zram = (struct zram_bdev *)bdev;
+	LOCK(&zram->lock, state);
+	*stats = zram->stats;
+	RELEASE(&zram->lock, state);
+	return (OK);
+}
+
+void
+zram_print_stats(struct bdev *bdev)
+{
+	struct zram_stats stats;
+
+	if (zram_get_stats(bdev, &stats) != OK) {
+		return ;
+	}
+	printf("%s: %u pages (%u same-filled, %u raw), %r -> %r (%u%%)\n"
+		"\treads: %u (avg %u cycles, max %u)\n"
+		"\twrites: %u (avg %u cycles, max %u), %u failed\n",
+		bdev->name,
+		stats.nb_stored,
+		stats.nb_same_filled,
+		stats.nb_raw,
+		stats.orig_size,
+		stats.compr_size,
+		stats.orig_size ? stats.compr_size * 100 / stats.orig_size : 0,
+		stats.nb_reads,
+		stats.read_latency,
+		stats.max_read_latency,
+		stats.nb_writes,
+		stats.write_latency,
+		stats.max_write_latency,
+		stats.nb_failed_writes
+	);
+}
+
+/*
+** Zram tests, both as a raw block device and as a swap device.
+*/
+static void __init
+zram_test(void)
+{
+	struct bdev *bdev;
+	struct zram_stats stats;
+	uchar *page;
+	uchar *out;
+	virt_addr_t va;
+	uint32 seed;
+	size_t i;
+
+	page = kalloc(PAGE_SIZE);
+	out = kalloc(PAGE_SIZE);
+	assert_neq(page, NULL);
+	assert_neq(out, NULL);
+	assert_eq(register_zram("zram-test", 4 * PAGE_SIZE), OK);
+	bdev = bdev_open("zram-test");
+	assert_neq(bdev, NULL);
+
+	/* Empty slots read as zeroes */
+	memset(out, 0xFF, PAGE_SIZE);
+	assert_eq(bdev_read(bdev, out, 0, PAGE_SIZE), PAGE_SIZE);
+	assert_eq(out[0], 0);
+	assert_eq(out[PAGE_SIZE - 1], 0);
+
+	/* Same-filled pages */
+	memset(page, 0, PAGE_SIZE);
+	assert_eq(bdev_write(bdev, page, 0, PAGE_SIZE), PAGE_SIZE);
+	memset(page, 0x2a, PAGE_SIZE);
+	assert_eq(bdev_write(bdev, page, PAGE_SIZE, PAGE_SIZE), PAGE_SIZE);
+	assert_eq(bdev_read(bdev, out, PAGE_SIZE, PAGE_SIZE), PAGE_SIZE);
+	assert_eq(memcmp(page, out, PAGE_SIZE), 0);
+	assert_eq(zram_get_stats(bdev, &stats), OK);
+	assert_eq(stats.nb_stored, 2);
+	assert_eq(stats.nb_same_filled, 2);
+	assert_eq(stats.compr_size, 0);
+
+	/* Compressible page */
+	i = 0;
+	while (i < PAGE_SIZE) {
+		page[i] = "chaos"[i % 5] + (i / 512);
+		++i;
+	}
+	assert_eq(bdev_write(bdev, page, 2 * PAGE_SIZE, PAGE_SIZE), PAGE_SIZE);
+	assert_eq(bdev_read(bdev, out, 2 * PAGE_SIZE, PAGE_SIZE), PAGE_SIZE);
+	assert_eq(memcmp(page, out, PAGE_SIZE), 0);
+	assert_eq(zram_get_stats(bdev, &stats), OK);
+	assert_eq(stats.nb_raw, 0);
+	assert_gr(stats.compr_size, 0);
+	assert_lo(stats.compr_size, PAGE_SIZE / 4);
+
+	/* Incompressible page (xorshift noise), overwriting a same-filled one */
+	seed = 42;
+	i = 0;
+	while (i < PAGE_SIZE) {
+		seed ^= seed << 13u;
+		seed ^= seed >> 17u;
+		seed ^= seed << 5u;
+		page[i] = seed;
+		++i;
+	}
+	assert_eq(bdev_write(bdev, page, 0, PAGE_SIZE), PAGE_SIZE);
+	assert_eq(bdev_read(bdev, out, 0, PAGE_SIZE), PAGE_SIZE);
+	assert_eq(memcmp(page, out, PAGE_SIZE), 0);
+	assert_eq(zram_get_stats(bdev, &stats), OK);
+	assert_eq(stats.nb_stored, 3);
+	assert_eq(stats.nb_same_filled, 1);
+	assert_eq(stats.nb_raw, 1);
+
+	/* Unaligned accesses are refused */
+	assert_eq(bdev_read(bdev, out, 42, PAGE_SIZE), -1);
+
+	/* Swap device */
+	assert_eq(swap_on("zram-test"), OK);
+	va = (virt_addr_t)0x10000000;
+	assert_eq(mmap(va, PAGE_SIZE, MMAP_USER | MMAP_WRITE), va);
+	memset(va, 0x2a, PAGE_SIZE);
+	assert_eq(swap_out_page(va), OK);
+	assert(!arch_is_allocated(va));
+	assert_eq(*(volatile uchar *)(va + 42), 0x2a);
+	munmap(va, PAGE_SIZE);
+	assert_eq(swap_off(), OK);
+
+	bdev_unregister(bdev);
+	bdev_close(bdev);
+	kfree(page);
+	kfree(out);
+}
+
+/*
+** Creates a zram device and swaps on it if the --zram option was given.
+*/
+static void __init
+zram_init(enum init_level il __unused)
+{
+	if (cmd_options.zram)
+	{
+		if (register_zram("zram0", ZRAM_DEFAULT_SIZE) == OK && swap_on("zram0") == OK) {
+			printf("[OK]\tZram swap (Size: %r)\n", ZRAM_DEFAULT_SIZE);
+		} else {
+			printf("[!!]\tZram swap\n");
+		}
+	}
+}
+
+/* After the swap unit tests, which need the swap to be off */
+NEW_INIT_HOOK(zram, &zram_init, CHAOS_INIT_LEVEL_BDEV + 1);
+NEW_UNIT_TEST(zram, &zram_test, UNIT_TEST_LEVEL_SWAP);
@@ -0,0 +1,264 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#include <lib/compress/lz4.h>
+#include <debug.h>
+#include <string.h>
+
+/*
+** A compressor and decompressor for the LZ4 block format.
+**
+** A block is a list of sequences, each made of a token, some literals
+** and a match:
+**   - The high nibble of the token is the number of literals, and the low
+**     nibble the length of the match minus LZ4_MIN_MATCH. A nibble equal
+**     to 15 means additional length bytes follow, until one isn't 255.
+**   - The match is a 16-bit little-endian offset to copy the data from.
+**
+** The last sequence has no match, and the last LZ4_LAST_LITERALS bytes of the
+** input are always literals.
+**
+** The compressor favours speed over ratio: a single hash table of the last
+** position of each 4-byte sequence, no chaining.
+*/
+
+# define LZ4_MIN_MATCH		4
+# define LZ4_LAST_LITERALS	5
+# define LZ4_MF_LIMIT		12
+# define LZ4_MAX_OFFSET		0xFFFF
+
+static inline uint32
+lz4_read32(uchar const *p)
+{
+	uint32 val;
+
+	memcpy(&val, p, sizeof(val));
+	return (val);
+}
+
+static inline uint
+lz4_hash(uint32 seq)
+{
+	return ((seq * 2654435761u) >> (32 - LZ4_HASH_LOG));
+}
+
+static inline uchar *
+lz4_write_length(uchar *op, size_t len)
+{
+	while (len >= 255) {
+		*op++ = 255;
+		len -= 255;
+	}
+	*op++ = len;
+	return (op);
+}
+
+/*
+** Writes a sequence and returns a pointer on the byte that follows it,
+** or NULL if the output buffer is too small.
+** A match_len of 0 means this is the last sequence.
+*/
+static uchar *
+lz4_write_sequence(uchar *op,
+		   uchar const *oend,
+		   uchar const *lit,
+		   size_t lit_len,
+		   size_t offset,
+		   size_t match_len)
+{
+	uchar *token;
+
+	if (op + 1 + lit_len + lit_len / 255 + 1 + 2 + match_len / 255 + 1 > oend) {
+		return (NULL);
+	}
+	token = op++;
+	if (lit_len >= 15) {
+		*token = 15 << 4;
+		op = lz4_write_length(op, lit_len - 15);
+	} else {
+		*token = lit_len << 4;
+	}
+	memcpy(op, lit, lit_len);
+	op += lit_len;
+	if (match_len)
+	{
+		*op++ = offset & 0xFF;
+		*op++ = (offset >> 8) & 0xFF;
+		match_len -= LZ4_MIN_MATCH;
+		if (match_len >= 15) {
+			*token |= 15;
+			op = lz4_write_length(op, match_len - 15);
+		} else {
+			*token |= match_len;
+		}
+	}
+	return (op);
+}
+
+/*
+** Compresses 'src' to 'dst'.
+** Returns the size of the compressed data, or 0 if it doesn't fit in 'dst'.
+*/
+size_t
+lz4_compress(void const *src,
+	     size_t src_len,
+	     void *dst,
+	     size_t dst_len,
+	     struct lz4_ctx *ctx)
+{
+	uchar const *base;
+	uchar const *ip;
+	uchar const *anchor;
+	uchar const *match;
+	uchar const *mflimit;
+	uchar const *mlimit;
+	uchar *op;
+	uchar const *oend;
+	size_t match_len;
+	uint h;
+
+	assert(src_len <= LZ4_MAX_INPUT_SIZE);
+
+	base = src;
+	ip = base;
+	anchor = base;
+	op = dst;
+	oend = op + dst_len;
+
+	if (src_len > LZ4_MF_LIMIT)
+	{
+		memset(ctx->table, 0, sizeof(ctx->table));
+		mflimit = base + src_len - LZ4_MF_LIMIT;
+		mlimit = base + src_len - LZ4_LAST_LITERALS;
+		++ip;
+		while (ip < mflimit)
+		{
+			h = lz4_hash(lz4_read32(ip));
+			match = base + ctx->table[h];
+			ctx->table[h] = ip - base;
+			if (lz4_read32(match) != lz4_read32(ip)
+			    || (size_t)(ip - match) > LZ4_MAX_OFFSET) {
+				++ip;
+				continue;
+			}
+
+			/* Extend the match backward, over the pending literals */
+			while (ip > anchor && match > base && ip[-1] == match[-1]) {
+				--ip;
+				--match;
+			}
+
+			match_len = LZ4_MIN_MATCH;
+			while (ip + match_len < mlimit && ip[match_len] == match[match_len]) {
+				++match_len;
+			}
+
+			op = lz4_write_sequence(op, oend, anchor, ip - anchor, ip - match, match_len);
+			if (op == NULL) {
+				return (0);
+			}
+			ip += match_len;
+			anchor = ip;
+		}
+	}
+
+	op = lz4_write_sequence(op, oend, anchor, base + src_len - anchor, 0, 0);
+	if (op == NULL) {
+		return (0);
+	}
+	return (op - (uchar *)dst);
+}
+
+/*
+** Reads a length extension, adding it to 'len'.
+** Returns NULL if the input is truncated.
+*/
+static uchar const *
+lz4_read_length(uchar const *ip, uchar const *iend, size_t *len)
+{
+	uchar byte;
+
+	do {
+		if (ip >= iend) {
+			return (NULL);
+		}
+		byte = *ip++;
+		*len += byte;
+	} while (byte == 255);
+	return (ip);
+}
+
+/*
+** Decompresses 'src' to 'dst'.
+** Returns the size of the decompressed data, or -1 if the input is
+** malformed or doesn't fit in 'dst'.
+*/
+ssize_t
+lz4_decompress(void const *src, size_t src_len, void *dst, size_t dst_len)
+{
+	uchar const *ip;
+	uchar const *iend;
+	uchar *op;
+	uchar *oend;
+	uchar const *match;
+	uchar token;
+	size_t len;
+	size_t offset;
+
+	ip = src;
+	iend = ip + src_len;
+	op = dst;
+	oend = op + dst_len;
+	while (ip < iend)
+	{
+		token = *ip++;
+
+		/* Literals */
+		len = token >> 4;
+		if (len == 15 && (ip = lz4_read_length(ip, iend, &len)) == NULL) {
+			return (-1);
+		}
+		if (len > (size_t)(iend - ip) || len > (size_t)(oend - op)) {
+			return (-1);
+		}
+		memcpy(op, ip, len);
+		op += len;
+		ip += len;
+
+		/* The last sequence has no match */
+		if (ip == iend) {
+			break;
+		}
+
+		/* Match */
+		if (iend - ip < 2) {
+			return (-1);
+		}
+		offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > (size_t)(op - (uchar *)dst)) {
+			return (-1);
+		}
+		len = token & 0xF;
+		if (len == 15 && (ip = lz4_read_length(ip, iend, &len)) == NULL) {
+			return (-1);
+		}
+		len += LZ4_MIN_MATCH;
+		if (len > (size_t)(oend - op)) {
+			return (-1);
+		}
+
+		/* Byte per byte, as the match may overlap the output */
+		match = op - offset;
+		while (len--) {
+			*op++ = *match++;
+		}
+	}
+	return (op - (uchar *)dst);
+}
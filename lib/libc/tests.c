@@ -11,7 +11,7 @@
 #include <debug.h>
 #include <string.h>
 
-static void
+static void __init
 strcmp_tests(void)
 {
 	assert_eq(strcmp("", ""), 0);
@@ -25,7 +25,7 @@ strcmp_tests(void)
 	assert_lo(strcmp("qwerty", "qwertz"), 0);
 }
 
-static void
+static void __init
 strncmp_tests(void)
 {
 	assert_eq(strncmp(NULL, NULL, 0), 0);
@@ -73,7 +73,7 @@ strncmp_tests(void)
 	assert_lo(strncmp("qwerty", "qwertz", 7), 0);
 }
 
-static void
+static void __init
 strstr_tests(void)
 {
 	char *a;
@@ -106,7 +106,7 @@ strstr_tests(void)
 	assert_eq(strstr(a, e), a);
 }
 
-static void
+static void __init
 libc_tests(void)
 {
 	strcmp_tests();
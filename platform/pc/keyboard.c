@@ -9,6 +9,9 @@
 
 #include <kernel/init.h>
 #include <kernel/interrupts.h>
+#include <kernel/thread.h>
+#include <kernel/waitqueue.h>
+#include <kernel/workqueue.h>
 #include <arch/x86/asm.h>
 #include <platform/pc/keyboard.h>
 #include <stdio.h>
@@ -54,6 +57,24 @@ static volatile char input_buffer[PAGE_SIZE] = { 0 };
 static volatile size_t input_write_idx = 0;
 static volatile size_t input_read_idx = 0;
 
+/* Threads waiting for a key to be pressed */
+static struct wait_queue input_wq = WAIT_QUEUE_INIT_VALUE(input_wq);
+
+/* Wakes up the readers, out of the interrupt handler */
+static struct work input_work;
+
+extern struct spinlock thread_table_lock;
+
+static void
+keyboard_input_work(void *arg __unused)
+{
+	wait_queue_wake_all(&input_wq);
+}
+
+/*
+** Only stores the pressed key: waking up the readers is deferred to the
+** system work queue.
+*/
 static enum handler_return
 keyboard_int_handler(void)
 {
@@ -66,28 +87,34 @@ keyboard_int_handler(void)
 		{
 			input_buffer[input_write_idx] = code;
 			input_write_idx = (input_write_idx + 1) % PAGE_SIZE;
+			queue_work(system_wq, &input_work);
 		}
 	}
-	return (IRQ_RESCHEDULE);
+	return (IRQ_NO_RESCHEDULE);
 }
 
 /*
-** Sends the next char or loops until the user presses a key.
+** Sends the next char or sleeps until the user presses a key.
 */
 char
 keyboard_next_input(void)
 {
 	char c;
 
-	while (input_read_idx == input_write_idx);
+	LOCK_THREAD(state);
+	while (input_read_idx == input_write_idx) {
+		wait_queue_sleep(&input_wq);
+	}
 	c = input_buffer[input_read_idx];
 	input_read_idx = (input_read_idx + 1) % PAGE_SIZE;
+	RELEASE_THREAD(state);
 	return (c);
 }
 
-static void
+static void __init
 keyboard_init(enum init_level il __unused)
 {
+	work_init(&input_work, &keyboard_input_work, NULL);
 	register_int_handler(KEYBOARD_INT_HANDLER, &keyboard_int_handler);
 }
 
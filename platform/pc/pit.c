@@ -0,0 +1,106 @@
+/* ------------------------------------------------------------------------ *\
+**
+**  This file is part of the Chaos Kernel, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2017 - Benjamin Grange <benjamin.grange@epitech.eu>
+**
+\* ------------------------------------------------------------------------ */
+
+#include <kernel/init.h>
+#include <kernel/timer.h>
+#include <arch/x86/asm.h>
+#include <platform/pc/pit.h>
+#include <config.h>
+#include <stdio.h>
+#include <debug.h>
+
+/* The divisor must fit in the 16 bits reload register */
+static_assert(PIT_TICK_DIVISOR > 0 && PIT_TICK_DIVISOR <= 0xFFFF);
+
+static void
+pit_program(uchar cmd, ushort count)
+{
+	outb(PIT_COMMAND_IO_PORT, cmd);
+	outb(PIT_CHANNEL0_IO_PORT, count & 0xFF);
+	outb(PIT_CHANNEL0_IO_PORT, (count >> 8u) & 0xFF);
+}
+
+/*
+** Raises the timer interrupt HZ times per second.
+*/
+void
+platform_timer_periodic(void)
+{
+	pit_program(PIT_CMD_CHANNEL0_RATE, PIT_TICK_DIVISOR);
+}
+
+/*
+** Raises a single timer interrupt in the given number of ticks.
+** The counter is only 16 bits wide, so the delay is capped. Returns the
+** number of ticks that was actually programmed.
+*/
+uint
+platform_timer_oneshot(uint nb_ticks)
+{
+	uint max;
+
+	max = 0xFFFF / PIT_TICK_DIVISOR;
+	nb_ticks = nb_ticks > max ? max : nb_ticks;
+	pit_program(PIT_CMD_CHANNEL0_ONESHOT, nb_ticks * PIT_TICK_DIVISOR);
+	return (nb_ticks);
+}
+
+/*
+** Stops the timer interrupt.
+** The counter stops when the mode is set, until a new count is written.
+*/
+void
+platform_timer_stop(void)
+{
+	outb(PIT_COMMAND_IO_PORT, PIT_CMD_CHANNEL0_ONESHOT);
+}
+
+/*
+** Busy-waits for the given number of microseconds, using channel 2 so
+** the timer interrupt isn't disturbed.
+** Works with interrupts disabled.
+*/
+void
+platform_udelay(uint usec)
+{
+	uint chunk;
+	uint count;
+	uchar gate;
+
+	while (usec > 0)
+	{
+		/* The counter is only 16 bits wide, so wait ~50ms at most at once */
+		chunk = usec > 50000 ? 50000 : usec;
+		count = (PIT_FREQUENCY / 1000u) * chunk / 1000u;
+		count = count ? count : 1;
+
+		gate = inb(PIT_CHANNEL2_GATE_IO_PORT) & ~PIT_CHANNEL2_SPEAKER;
+		outb(PIT_CHANNEL2_GATE_IO_PORT, gate & ~PIT_CHANNEL2_GATE);
+		outb(PIT_COMMAND_IO_PORT, PIT_CMD_CHANNEL2_ONESHOT);
+		outb(PIT_CHANNEL2_IO_PORT, count & 0xFF);
+		outb(PIT_CHANNEL2_IO_PORT, (count >> 8u) & 0xFF);
+		outb(PIT_CHANNEL2_GATE_IO_PORT, gate | PIT_CHANNEL2_GATE);
+		while (!(inb(PIT_CHANNEL2_GATE_IO_PORT) & PIT_CHANNEL2_OUTPUT))
+			;
+		usec -= chunk;
+	}
+}
+
+/*
+** Programs the PIT to raise the timer interrupt HZ times per second,
+** instead of the ~18.2Hz set by the BIOS.
+*/
+static void __init
+pit_init(enum init_level il __unused)
+{
+	platform_timer_periodic();
+	printf("[OK]\tTimer (%uHz)\n", HZ);
+}
+
+NEW_INIT_HOOK(pit, &pit_init, CHAOS_INIT_LEVEL_PLATFORM);
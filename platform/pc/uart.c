@@ -45,7 +45,7 @@ uart_putsn(char const *str, size_t n)
 	return (n);
 }
 
-static void
+static void __init
 uart_init(enum init_level il __unused)
 {
 	struct io_output_callbacks cb;
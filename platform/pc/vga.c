@@ -178,7 +178,7 @@ vga_putsn(char const *str, size_t n)
 /*
 ** Initializes the vga driver
 */
-static void
+static void __init
 vga_init(enum init_level il __unused)
 {
 	struct io_output_callbacks cb;
@@ -147,6 +147,11 @@ void *kalloc(size_t);
 void kfree(void *);
 void strcat(char *, char *);
 void strcpy(char *, char *);
+uint64 get_ticks(void);
+
+/* Rounds of open, close and fork done by each worker of the stress command */
+# define STRESS_ROUNDS		200
+# define STRESS_MAX_WORKERS	4
 
 static void
 print_dir_content(char *pwd)
@@ -249,6 +254,62 @@ exec_divzero(void)
 	return (j);
 }
 
+static void
+stress_worker(void)
+{
+	pid_t pid;
+	int fd;
+	int i;
+
+	for (i = 0; i < STRESS_ROUNDS; ++i)
+	{
+		fd = open(".");
+		assert_neq(fd, -1);
+		close(fd);
+		pid = fork();
+		assert_neq(pid, -1);
+		if (pid == 0) {
+			exit();
+		}
+		waitpid(pid);
+	}
+	exit();
+}
+
+/*
+** Runs 1, 2 then 4 workers at the same time, each of them opening, closing
+** and forking in a loop, and prints the time they took.
+** With enough processors, it should stay about the same as the number of
+** workers grows.
+*/
+static int
+exec_stress(void)
+{
+	pid_t pids[STRESS_MAX_WORKERS];
+	uint64 start;
+	int nb;
+	int i;
+
+	for (nb = 1; nb <= STRESS_MAX_WORKERS; nb *= 2)
+	{
+		start = get_ticks();
+		for (i = 0; i < nb; ++i)
+		{
+			pids[i] = fork();
+			assert_neq(pids[i], -1);
+			if (pids[i] == 0) {
+				stress_worker();
+			}
+		}
+		for (i = 0; i < nb; ++i) {
+			waitpid(pids[i]);
+		}
+		printf("%i worker(s): %u ticks\n", nb, (uint)(get_ticks() - start));
+	}
+	exit();
+	return (0);
+}
+
 static struct cmd cmds[] =
 {
 	{"help", "prints this help", &exec_help},
@@ -256,6 +317,7 @@ static struct cmd cmds[] =
 	{"ls", "lists filesystem", &exec_ls},
 	{"sigsev", "produces a segmentation fault", &exec_sigsev},
 	{"divz","produces a division by zero", &exec_divzero},
+	{"stress", "forks, opens and closes on all processors", &exec_stress},
 
 	{NULL, NULL, NULL},
 };
@@ -272,20 +334,17 @@ parse_command(char const *cmd)
 	fill_argv(strdup(cmd), argv);
 	while (c->name) {
 		if (!strcmp(c->name, cmd)) {
-			pid = fork();
-			assert_neq(pid, -1);
-			if (pid == 0) {
-				execve(c->name, c->func, argv);
-				puts("execve failed\n");
-				exit();
-			} else {
-				status = waitpid(pid);
-				if (status == 139) {
-					puts("Segmentation Fault\n");
-				}
-				else if (status == 136) {
-					puts("Floating Point exception\n");
-				}
+			pid = spawn(c->name, c->func, argv);
+			if (pid == -1) {
+				puts("spawn failed\n");
+				return ;
+			}
+			status = waitpid(pid);
+			if (status == 139) {
+				puts("Segmentation Fault\n");
+			}
+			else if (status == 136) {
+				puts("Floating Point exception\n");
 			}
 			return ;
 		}